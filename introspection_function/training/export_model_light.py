@@ -1,12 +1,14 @@
-import sys, os, argparse
+import sys, os, argparse, glob
 sys.path.append(os.path.join(os.path.dirname(sys.path[0])))
 
 from skimage import io
 import torch
+import torch.nn as nn
 import torchvision
 from torchvision import transforms
 import numpy as np
 import cv2
+import copy
 
 from config import cfg
 from networks.models_light import ModelBuilder, IntrospectionModule
@@ -19,6 +21,76 @@ from lib.utils.utils import MaskedMSELoss
 USE_TRACING=True
 LOAD_EXAMPLE_INPUT_FROM_FILE=False
 
+# Applies the same preprocessing as IntrospectionSession in the C++ code
+def load_input_img(path):
+  normalize = transforms.Normalize(mean=[0.485, 0.456, 0.406],
+                                    std=[0.229, 0.224, 0.225])
+  data_transform_input = transforms.Compose([
+          transforms.ToTensor(),
+          normalize
+      ])
+
+  img = io.imread(path)
+  if len(img.shape) > 2:
+    img = img[:, : , 0:3]
+    img = img.reshape((img.shape[0], img.shape[1], 3))
+  else:
+    img = img.reshape((img.shape[0], img.shape[1], 1))
+    img = np.repeat(img, 3, axis=2)
+
+  img = transforms.ToPILImage()(img)
+  img = data_transform_input(img)
+  return img.reshape((1, 3, img.shape[1], img.shape[2]))
+
+# Loads num_imgs images evenly spread over the images in img_dir
+def load_calibration_imgs(img_dir, num_imgs):
+  paths = sorted(glob.glob(os.path.join(img_dir, '*.png')) +
+                 glob.glob(os.path.join(img_dir, '*.jpg')))
+  if len(paths) == 0:
+    raise Exception('No calibration images found in ' + img_dir)
+  step = max(1, len(paths) // num_imgs)
+  return [load_input_img(path) for path in paths[::step][:num_imgs]]
+
+# Runs the wrapped network in fp16 while keeping fp32 inputs and outputs, so
+# that the C++ code does not need to change. Meant for GPU deployment; most
+# CPU kernels do not support fp16.
+class HalfPrecisionWrapper(nn.Module):
+  def __init__(self, net):
+    super(HalfPrecisionWrapper, self).__init__()
+    self.net = net.half()
+
+  def forward(self, input):
+    return self.net(input.half()).float()
+
+# Dynamic quantization only converts the weights of Linear (and recurrent)
+# layers to int8. The introspection networks are fully convolutional, so this
+# mainly helps models with fully connected heads.
+def quantize_dynamic(net, engine):
+  torch.backends.quantized.engine = engine
+  return torch.quantization.quantize_dynamic(net, {nn.Linear},
+                                             dtype=torch.qint8)
+
+# Static int8 quantization with FX graph mode. Convolutions, batch norms and
+# ReLUs are fused and the activation ranges are calibrated on calib_imgs.
+def quantize_static(net, calib_imgs, engine):
+  from torch.quantization import get_default_qconfig
+  from torch.quantization.quantize_fx import prepare_fx, convert_fx
+
+  torch.backends.quantized.engine = engine
+  qconfig = get_default_qconfig(engine)
+  try:
+    # PyTorch >= 1.13
+    from torch.ao.quantization import QConfigMapping
+    prepared = prepare_fx(net, QConfigMapping().set_global(qconfig),
+                          (calib_imgs[0],))
+  except ImportError:
+    prepared = prepare_fx(net, {"": qconfig})
+
+  with torch.no_grad():
+    for img in calib_imgs:
+      prepared(img)
+  return convert_fx(prepared)
+
 def main():
   parser = argparse.ArgumentParser(description='Convert Pytorch models '
                                     'to Torch Script for use in CPP.')
@@ -33,8 +105,33 @@ def main():
                     default=None,
                     help="Path to the converted torch script model",
                     required=True)
+  parser.add_argument("--precision",
+                    default="fp32",
+                    choices=["fp32", "fp16", "int8_dynamic", "int8_static"],
+                    help="Precision of the exported model. fp16 needs a GPU "
+                    "and int8_static needs --calib_img_dir.")
+  parser.add_argument("--quant_engine",
+                    default="fbgemm",
+                    choices=["fbgemm", "qnnpack"],
+                    help="Quantized backend the int8 model is exported for: "
+                    "fbgemm for x86 and qnnpack for ARM. Pass the same value "
+                    "to --introspection_quantized_engine at run-time.")
+  parser.add_argument("--calib_img_dir",
+                    default=None,
+                    help="Directory of images used to calibrate the "
+                    "activation ranges for int8_static, e.g. the image_0 "
+                    "directory of a training sequence.")
+  parser.add_argument("--num_calib_imgs",
+                    default=32,
+                    type=int,
+                    help="Number of calibration images.")
   args = parser.parse_args()
 
+  if args.precision == "int8_static" and args.calib_img_dir is None:
+    parser.error("--calib_img_dir is required for int8_static.")
+  if args.precision == "fp16" and not torch.cuda.is_available():
+    parser.error("fp16 export needs a GPU.")
+
   cfg.merge_from_file(args.cfg)
 
   cfg.MODEL.weights_encoder = cfg.TEST.test_model_encoder
@@ -84,40 +181,40 @@ def main():
 
   # *******************
   # Example image input:
-  if LOAD_EXAMPLE_INPUT_FROM_FILE:
-    normalize = transforms.Normalize(mean=[0.485, 0.456, 0.406],
-                                      std=[0.229, 0.224, 0.225])
-    data_transform_input = transforms.Compose([
-            transforms.ToTensor(),
-            normalize
-        ])
-
+  calib_imgs = None
+  if args.calib_img_dir is not None:
+    calib_imgs = load_calibration_imgs(args.calib_img_dir,
+                                       args.num_calib_imgs)
+    img = calib_imgs[0]
+  elif LOAD_EXAMPLE_INPUT_FROM_FILE:
     example_img = "/media/ssd2/datasets/Jackal_Visual_Odom/sequences/00037/image_0/000984.png"
-
-    img = io.imread(example_img)
-    if len(img.shape) > 2:
-      img = img[:, : , 0:3]
-      img = img.reshape((img.shape[0], img.shape[1], 3))
-    else:
-      img = img.reshape((img.shape[0], img.shape[1], 1))
-      img = np.repeat(img, 3, axis=2)
-    
-
-    img = transforms.ToPILImage()(img)
-    img = data_transform_input(img)
-    img = img.reshape((1, 3, img.shape[1], img.shape[2]))
+    img = load_input_img(example_img)
   else:
     img = torch.rand(1, 3, 1024, 1224)
   # ***********************
 
+  # Convert the model to the requested precision
+  net.eval()
+  device = torch.device('cpu')
+  if args.precision == "fp16":
+    device = torch.device('cuda')
+    deploy_net = HalfPrecisionWrapper(copy.deepcopy(net).to(device))
+  elif args.precision == "int8_dynamic":
+    deploy_net = quantize_dynamic(copy.deepcopy(net), args.quant_engine)
+  elif args.precision == "int8_static":
+    deploy_net = quantize_static(copy.deepcopy(net), calib_imgs,
+                                 args.quant_engine)
+  else:
+    deploy_net = net
+  deploy_net.eval()
+
   # Use torch.jit.trace to generate a torch.jit.ScriptModule via tracing.
   if USE_TRACING:
-    net.eval()
-    script_module = torch.jit.trace(net, img)
+    script_module = torch.jit.trace(deploy_net, img.to(device))
     script_module.save(args.output_model)
   else:
     # Convert the pytorch model to a ScriptModule via annotation
-    script_module = torch.jit.script(net)
+    script_module = torch.jit.script(deploy_net)
     script_module.save(args.output_model)
 
   
@@ -128,13 +225,17 @@ def main():
   script_module.eval()
   net.eval()
 
-  for model, name in zip([script_module, net], ['scrpt_model', 'orig_model']):
+  outputs = []
+  for model, name, model_device in zip([script_module, net],
+                                       ['scrpt_model', 'orig_model'],
+                                       [device, torch.device('cpu')]):
     
     print('input img: ', img.shape)
     with torch.set_grad_enabled(False):
-      output_img = model(img)
+      output_img = model(img.to(model_device)).cpu()
     print(type(output_img))
     print("output_img: ", output_img.shape)
+    outputs.append(output_img)
 
 
     # Visualize input img
@@ -156,6 +257,13 @@ def main():
     heatmap_color = cv2.applyColorMap(output_np, cv2.COLORMAP_JET)
     cv2.imwrite("output_" + name + ".png", heatmap_color)
 
+  # Deviation of the exported model from the fp32 model in 8-bit cost levels.
+  # Use introspection_model_benchmark in introspective_ORB_SLAM/benchmarks
+  # to compare the two over a whole sequence.
+  abs_diff = 255.0 * (outputs[0] - outputs[1]).abs()
+  print("Exported model vs. original: mean abs diff %.3f, max abs diff %.3f "
+        "(cost levels)" % (abs_diff.mean().item(), abs_diff.max().item()))
+
 
 
 if __name__=="__main__":
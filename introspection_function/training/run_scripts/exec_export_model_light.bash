@@ -3,4 +3,15 @@
  python \
 ../export_model_light.py \
  --cfg "../../config/jackal/jackal_mobilenetv2dialated-c1_deepsup_reg.yaml" \
- --output_model "iv_jackal_mobilenet_c1deepsup_light.pt"
\ No newline at end of file
+ --output_model "iv_jackal_mobilenet_c1deepsup_light.pt"
+
+# int8 model for CPU-only deployment. Run stereo_kitti with
+# --introspection_quantized_engine=fbgemm (x86) or qnnpack (ARM), matching
+# --quant_engine below.
+#  python \
+# ../export_model_light.py \
+#  --cfg "../../config/jackal/jackal_mobilenetv2dialated-c1_deepsup_reg.yaml" \
+#  --output_model "iv_jackal_mobilenet_c1deepsup_light_int8.pt" \
+#  --precision "int8_static" \
+#  --quant_engine "fbgemm" \
+#  --calib_img_dir "../../../Jackal_Visual_Odom/sequences/00037/image_0"
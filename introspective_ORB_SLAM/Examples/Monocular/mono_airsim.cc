@@ -283,6 +283,9 @@ int main(int argc, char **argv)
 
     // Main loop
     cv::Mat im;
+    // The ground truth depth images are read into the same buffer every frame.
+    // SLAM does not use them after the Track call returns.
+    cv::Mat gt_depth_buffer;
     
     int end_frame;
     if(FLAGS_end_frame > 0) {
@@ -312,14 +315,16 @@ int main(int argc, char **argv)
         // Read the depth image
         cv::Mat depth_im;
         if (FLAGS_load_gt_depth_imgs) {
+          // The depth images are used in the row order in which they are
+          // stored in the file.
           PFM pfm_rw;
-          float * depth_data = 
-                        pfm_rw.read_pfm<float>(vstrDepthImageFilenames[ni]);
-          depth_im = cv::Mat(pfm_rw.getHeight(), 
-                                    pfm_rw.getWidth(), 
-                                    CV_32F, 
-                                    depth_data);
-          cv::flip(depth_im, depth_im, 0);
+          if (!pfm_rw.read_pfm(vstrDepthImageFilenames[ni], 
+                               &gt_depth_buffer, 
+                               false)) {
+            LOG(FATAL) << "Failed to load depth image at: "
+                       << vstrDepthImageFilenames[ni];
+          }
+          depth_im = gt_depth_buffer;
           
           // Visualize and verify the depth image
   //         double min;
@@ -330,11 +335,6 @@ int main(int argc, char **argv)
   //         cv::imshow("window", adjMap); 
   //         cv::waitKey(0);
           
-          if(depth_im.empty()) {
-            cerr << endl << "Failed to load depth image at: " << 
-                            vstrDepthImageFilenames[ni] << endl;
-            return 1;
-          }
         } else if (FLAGS_load_img_qual_heatmaps) {
           // There might not be a image quality available for all input 
           // images. In that case just skip the missing ones with setting 
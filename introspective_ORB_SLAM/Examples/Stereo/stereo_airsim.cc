@@ -35,8 +35,9 @@
 #include <memory>
 
 #include"System.h"
+#include "cost_map_scheduler.h"
+#include "introspection_session.h"
 #include "io_access.h"
-#include "torch_helpers.h"
 
 #if (CV_VERSION_MAJOR >= 4)
   #include<opencv2/imgcodecs/legacy/constants_c.h>
@@ -223,24 +224,17 @@ int main(int argc, char **argv)
                  << "when the introspection function is enabled." << endl;
     }
 
-    torch::jit::script::Module introspection_func;
-    torch::Device device = torch::kCPU;
+    // The model runs on 512x512 inputs
+    IntrospectionSession introspection_func;
     if (FLAGS_introspection_func_enabled && !FLAGS_load_img_qual_heatmaps) {
-      try {
-        // Deserialize the ScriptModule from file
-        introspection_func = torch::jit::load(FLAGS_introspection_model_path);
-
-        if (FLAGS_use_gpu && torch::cuda::is_available()) {
-          std::cout << "Introspection function running on GPU." << std::endl;
-          device = torch::kCUDA;
-        }
-        introspection_func.to(device);
-      }
-      catch (const c10::Error& e) {
+      if (!introspection_func.Load(FLAGS_introspection_model_path,
+                                   FLAGS_use_gpu,
+                                   cv::Size(512, 512))) {
         std::cerr << "error loading the introspection model\n";
         return -1;
       }
     }
+    CostMapScheduler cost_map_scheduler;
   
 
     // Retrieve paths to images
@@ -299,8 +293,20 @@ int main(int argc, char **argv)
     cout << "Start frame: " << FLAGS_start_frame << endl;
       
     
+    // Warm up the introspection function before the first frame is tracked
+    if (introspection_func.IsLoaded() && FLAGS_start_frame < nImages) {
+      cv::Mat im_first = cv::imread(vstrImageLeft[FLAGS_start_frame],
+                                    CV_LOAD_IMAGE_COLOR);
+      if (!im_first.empty()) {
+        introspection_func.Warmup(im_first.size());
+      }
+    }
+
     // Main loop
     cv::Mat imLeft, imRight;
+    // The ground truth depth images are read into the same buffer every frame.
+    // SLAM does not use them after the Track call returns.
+    cv::Mat gt_depth_buffer;
     
     int end_frame;
     if(FLAGS_end_frame > 0) {
@@ -339,14 +345,16 @@ int main(int argc, char **argv)
         // Read the depth image
         cv::Mat depth_im;
         if (FLAGS_load_gt_depth_imgs) {
+          // The depth images are used in the row order in which they are
+          // stored in the file.
           PFM pfm_rw;
-          float * depth_data = 
-                        pfm_rw.read_pfm<float>(vstrDepthImageFilenames[ni]);
-          depth_im = cv::Mat(pfm_rw.getHeight(), 
-                                    pfm_rw.getWidth(), 
-                                    CV_32F, 
-                                    depth_data);
-          cv::flip(depth_im, depth_im, 0);
+          if (!pfm_rw.read_pfm(vstrDepthImageFilenames[ni], 
+                               &gt_depth_buffer, 
+                               false)) {
+            LOG(FATAL) << "Failed to load depth image at: "
+                       << vstrDepthImageFilenames[ni];
+          }
+          depth_im = gt_depth_buffer;
           
           // Visualize and verify the depth image
   //         double min;
@@ -357,11 +365,6 @@ int main(int argc, char **argv)
   //         cv::imshow("window", adjMap); 
   //         cv::waitKey(0);
           
-          if(depth_im.empty()) {
-            cerr << endl << "Failed to load depth image at: " << 
-                            vstrDepthImageFilenames[ni] << endl;
-            return 1;
-          }
 
         } else if (FLAGS_introspection_func_enabled) {
           if (FLAGS_load_img_qual_heatmaps) {
@@ -381,37 +384,12 @@ int main(int argc, char **argv)
                   return 1;
               }
             }
-          } else {
-            // Run inference on the introspection model online
-            cv::Mat imLeft_RGB = imLeft;
-            cv::cvtColor(imLeft_RGB, imLeft_RGB, CV_BGR2RGB);
-
-            cv::resize(imLeft_RGB,
-                       imLeft_RGB, cv::Size(512, 512));
-            
-            // Convert to float and normalize image
-            imLeft_RGB.convertTo(imLeft_RGB, CV_32FC3, 1.0/255.0);
-            cv::subtract(imLeft_RGB, cv::Scalar(0.485, 0.456, 0.406), imLeft_RGB);
-            cv::divide(imLeft_RGB, cv::Scalar(0.229, 0.224, 0.225), imLeft_RGB);
-
-            auto tensor_img = CVImgToTensor(imLeft_RGB);
-            // Swap axis 
-            tensor_img = TransposeTensor(tensor_img, { (2),(0),(1) });
-            // Add batch dim 
-            tensor_img.unsqueeze_(0);
-            
-            tensor_img = tensor_img.to(device);
-            std::vector<torch::jit::IValue> inputs{tensor_img};
-            at::Tensor cost_img = introspection_func.forward(inputs).toTensor();
-            cost_img = (cost_img * 255.0).to(torch::kByte);
-            cost_img = cost_img.to(torch::kCPU);
-
-            auto cost_img_cv = ToCvImage(cost_img);
-            resize(cost_img_cv, cost_img_cv, 
-                  cv::Size(imLeft.cols, imLeft.rows));
-            // ShowImage(cost_img_cv, "Predicted cost image");
-
-            depth_im = cost_img_cv;
+          } else if (cost_map_scheduler.Schedule(&SLAM, &depth_im)) {
+            // Run inference on the introspection model online. On the other
+            // frames the scheduler warps the last predicted cost map.
+            depth_im = introspection_func.Predict(imLeft);
+            // ShowImage(depth_im, "Predicted cost image");
+            cost_map_scheduler.SetPredictedCostMap(depth_im);
           }
         }
 
@@ -484,6 +462,10 @@ int main(int argc, char **argv)
     cout << "--------------------" << endl;
     cout << "Finished processing sequence located at " 
          << FLAGS_data_path << endl;
+    if (introspection_func.IsLoaded()) {
+      cout << introspection_func.GetLatencySummary() << endl;
+      cout << cost_map_scheduler.GetSummary() << endl;
+    }
     cout << "--------------------" << endl << endl;
         
     return 0;
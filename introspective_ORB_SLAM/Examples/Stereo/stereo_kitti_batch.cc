@@ -0,0 +1,353 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs stereo ORB-SLAM / IV-SLAM on a list of KITTI format sessions inside a
+// single process. The ORB vocabulary and the introspection model are loaded
+// once and shared by all the sessions, which can run one after the other or
+// concurrently on separate cores. Each session gets its own System instance
+// and its own output directories. All the sessions use the same settings
+// file and the same command line flags.
+
+#include <System.h>
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+#include <torch/script.h>
+#include <torch/torch.h>
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <opencv2/core/core.hpp>
+#include <sstream>
+#include <thread>
+
+#include "ORBVocabulary.h"
+#include "cost_map_scheduler.h"
+#include "introspection_session.h"
+#include "stereo_kitti_common.h"
+
+// Command line flags flag. The flags shared with stereo_kitti are defined in
+// stereo_kitti_common.cc.
+DEFINE_string(sessions,
+              "",
+              "Comma or space separated list of session numbers. Session "
+              "N is read from <sequences_dir>/%05d.");
+DEFINE_string(sequences_dir, "", "Directory of the source sequences.");
+DEFINE_string(ground_truth_dir,
+              "",
+              "Directory of the ground truth poses, one %05d.txt file per "
+              "session.");
+DEFINE_string(img_qual_base_dir,
+              "",
+              "Base directory of the predicted image quality heatmaps, one "
+              "%05d subdirectory per session.");
+DEFINE_string(rel_pose_uncertainty_dir,
+              "",
+              "Directory of the relative camera pose uncertainty values, one "
+              "%05d_predicted_unc.txt file per session.");
+DEFINE_string(out_visualization_base_path,
+              "",
+              "Base output path for visualization results. Each session "
+              "writes to a %05d subdirectory.");
+DEFINE_string(out_dataset_base_path,
+              "",
+              "Base output path for generated datasets. Each session writes "
+              "to a %05d subdirectory.");
+
+DEFINE_int32(num_parallel_sessions,
+             1,
+             "Number of sessions that are run concurrently.");
+
+DECLARE_bool(help);
+DECLARE_bool(helpshort);
+
+using namespace std;
+using namespace ORB_SLAM2;
+
+// Systems of the sessions that are currently running
+std::mutex active_systems_mutex;
+std::vector<ORB_SLAM2::System *> active_systems;
+
+// Per session input and output paths
+struct SessionPaths {
+  string session_str;
+  KittiSequencePaths sequence;
+  string out_visualization_path;
+  string out_dataset_path;
+};
+
+// Checks if all required command line arguments have been set
+void CheckCommandLineArgs(char **argv) {
+  vector<string> required_args = {"vocab_path",
+                                  "settings_path",
+                                  "sessions",
+                                  "sequences_dir",
+                                  "out_visualization_base_path",
+                                  "out_dataset_base_path"};
+
+  for (const string &arg_name : required_args) {
+    bool flag_not_set =
+        gflags::GetCommandLineFlagInfoOrDie(arg_name.c_str()).is_default;
+    if (flag_not_set) {
+      gflags::ShowUsageWithFlagsRestrict(argv[0], "stereo_kitti");
+      LOG(FATAL) << arg_name << " was not set." << endl;
+    }
+  }
+}
+
+vector<int> ParseSessionList(const string &sessions);
+
+SessionPaths GetSessionPaths(const int session);
+
+bool RunSession(const SessionPaths &paths,
+                ORBVocabulary *vocabulary,
+                IntrospectionSession *introspection_func,
+                const RectificationMaps &maps);
+
+void SignalHandler(int signal_num) {
+  cout << "Interrupt signal is (" << signal_num << ").\n";
+
+  // terminate program
+  {
+    std::lock_guard<std::mutex> lock(active_systems_mutex);
+    for (ORB_SLAM2::System *system : active_systems) {
+      system->ShutdownMinimal();
+    }
+  }
+
+  cout << "Exiting the program!" << endl;
+
+  exit(signal_num);
+}
+
+int main(int argc, char **argv) {
+  google::InstallFailureSignalHandler();
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_stderrthreshold = 2;   // ERROR level logging.
+  FLAGS_colorlogtostderr = 1;  // Colored logging.
+  FLAGS_logtostderr = true;    // Don't log to disk
+  signal(SIGINT, SignalHandler);
+
+  string usage(
+      "This program runs stereo ORB-SLAM on a list of KITTI format "
+      "sessions in a single process, with the option to run with IV-SLAM "
+      "in inference mode or generate training data for it. \n");
+
+  usage += string(argv[0]) + " <argument1> <argument2> ...";
+  gflags::SetUsageMessage(usage);
+
+  gflags::ParseCommandLineNonHelpFlags(&argc, &argv, true);
+  if (FLAGS_help) {
+    // Also lists the flags in stereo_kitti_common.cc
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "stereo_kitti");
+    return 0;
+  }
+  CheckCommandLineArgs(argv);
+  CheckSequenceFlags();
+
+  const vector<int> sessions = ParseSessionList(FLAGS_sessions);
+  if (sessions.empty()) {
+    LOG(FATAL) << "No sessions found in --sessions=" << FLAGS_sessions;
+  }
+  if (FLAGS_num_parallel_sessions < 1) {
+    LOG(FATAL) << "num_parallel_sessions must be at least 1.";
+  }
+
+  // The vocabulary is immutable once loaded and all the sessions share it
+  ORBVocabulary vocabulary;
+  cout << endl << "Loading ORB Vocabulary. This could take a while..." << endl;
+  if (!vocabulary.loadFromTextFile(FLAGS_vocab_path)) {
+    cerr << "Wrong path to vocabulary. " << endl;
+    cerr << "Falied to open at: " << FLAGS_vocab_path << endl;
+    return -1;
+  }
+  cout << "Vocabulary loaded!" << endl << endl;
+
+  // The model is only used for inference, which is safe to run concurrently
+  // on the same module
+  IntrospectionSession introspection_func;
+  if (FLAGS_introspection_func_enabled && !FLAGS_load_img_qual_heatmaps) {
+    if (!introspection_func.Load(FLAGS_introspection_model_path,
+                                 FLAGS_use_gpu)) {
+      std::cerr << "error loading the introspection model\n";
+      return -1;
+    }
+  }
+
+  // Read undistortion/rectification parameters. All the sessions use the
+  // same settings file, so the maps are computed once.
+  RectificationMaps maps;
+  if (!LoadRectificationMaps(FLAGS_settings_path, &maps)) {
+    return -1;
+  }
+
+  // Sessions are handed out to the workers in the given order
+  std::atomic<size_t> next_session(0);
+  std::atomic<int> failed_session_count(0);
+  auto worker = [&]() {
+    for (size_t i = next_session++; i < sessions.size();
+         i = next_session++) {
+      const SessionPaths paths = GetSessionPaths(sessions[i]);
+      if (!RunSession(paths, &vocabulary, &introspection_func, maps)) {
+        LOG(ERROR) << "Session " << paths.session_str << " failed.";
+        failed_session_count++;
+      }
+    }
+  };
+
+  const int num_workers = std::min(FLAGS_num_parallel_sessions,
+                                   static_cast<int>(sessions.size()));
+  if (num_workers == 1) {
+    worker();
+  } else {
+    vector<std::thread> workers;
+    for (int i = 0; i < num_workers; i++) {
+      workers.emplace_back(worker);
+    }
+    for (std::thread &t : workers) {
+      t.join();
+    }
+  }
+
+  cout << "--------------------" << endl;
+  cout << "Finished processing " << sessions.size() << " sessions, "
+       << failed_session_count << " failed." << endl;
+  if (introspection_func.IsLoaded()) {
+    cout << introspection_func.GetLatencySummary() << endl;
+  }
+  cout << "--------------------" << endl << endl;
+
+  return failed_session_count == 0 ? 0 : 1;
+}
+
+vector<int> ParseSessionList(const string &sessions) {
+  string list = sessions;
+  std::replace(list.begin(), list.end(), ',', ' ');
+  stringstream ss(list);
+  vector<int> session_list;
+  int session;
+  while (ss >> session) {
+    session_list.push_back(session);
+  }
+  return session_list;
+}
+
+SessionPaths GetSessionPaths(const int session) {
+  char session_str[32];
+  snprintf(session_str, sizeof(session_str), "%05d", session);
+
+  SessionPaths paths;
+  paths.session_str = session_str;
+  paths.sequence.data_path = FLAGS_sequences_dir + "/" + paths.session_str;
+  // The timestamps file is looked up the same way stereo_kitti does when
+  // --session is not set
+  paths.sequence.times_prefix = "";
+  paths.sequence.ground_truth_path =
+      FLAGS_ground_truth_dir + "/" + paths.session_str + ".txt";
+  paths.sequence.img_qual_path =
+      FLAGS_img_qual_base_dir + "/" + paths.session_str + "/";
+  paths.sequence.rel_pose_uncertainty_path = FLAGS_rel_pose_uncertainty_dir +
+                                             "/" + paths.session_str +
+                                             "_predicted_unc.txt";
+  paths.out_visualization_path =
+      FLAGS_out_visualization_base_path + "/" + paths.session_str + "/";
+  paths.out_dataset_path =
+      FLAGS_out_dataset_base_path + "/" + paths.session_str + "/";
+  return paths;
+}
+
+bool RunSession(const SessionPaths &paths,
+                ORBVocabulary *vocabulary,
+                IntrospectionSession *introspection_func,
+                const RectificationMaps &maps) {
+  cout << "*********************************" << endl;
+  cout << "Running on " << paths.session_str << endl;
+  cout << "*********************************" << endl;
+
+  // Retrieve paths to images
+  KittiSequence sequence;
+  LoadSequence(paths.sequence, &sequence);
+
+  const int nImages = sequence.image_left.size();
+
+  // Create SLAM system. The viewer is always disabled since several
+  // sessions may run at the same time. The vocabulary is shared, not copied.
+  bool enable_viewer = false;
+  bool use_BoW = true;
+  bool silent_mode = false;
+  bool guided_ba = false;
+  ORB_SLAM2::System SLAM(FLAGS_vocab_path,
+                         FLAGS_settings_path,
+                         ORB_SLAM2::System::STEREO,
+                         enable_viewer,
+                         FLAGS_ivslam_enabled,
+                         FLAGS_inference_mode,
+                         FLAGS_minloglevel,
+                         FLAGS_create_ivslam_dataset,
+                         FLAGS_run_single_threaded,
+                         use_BoW,
+                         paths.out_visualization_path,
+                         paths.out_dataset_path,
+                         silent_mode,
+                         guided_ba,
+                         vocabulary);
+  if (FLAGS_load_rel_pose_uncertainty) {
+    SLAM.SetRelativeCamPoseUncertainty(&sequence.pose_unc_map,
+                                       &sequence.rel_cam_poses_uncertainty);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(active_systems_mutex);
+    active_systems.push_back(&SLAM);
+  }
+
+  cout << "Images in session " << paths.session_str << ": " << nImages
+       << endl;
+
+  // Decides on which frames of the session the shared model is run
+  CostMapScheduler cost_map_scheduler;
+
+  const bool success = TrackSequence(
+      sequence, maps, introspection_func, &cost_map_scheduler, &SLAM);
+
+  {
+    std::lock_guard<std::mutex> lock(active_systems_mutex);
+    active_systems.erase(
+        std::remove(active_systems.begin(), active_systems.end(), &SLAM),
+        active_systems.end());
+  }
+
+  // Stop all threads. This also saves the trajectory and the dataset of the
+  // session.
+  SLAM.Shutdown();
+
+  cout << "--------------------" << endl;
+  cout << "Finished processing sequence located at "
+       << paths.sequence.data_path << endl;
+  if (introspection_func->IsLoaded()) {
+    cout << cost_map_scheduler.GetSummary() << endl;
+  }
+  cout << "--------------------" << endl << endl;
+
+  return success;
+}
@@ -0,0 +1,524 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "stereo_kitti_common.h"
+
+#include <dirent.h>
+#include <glog/logging.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <sstream>
+
+#if (CV_VERSION_MAJOR >= 4)
+#include <opencv2/imgcodecs/legacy/constants_c.h>
+#endif
+
+DEFINE_string(vocab_path, "", "Path to ORB vocabulary.");
+DEFINE_string(settings_path, "", "Path to ORB-SLAM config file.");
+DEFINE_string(introspection_model_path,
+              "",
+              "Path to the trained model "
+              "of the introspection function.");
+
+DEFINE_int32(start_frame, 0, "Start frame ID.");
+DEFINE_int32(end_frame, -1, "End frame ID.");
+
+// If set to true, the estimated camera pose uncertainty values are loaded
+// and passed to IV-SLAM
+DEFINE_bool(load_rel_pose_uncertainty,
+            false,
+            "Loads relative camera pose "
+            "uncertainty values from file.");
+
+// Set to true if you would like to use predicted heatmaps the same size as
+// the input images for weighting the extracted keypoints.
+// NOTE: If the program is run in ivslam_enabled  and inference mode but this
+// is set to false, it is equivalent to running original ORB-SLAM with the
+// additional logging and visualization that is provided in ivslam_enabled mode
+DEFINE_bool(load_img_qual_heatmaps,
+            false,
+            "Loads predicted image quality "
+            "heatmpas from file.");
+
+DEFINE_bool(run_single_threaded, false, "Runs in single threaded mode.");
+DEFINE_bool(create_ivslam_dataset,
+            false,
+            "Saves to file the dataset for "
+            "training the introspection model.");
+DEFINE_bool(ivslam_enabled,
+            false,
+            "Enables IV-SLAM. The program will run "
+            "in trainig mode unless the inference_mode flag is set.");
+DEFINE_bool(inference_mode, false, "Enables the inference mode.");
+DEFINE_bool(introspection_func_enabled,
+            false,
+            "Enables the introspection function.");
+DEFINE_bool(gt_pose_available,
+            true,
+            "If set to true, loads the ground truth "
+            "camera poses for either visualizatio or training. This must be "
+            "true in training mode or if FLAGS_map_drawer_visualize_gt_pose "
+            "is set.");
+DEFINE_bool(use_gpu, false, "Uses GPU for running the introspection function.");
+DEFINE_bool(rectify_images,
+            false,
+            "Set to true, if input images need "
+            "to be rectified.");
+DEFINE_bool(undistort_images,
+            false,
+            "Set to true, if input images need "
+            "to be undistorted.");
+
+using namespace std;
+using namespace ORB_SLAM2;
+
+namespace {
+
+void LoadImages(const string &strPathToSequence,
+                const string &session,
+                vector<string> &vstrImageLeft,
+                vector<string> &vstrImageRight,
+                vector<double> &vTimestamps);
+
+bool GetImageQualFileNames(const std::string &directory,
+                           const int &size,
+                           vector<string> *vstrImageQualFilenames,
+                           int *num_qual_imgs_found);
+
+int GetSmallestImgIdx(const std::string &directory, const int &prefix_length);
+
+}  // namespace
+
+void CheckSequenceFlags() {
+  if (!FLAGS_gt_pose_available && FLAGS_ivslam_enabled &&
+      !FLAGS_inference_mode) {
+    LOG(FATAL) << "Ground truth camera poses are required in training mode.";
+  }
+
+  if (!FLAGS_gt_pose_available && FLAGS_map_drawer_visualize_gt_pose) {
+    LOG(FATAL) << "Ground truth camera poses are not available but their "
+               << "visualization is requested!";
+  }
+}
+
+bool LoadRectificationMaps(const string &settings_path,
+                           RectificationMaps *maps) {
+  cv::FileStorage fsSettings(settings_path, cv::FileStorage::READ);
+  if (!fsSettings.isOpened()) {
+    cerr << "ERROR: Wrong path to settings" << endl;
+    return false;
+  }
+
+  cv::Mat K_l, K_r, P_l, P_r, R_l, R_r, D_l, D_r;
+  fsSettings["LEFT.K"] >> K_l;
+  fsSettings["RIGHT.K"] >> K_r;
+
+  fsSettings["LEFT.P"] >> P_l;
+  fsSettings["RIGHT.P"] >> P_r;
+
+  fsSettings["LEFT.R"] >> R_l;
+  fsSettings["RIGHT.R"] >> R_r;
+
+  fsSettings["LEFT.D"] >> D_l;
+  fsSettings["RIGHT.D"] >> D_r;
+
+  int rows_l = fsSettings["LEFT.height"];
+  int cols_l = fsSettings["LEFT.width"];
+  int rows_r = fsSettings["RIGHT.height"];
+  int cols_r = fsSettings["RIGHT.width"];
+
+  if (!FLAGS_rectify_images && !FLAGS_undistort_images) {
+    return true;
+  }
+
+  if (K_l.empty() || K_r.empty() || P_l.empty() || P_r.empty() ||
+      R_l.empty() || R_r.empty() || D_l.empty() || D_r.empty() || rows_l == 0 ||
+      rows_r == 0 || cols_l == 0 || cols_r == 0) {
+    cerr << "ERROR: Calibration parameters to undistort/rectify stereo are "
+            "missing!"
+         << endl;
+    return false;
+  }
+
+  // Only rectify: ignore the distortion. Only undistort: ignore the rotation.
+  if (!FLAGS_undistort_images) {
+    D_l = cv::Mat::zeros(1, 4, CV_32F);
+    D_r = cv::Mat::zeros(1, 4, CV_32F);
+  }
+  if (!FLAGS_rectify_images) {
+    R_l = cv::Mat::eye(3, 3, CV_32F);
+    R_r = cv::Mat::eye(3, 3, CV_32F);
+  }
+  cv::initUndistortRectifyMap(K_l,
+                              D_l,
+                              R_l,
+                              P_l.rowRange(0, 3).colRange(0, 3),
+                              cv::Size(cols_l, rows_l),
+                              CV_32F,
+                              maps->M1l,
+                              maps->M2l);
+  cv::initUndistortRectifyMap(K_r,
+                              D_r,
+                              R_r,
+                              P_r.rowRange(0, 3).colRange(0, 3),
+                              cv::Size(cols_r, rows_r),
+                              CV_32F,
+                              maps->M1r,
+                              maps->M2r);
+  return true;
+}
+
+void LoadSequence(const KittiSequencePaths &paths, KittiSequence *sequence) {
+  LoadImages(paths.data_path,
+             paths.times_prefix,
+             sequence->image_left,
+             sequence->image_right,
+             sequence->timestamps);
+  const int nTimes = sequence->timestamps.size();
+
+  if (!FLAGS_ivslam_enabled) {
+    return;
+  }
+
+  if (FLAGS_gt_pose_available) {
+    // Load ground truth poses
+    ifstream fGroundTruthPoses;
+    fGroundTruthPoses.open(paths.ground_truth_path.c_str());
+    while (!fGroundTruthPoses.eof()) {
+      string s;
+      getline(fGroundTruthPoses, s);
+      if (!s.empty()) {
+        cv::Mat cam_pose = cv::Mat::eye(4, 4, CV_32F);
+        stringstream ss(s);
+        string str_curr_entry;
+        for (size_t i = 0; i < 12; i++) {
+          getline(ss, str_curr_entry, ' ');
+          cam_pose.at<float>(floor((float)(i) / 4), i % 4) =
+              stof(str_curr_entry);
+        }
+        sequence->cam_poses_gt.push_back(cam_pose);
+      }
+    }
+
+    CHECK_EQ(sequence->cam_poses_gt.size(), nTimes);
+
+    // Load reference pose uncertainty values
+    if (FLAGS_load_rel_pose_uncertainty) {
+      ifstream fRefPosesUnc;
+      fRefPosesUnc.open(paths.rel_pose_uncertainty_path.c_str());
+      while (!fRefPosesUnc.eof()) {
+        string s;
+        getline(fRefPosesUnc, s);
+        if (!s.empty()) {
+          // pose_uncertainty: (translational_unc, rotational_unc)
+          Eigen::Vector2f pose_uncertainty;
+          stringstream ss(s);
+          string str_curr_entry;
+          for (size_t i = 0; i < 2; i++) {
+            getline(ss, str_curr_entry, ' ');
+            pose_uncertainty(i) = stof(str_curr_entry);
+          }
+          sequence->rel_cam_poses_uncertainty.push_back(pose_uncertainty);
+        }
+      }
+      CHECK_EQ(sequence->rel_cam_poses_uncertainty.size(), nTimes);
+
+      for (int i = 0; i < nTimes; i++) {
+        const string &img_name = sequence->image_left[i];
+        string img_name_short = img_name.substr(
+            img_name.length() - KImageNameSuffixLength, KImageNameSuffixLength);
+        sequence->pose_unc_map[img_name_short] = i;
+      }
+    }
+  }
+
+  // Load predicted quality images
+  int qual_img_num = 0;
+  if (FLAGS_load_img_qual_heatmaps && FLAGS_introspection_func_enabled) {
+    if (!GetImageQualFileNames(
+            paths.img_qual_path, nTimes, &sequence->image_qual, &qual_img_num)) {
+      LOG(FATAL) << "Error loading the image quality files" << endl;
+    }
+    LOG(INFO) << qual_img_num << " predicted image quality heatmaps found.";
+
+    if (qual_img_num != nTimes) {
+      LOG(WARNING) << qual_img_num << " predicted image quality heatmaps "
+                   << "were found but total session image count is " << nTimes;
+    }
+
+    if (qual_img_num < 2) {
+      LOG(FATAL) << "Predicted image quality heatmaps not found!";
+    }
+  }
+}
+
+bool TrackSequence(const KittiSequence &sequence,
+                   const RectificationMaps &maps,
+                   IntrospectionSession *introspection_func,
+                   CostMapScheduler *cost_map_scheduler,
+                   System *SLAM) {
+  const int nImages = sequence.image_left.size();
+  const bool remap_images = FLAGS_rectify_images || FLAGS_undistort_images;
+
+  // Main loop
+  // Processing in this case refers to undisortion/rectification
+  cv::Mat imLeft, imRight, imLeftProcessed, imRightProcessed;
+  int end_frame;
+  if (FLAGS_end_frame > 0) {
+    end_frame = std::min(nImages, FLAGS_end_frame);
+  } else {
+    end_frame = nImages;
+  }
+  for (int ni = FLAGS_start_frame; ni < end_frame; ni++) {
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+    // Read left and right images from file
+    imLeft = cv::imread(sequence.image_left[ni], CV_LOAD_IMAGE_COLOR);
+    imRight = cv::imread(sequence.image_right[ni], CV_LOAD_IMAGE_COLOR);
+    double tframe = sequence.timestamps[ni];
+
+    if (imLeft.empty()) {
+      cerr << endl
+           << "Failed to load image at: " << sequence.image_left[ni] << endl;
+      return false;
+    }
+
+    if (imRight.empty()) {
+      cerr << endl
+           << "Failed to load image at: " << sequence.image_right[ni] << endl;
+      return false;
+    }
+
+    if (remap_images) {
+      cv::remap(imLeft, imLeftProcessed, maps.M1l, maps.M2l, cv::INTER_LINEAR);
+      cv::remap(
+          imRight, imRightProcessed, maps.M1r, maps.M2r, cv::INTER_LINEAR);
+    } else {
+      imLeftProcessed = imLeft;
+      imRightProcessed = imRight;
+    }
+
+    // Read the predicted quality image
+    cv::Mat cost_img_cv;
+    if (FLAGS_introspection_func_enabled) {
+      if (FLAGS_load_img_qual_heatmaps) {
+        // There might not be a image quality available for all input
+        // images. In that case just skip the missing ones with setting
+        // them to empty images. (The SLAM object will ignore empty
+        // images as if no score was available).
+        if (sequence.image_qual[ni].empty()) {
+          cost_img_cv = cv::Mat(0, 0, CV_8U);
+        } else {
+          // Read the predicted image quality
+          cost_img_cv =
+              cv::imread(sequence.image_qual[ni], CV_LOAD_IMAGE_GRAYSCALE);
+          if (cost_img_cv.empty()) {
+            cerr << endl
+                 << "Failed to load image at: " << sequence.image_qual[ni]
+                 << endl;
+            return false;
+          }
+        }
+
+        if (remap_images) {
+          cv::remap(
+              cost_img_cv, cost_img_cv, maps.M1l, maps.M2l, cv::INTER_LINEAR);
+        }
+      } else if (cost_map_scheduler->Schedule(SLAM, &cost_img_cv)) {
+        // Run inference on the introspection model online. On the other
+        // frames the scheduler warps the last predicted cost map.
+        cost_img_cv = introspection_func->Predict(imLeft);
+
+        if (remap_images) {
+          cv::remap(
+              cost_img_cv, cost_img_cv, maps.M1l, maps.M2l, cv::INTER_LINEAR);
+        }
+        cost_map_scheduler->SetPredictedCostMap(cost_img_cv);
+      }
+    }
+
+    string img_name = sequence.image_left[ni].substr(
+        sequence.image_left[ni].length() - KImageNameSuffixLength,
+        KImageNameSuffixLength);
+
+    Eigen::Matrix<double, 6, 6> cam_poses_gt_cov;
+    bool pose_cov_available = false;
+
+    // Pass the images to the SLAM system
+    if (FLAGS_ivslam_enabled) {
+      cv::Mat cam_pose_gt = FLAGS_gt_pose_available ? sequence.cam_poses_gt[ni]
+                                                    : cv::Mat(0, 0, CV_32F);
+      SLAM->TrackStereo(imLeftProcessed,
+                        imRightProcessed,
+                        tframe,
+                        cam_pose_gt,
+                        cam_poses_gt_cov,
+                        pose_cov_available,
+                        img_name,
+                        false,
+                        cost_img_cv);
+    } else {
+      SLAM->TrackStereo(imLeftProcessed, imRightProcessed, tframe);
+    }
+
+    std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+    double ttrack =
+        std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1)
+            .count();
+
+    // Wait to load the next frame. In single threaded mode, load images
+    // as fast as possible
+    if (!FLAGS_run_single_threaded) {
+      double T = 0;
+      if (ni < nImages - 1)
+        T = sequence.timestamps[ni + 1] - tframe;
+      else if (ni > 0)
+        T = tframe - sequence.timestamps[ni - 1];
+
+      if (ttrack < T) usleep((T - ttrack) * 1e6);
+    }
+  }
+
+  return true;
+}
+
+namespace {
+
+void LoadImages(const string &strPathToSequence,
+                const string &session,
+                vector<string> &vstrImageLeft,
+                vector<string> &vstrImageRight,
+                vector<double> &vTimestamps) {
+  ifstream fTimes;
+  string strPathTimeFile = strPathToSequence + "/" + session + "_times.txt";
+  std::cout << strPathTimeFile << std::endl;
+  fTimes.open(strPathTimeFile.c_str());
+  while (!fTimes.eof()) {
+    string s;
+    getline(fTimes, s);
+    if (!s.empty()) {
+      stringstream ss;
+      ss << s;
+      double t;
+      ss >> t;
+      vTimestamps.push_back(t);
+    }
+  }
+
+  string strPrefixLeft = strPathToSequence + "/image_0/";
+  string strPrefixRight = strPathToSequence + "/image_1/";
+
+  const int nTimes = vTimestamps.size();
+  vstrImageLeft.resize(nTimes);
+  vstrImageRight.resize(nTimes);
+
+  int smallest_img_idx = GetSmallestImgIdx(strPrefixLeft, 6);
+  for (int i = 0; i < nTimes; i++) {
+    stringstream ss;
+    ss << setfill('0') << setw(6) << i + smallest_img_idx;
+    vstrImageLeft[i] = strPrefixLeft + ss.str() + ".png";
+    vstrImageRight[i] = strPrefixRight + ss.str() + ".png";
+  }
+}
+
+// Given a direcotry whose content is supposed to be files named as ID numbers
+// in the format %06d.jpg, it will fill vstrImageQualFilenames with full path
+// to all available files and leave missing images as empty strings. The
+// argument "size" determines how many images we are expecting starting at
+// the index of 0
+bool GetImageQualFileNames(const std::string &directory,
+                           const int &size,
+                           vector<string> *vstrImageQualFilenames,
+                           int *num_qual_imgs_found) {
+  vstrImageQualFilenames->clear();
+  vstrImageQualFilenames->resize(size);
+
+  const int kPrefixLength = 6;
+  char numbering[6];
+  *num_qual_imgs_found = 0;
+
+  DIR *dirp = opendir(directory.c_str());
+  struct dirent *dp;
+
+  if (!dirp) {
+    LOG(ERROR) << "Could not open directory " << directory
+               << " for predicted image quality heatmaps.";
+  }
+
+  while ((dp = readdir(dirp)) != NULL) {
+    // Ignore the '.' and ".." directories
+    if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, "..")) continue;
+    for (int i = 0; i < kPrefixLength; i++) {
+      numbering[i] = dp->d_name[i];
+    }
+
+    int prefix_number = atoi(numbering);
+
+    CHECK_LT(prefix_number, size) << "The index of the images are expected to"
+                                  << "be between 0 and " << size - 1;
+    vstrImageQualFilenames->at(prefix_number) =
+        directory + "/" + std::string(dp->d_name);
+    *num_qual_imgs_found = *num_qual_imgs_found + 1;
+  }
+  (void)closedir(dirp);
+
+  return true;
+}
+
+int GetSmallestImgIdx(const std::string &directory, const int &prefix_length) {
+  char numbering[20];
+
+  DIR *dirp = opendir(directory.c_str());
+  struct dirent *dp;
+
+  if (!dirp) {
+    LOG(ERROR) << "Could not open directory " << directory;
+  }
+
+  int smallest_idx = std::numeric_limits<int>::max();
+  while ((dp = readdir(dirp)) != NULL) {
+    // Ignore the '.' and ".." directories
+    if (!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, "..")) continue;
+    for (int i = 0; i < prefix_length; i++) {
+      numbering[i] = dp->d_name[i];
+    }
+
+    int prefix_number = atoi(numbering);
+
+    if (prefix_number < smallest_idx) {
+      smallest_idx = prefix_number;
+    }
+  }
+  (void)closedir(dirp);
+
+  return smallest_idx;
+}
+
+}  // namespace
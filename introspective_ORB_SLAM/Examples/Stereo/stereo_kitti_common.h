@@ -0,0 +1,114 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Loading and tracking of one KITTI format stereo sequence. Shared by
+// stereo_kitti, which runs a single sequence, and stereo_kitti_batch, which
+// runs a list of sessions in one process. The flags declared here are defined
+// in stereo_kitti_common.cc and are the same for both programs.
+
+#ifndef IVSLAM_STEREO_KITTI_COMMON
+#define IVSLAM_STEREO_KITTI_COMMON
+
+#include <gflags/gflags.h>
+
+#include <Eigen/Core>
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "System.h"
+#include "cost_map_scheduler.h"
+#include "introspection_session.h"
+
+DECLARE_string(vocab_path);
+DECLARE_string(settings_path);
+DECLARE_string(introspection_model_path);
+DECLARE_int32(start_frame);
+DECLARE_int32(end_frame);
+DECLARE_bool(load_rel_pose_uncertainty);
+DECLARE_bool(load_img_qual_heatmaps);
+DECLARE_bool(run_single_threaded);
+DECLARE_bool(create_ivslam_dataset);
+DECLARE_bool(ivslam_enabled);
+DECLARE_bool(inference_mode);
+DECLARE_bool(introspection_func_enabled);
+DECLARE_bool(gt_pose_available);
+DECLARE_bool(use_gpu);
+DECLARE_bool(rectify_images);
+DECLARE_bool(undistort_images);
+
+// Length of the image name suffix that should be extracted from its name
+const int KImageNameSuffixLength = 10;
+
+// Input paths of a sequence
+struct KittiSequencePaths {
+  std::string data_path;
+  // The timestamps are read from <data_path>/<times_prefix>_times.txt
+  std::string times_prefix;
+  std::string ground_truth_path;
+  std::string img_qual_path;
+  std::string rel_pose_uncertainty_path;
+};
+
+// Image file names, timestamps and reference poses of a sequence
+struct KittiSequence {
+  std::vector<std::string> image_left;
+  std::vector<std::string> image_right;
+  // Empty entries for the frames without a predicted heatmap
+  std::vector<std::string> image_qual;
+  std::vector<double> timestamps;
+  std::vector<cv::Mat> cam_poses_gt;
+  std::vector<Eigen::Vector2f> rel_cam_poses_uncertainty;
+  // The map from left image names to the ID of corresponding relative camera
+  // pose uncertainty (from current image to next image)
+  std::unordered_map<std::string, int> pose_unc_map;
+};
+
+// Undistortion/rectification maps. Empty if the images are used as they are.
+struct RectificationMaps {
+  cv::Mat M1l, M2l, M1r, M2r;
+};
+
+// Fails if the combination of flags is not supported
+void CheckSequenceFlags();
+
+// Reads the calibration in the settings file and computes the maps requested
+// by --rectify_images and --undistort_images. Returns false if the
+// calibration is missing.
+bool LoadRectificationMaps(const std::string &settings_path,
+                           RectificationMaps *maps);
+
+// Loads the image file names and timestamps of a sequence. The ground truth
+// poses, the pose uncertainty values and the predicted heatmaps are also
+// loaded when the flags ask for them.
+void LoadSequence(const KittiSequencePaths &paths, KittiSequence *sequence);
+
+// Passes frames [start_frame, end_frame) of the sequence to SLAM. The cost
+// maps are either read from file or predicted with introspection_func on the
+// frames picked by cost_map_scheduler. Returns false if an image could not be
+// read.
+bool TrackSequence(const KittiSequence &sequence,
+                   const RectificationMaps &maps,
+                   ORB_SLAM2::IntrospectionSession *introspection_func,
+                   ORB_SLAM2::CostMapScheduler *cost_map_scheduler,
+                   ORB_SLAM2::System *SLAM);
+
+#endif  // IVSLAM_STEREO_KITTI_COMMON
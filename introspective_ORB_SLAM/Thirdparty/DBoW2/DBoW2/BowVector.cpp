@@ -33,9 +33,16 @@ BowVector::~BowVector(void)
 
 void BowVector::addWeight(WordId id, WordValue v)
 {
+  // words are usually added in increasing order
+  if(this->empty() || this->back().first < id)
+  {
+    this->push_back(BowVector::value_type(id, v));
+    return;
+  }
+
   BowVector::iterator vit = this->lower_bound(id);
   
-  if(vit != this->end() && !(this->key_comp()(id, vit->first)))
+  if(vit != this->end() && vit->first == id)
   {
     vit->second += v;
   }
@@ -49,9 +56,15 @@ void BowVector::addWeight(WordId id, WordValue v)
 
 void BowVector::addIfNotExist(WordId id, WordValue v)
 {
+  if(this->empty() || this->back().first < id)
+  {
+    this->push_back(BowVector::value_type(id, v));
+    return;
+  }
+
   BowVector::iterator vit = this->lower_bound(id);
   
-  if(vit == this->end() || (this->key_comp()(id, vit->first)))
+  if(vit == this->end() || vit->first != id)
   {
     this->insert(vit, BowVector::value_type(id, v));
   }
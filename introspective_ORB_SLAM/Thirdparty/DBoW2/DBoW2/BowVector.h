@@ -11,8 +11,11 @@
 #define __D_T_BOW_VECTOR__
 
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <utility>
 #include <vector>
+#include <algorithm>
 
 namespace DBoW2 {
 
@@ -52,9 +55,52 @@ enum ScoringType
   DOT_PRODUCT,
 };
 
-/// Vector of words to represent images
+/// Compares the key of a (key, value) pair with a key
+struct PairKeyLess
+{
+	template<class Pair, class Key>
+	inline bool operator()(const Pair &p, const Key &k) const { return p.first < k; }
+};
+
+/// Compares two (key, value) pairs by key only
+struct PairKeyCompare
+{
+	template<class Pair>
+	inline bool operator()(const Pair &a, const Pair &b) const { return a.first < b.first; }
+};
+
+/**
+ * Returns the first element in [first, last) whose key is not less than id,
+ * in a range of (key, value) pairs sorted by key. The search gallops forward 
+ * from first, so it only takes a few comparisons when the element is close,
+ * which is the usual case when two sorted vectors are walked in lockstep
+ * @param first
+ * @param last
+ * @param id key to look for
+ */
+template<class Iterator, class Key>
+Iterator gallopLowerBound(Iterator first, Iterator last, const Key &id)
+{
+	if(first == last || !(first->first < id)) return first;
+
+	// first->first < id. Double the step until the bound is passed
+	typename std::iterator_traits<Iterator>::difference_type step = 1;
+	Iterator lo = first;
+	while(last - lo > step && (lo + step)->first < id)
+	{
+		lo += step;
+		step *= 2;
+	}
+	Iterator hi = (last - lo > step) ? lo + step + 1 : last;
+
+	return std::lower_bound(lo + 1, hi, id, PairKeyLess());
+}
+
+/// Vector of words to represent images. Words are stored in a contiguous 
+/// vector sorted by id, and it is iterated the same way as the std::map it 
+/// replaces
 class BowVector: 
-	public std::map<WordId, WordValue>
+	public std::vector<std::pair<WordId, WordValue> >
 {
 public:
 
@@ -67,6 +113,36 @@ public:
 	 * Destructor
 	 */
 	~BowVector(void);
+
+	/**
+	 * Returns the first word whose id is not less than the given one
+	 * @param id word id
+	 */
+	inline iterator lower_bound(WordId id)
+	{
+		return std::lower_bound(begin(), end(), id, PairKeyLess());
+	}
+
+	inline const_iterator lower_bound(WordId id) const
+	{
+		return std::lower_bound(begin(), end(), id, PairKeyLess());
+	}
+
+	/**
+	 * Returns the word with the given id, or end() if it is not in the vector
+	 * @param id word id
+	 */
+	inline iterator find(WordId id)
+	{
+		iterator it = lower_bound(id);
+		return (it != end() && it->first == id) ? it : end();
+	}
+
+	inline const_iterator find(WordId id) const
+	{
+		const_iterator it = lower_bound(id);
+		return (it != end() && it->first == id) ? it : end();
+	}
 	
 	/**
 	 * Adds a value to a word value existing in the vector, or creates a new
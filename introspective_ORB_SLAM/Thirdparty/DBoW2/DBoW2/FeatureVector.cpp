@@ -30,6 +30,13 @@ FeatureVector::~FeatureVector(void)
 
 void FeatureVector::addFeature(NodeId id, unsigned int i_feature)
 {
+  if(this->empty() || this->back().first < id)
+  {
+    this->push_back(FeatureVector::value_type(id, 
+      std::vector<unsigned int>(1, i_feature)));
+    return;
+  }
+
   FeatureVector::iterator vit = this->lower_bound(id);
   
   if(vit != this->end() && vit->first == id)
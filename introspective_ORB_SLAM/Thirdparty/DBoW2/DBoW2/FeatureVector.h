@@ -17,9 +17,11 @@
 
 namespace DBoW2 {
 
-/// Vector of nodes with indexes of local features
+/// Vector of nodes with indexes of local features. Nodes are stored in a 
+/// contiguous vector sorted by id, and it is iterated the same way as the
+/// std::map it replaces
 class FeatureVector: 
-  public std::map<NodeId, std::vector<unsigned int> >
+  public std::vector<std::pair<NodeId, std::vector<unsigned int> > >
 {
 public:
 
@@ -32,6 +34,36 @@ public:
    * Destructor
    */
   ~FeatureVector(void);
+
+  /**
+   * Returns the first node whose id is not less than the given one
+   * @param id node id
+   */
+  inline iterator lower_bound(NodeId id)
+  {
+    return std::lower_bound(begin(), end(), id, PairKeyLess());
+  }
+
+  inline const_iterator lower_bound(NodeId id) const
+  {
+    return std::lower_bound(begin(), end(), id, PairKeyLess());
+  }
+
+  /**
+   * Returns the node with the given id, or end() if it is not in the vector
+   * @param id node id
+   */
+  inline iterator find(NodeId id)
+  {
+    iterator it = lower_bound(id);
+    return (it != end() && it->first == id) ? it : end();
+  }
+
+  inline const_iterator find(NodeId id) const
+  {
+    const_iterator it = lower_bound(id);
+    return (it != end() && it->first == id) ? it : end();
+  }
   
   /**
    * Adds a feature to an existing node, or adds a new node with an initial
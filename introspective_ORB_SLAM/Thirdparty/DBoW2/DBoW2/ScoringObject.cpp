@@ -22,38 +22,40 @@ const double GeneralScoring::LOG_EPS = log(DBL_EPSILON); // FLT_EPSILON
 
 double L1Scoring::score(const BowVector &v1, const BowVector &v2) const
 {
-  BowVector::const_iterator v1_it, v2_it;
-  const BowVector::const_iterator v1_end = v1.end();
-  const BowVector::const_iterator v2_end = v2.end();
-  
-  v1_it = v1.begin();
-  v2_it = v2.begin();
+  // Walk the two sorted arrays of words directly. This is the score used to
+  // query the keyframe database, so it is kept free of iterator overhead
+  const BowVector::value_type *v1_it = v1.data();
+  const BowVector::value_type *v2_it = v2.data();
+  const BowVector::value_type *const v1_end = v1_it + v1.size();
+  const BowVector::value_type *const v2_end = v2_it + v2.size();
   
   double score = 0;
   
   while(v1_it != v1_end && v2_it != v2_end)
   {
-    const WordValue& vi = v1_it->second;
-    const WordValue& wi = v2_it->second;
+    const WordId id1 = v1_it->first;
+    const WordId id2 = v2_it->first;
     
-    if(v1_it->first == v2_it->first)
+    if(id1 == id2)
     {
+      const WordValue vi = v1_it->second;
+      const WordValue wi = v2_it->second;
       score += fabs(vi - wi) - fabs(vi) - fabs(wi);
       
       // move v1 and v2 forward
       ++v1_it;
       ++v2_it;
     }
-    else if(v1_it->first < v2_it->first)
+    else if(id1 < id2)
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
+      v1_it = gallopLowerBound(v1_it, v1_end, id2);
       // v1_it = (first element >= v2_it.id)
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
+      v2_it = gallopLowerBound(v2_it, v2_end, id1);
       // v2_it = (first element >= v1_it.id)
     }
   }
@@ -97,13 +99,13 @@ double L2Scoring::score(const BowVector &v1, const BowVector &v2) const
     else if(v1_it->first < v2_it->first)
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
+      v1_it = gallopLowerBound(v1_it, v1_end, v2_it->first);
       // v1_it = (first element >= v2_it.id)
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
+      v2_it = gallopLowerBound(v2_it, v2_end, v1_it->first);
       // v2_it = (first element >= v1_it.id)
     }
   }
@@ -154,12 +156,12 @@ double ChiSquareScoring::score(const BowVector &v1, const BowVector &v2)
     else if(v1_it->first < v2_it->first)
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
+      v1_it = gallopLowerBound(v1_it, v1_end, v2_it->first);
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
+      v2_it = gallopLowerBound(v2_it, v2_end, v1_it->first);
     }
   }
     
@@ -207,7 +209,7 @@ double KLScoring::score(const BowVector &v1, const BowVector &v2) const
     else
     {
       // move v2_it forward, do not add any score
-      v2_it = v2.lower_bound(v1_it->first);
+      v2_it = gallopLowerBound(v2_it, v2_end, v1_it->first);
       // v2_it = (first element >= v1_it.id)
     }
   }
@@ -251,13 +253,13 @@ double BhattacharyyaScoring::score(const BowVector &v1,
     else if(v1_it->first < v2_it->first)
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
+      v1_it = gallopLowerBound(v1_it, v1_end, v2_it->first);
       // v1_it = (first element >= v2_it.id)
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
+      v2_it = gallopLowerBound(v2_it, v2_end, v1_it->first);
       // v2_it = (first element >= v1_it.id)
     }
   }
@@ -296,13 +298,13 @@ double DotProductScoring::score(const BowVector &v1,
     else if(v1_it->first < v2_it->first)
     {
       // move v1 forward
-      v1_it = v1.lower_bound(v2_it->first);
+      v1_it = gallopLowerBound(v1_it, v1_end, v2_it->first);
       // v1_it = (first element >= v2_it.id)
     }
     else
     {
       // move v2 forward
-      v2_it = v2.lower_bound(v1_it->first);
+      v2_it = gallopLowerBound(v2_it, v2_end, v1_it->first);
       // v2_it = (first element >= v1_it.id)
     }
   }
@@ -26,6 +26,10 @@
 #include <algorithm>
 #include <opencv2/core/core.hpp>
 #include <limits>
+#include <climits>
+#include <cstring>
+#include <stdint.h>
+#include <thread>
 
 #include "FeatureVector.h"
 #include "BowVector.h"
@@ -145,6 +149,19 @@ public:
   virtual void transform(const std::vector<TDescriptor>& features,
     BowVector &v, FeatureVector &fv, int levelsup) const;
 
+  /**
+   * Transforms the rows of a descriptor matrix into a bow vector and a 
+   * feature vector. The result is the same as calling the function above
+   * with one descriptor per row, but no descriptor headers are created
+   * @param features matrix with one binary descriptor per row
+   * @param v (out) bow vector
+   * @param fv (out) feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   * @param nthreads number of threads the rows are split across
+   */
+  void transform(const cv::Mat &features, BowVector &v, FeatureVector &fv, 
+    int levelsup, int nthreads = 1) const;
+
   /**
    * Transforms a single feature into a word (without weight)
    * @param feature
@@ -361,6 +378,24 @@ protected:
    * @param id (out) word id
    */
   virtual void transform(const TDescriptor &feature, WordId &id) const;
+
+  /**
+   * Same as transform(feature, id, weight, nid, levelsup), but descends the
+   * flattened tree. Requires buildFlatTree() to have succeeded
+   * @param feature pointer to the F::L bytes of a binary descriptor
+   */
+  void transformFlat(const unsigned char *feature, 
+    WordId &id, WordValue &weight, NodeId* nid, int levelsup) const;
+
+  /**
+   * Builds the flattened copy of the tree used by transform(). The children
+   * of every node are stored in a contiguous range, and their descriptors
+   * are packed next to each other in 64-bit words so that the distances to
+   * all the children are computed with a few popcounts each. Only binary
+   * descriptors of at most 64 bytes are flattened, otherwise transform()
+   * falls back to walking m_nodes
+   */
+  void buildFlatTree();
       
   /**
    * Creates a level in the tree, under the parent, by running kmeans with
@@ -425,6 +460,17 @@ protected:
   /// Words of the vocabulary (tree leaves)
   /// this condition holds: m_words[wid]->word_id == wid
   std::vector<Node*> m_words;
+
+  /// Flattened tree (see buildFlatTree). Children of node i are the entries
+  /// m_flat_first_child[i] .. m_flat_first_child[i] + m_flat_num_children[i]
+  /// of m_flat_child_ids, and their descriptors take m_flat_desc_words 
+  /// words each in m_flat_descriptors. m_flat_desc_words is 0 if the tree
+  /// could not be flattened
+  std::vector<unsigned int> m_flat_first_child;
+  std::vector<unsigned int> m_flat_num_children;
+  std::vector<NodeId> m_flat_child_ids;
+  std::vector<uint64_t> m_flat_descriptors;
+  int m_flat_desc_words;
   
 };
 
@@ -434,7 +480,7 @@ template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
   (int k, int L, WeightingType weighting, ScoringType scoring)
   : m_k(k), m_L(L), m_weighting(weighting), m_scoring(scoring),
-  m_scoring_object(NULL)
+  m_scoring_object(NULL), m_flat_desc_words(0)
 {
   createScoringObject();
 }
@@ -443,7 +489,7 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const std::string &filename): m_scoring_object(NULL)
+  (const std::string &filename): m_scoring_object(NULL), m_flat_desc_words(0)
 {
   load(filename);
 }
@@ -452,7 +498,7 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const char *filename): m_scoring_object(NULL)
+  (const char *filename): m_scoring_object(NULL), m_flat_desc_words(0)
 {
   load(filename);
 }
@@ -516,7 +562,7 @@ void TemplatedVocabulary<TDescriptor,F>::setWeightingType(WeightingType type)
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary(
   const TemplatedVocabulary<TDescriptor, F> &voc)
-  : m_scoring_object(NULL)
+  : m_scoring_object(NULL), m_flat_desc_words(0)
 {
   *this = voc;
 }
@@ -935,6 +981,8 @@ void TemplatedVocabulary<TDescriptor,F>::createWords()
       }
     }
   }
+
+  buildFlatTree();
 }
 
 // --------------------------------------------------------------------------
@@ -1195,6 +1243,120 @@ void TemplatedVocabulary<TDescriptor,F>::transform(
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F> 
+void TemplatedVocabulary<TDescriptor,F>::transform(const cv::Mat &features,
+  BowVector &v, FeatureVector &fv, int levelsup, int nthreads) const
+{
+  v.clear();
+  fv.clear();
+  
+  if(empty() || features.empty()) // safe for subclasses
+  {
+    return;
+  }
+
+  const int N = features.rows;
+  const bool flat = m_flat_desc_words > 0 && features.type() == CV_8U && 
+    features.cols == F::L;
+
+  // look up the words of all the rows first, in parallel if asked to
+  vector<WordId> ids(N);
+  vector<WordValue> ws(N);
+  vector<NodeId> nids(N);
+
+  auto lookup = [&](int begin, int end)
+  {
+    for(int i = begin; i < end; ++i)
+    {
+      if(flat)
+        transformFlat(features.ptr<unsigned char>(i), ids[i], ws[i], 
+          &nids[i], levelsup);
+      else
+        transform(features.row(i), ids[i], ws[i], &nids[i], levelsup);
+    }
+  };
+
+  nthreads = std::max(1, std::min(nthreads, N));
+  if(nthreads == 1)
+  {
+    lookup(0, N);
+  }
+  else
+  {
+    const int chunk = (N + nthreads - 1) / nthreads;
+    vector<std::thread> workers;
+    workers.reserve(nthreads - 1);
+    for(int t = 1; t < nthreads; ++t)
+      workers.push_back(std::thread(lookup, std::min(N, t * chunk), 
+        std::min(N, (t + 1) * chunk)));
+    lookup(0, std::min(N, chunk));
+    for(size_t t = 0; t < workers.size(); ++t)
+      workers[t].join();
+  }
+
+  // then fill the vectors. The words and nodes are sorted once, keeping the
+  // feature order among equal ids, so that the result is the same as adding
+  // the features one by one
+  vector<std::pair<WordId, int> > words;
+  vector<std::pair<NodeId, unsigned int> > nodes;
+  words.reserve(N);
+  nodes.reserve(N);
+  for(int i = 0; i < N; ++i)
+  {
+    if(ws[i] > 0) // not stopped
+    {
+      words.push_back(std::make_pair(ids[i], i));
+      nodes.push_back(std::make_pair(nids[i], (unsigned int)i));
+    }
+  }
+  std::stable_sort(words.begin(), words.end(), PairKeyCompare());
+  std::stable_sort(nodes.begin(), nodes.end(), PairKeyCompare());
+
+  for(size_t j = 0; j < nodes.size(); ++j)
+  {
+    if(fv.empty() || fv.back().first != nodes[j].first)
+      fv.push_back(FeatureVector::value_type(nodes[j].first, 
+        vector<unsigned int>()));
+    fv.back().second.push_back(nodes[j].second);
+  }
+
+  LNorm norm;
+  bool must = m_scoring_object->mustNormalize(norm);
+  
+  if(m_weighting == TF || m_weighting == TF_IDF)
+  {
+    for(size_t j = 0; j < words.size(); ++j)
+    {
+      const WordValue w = ws[words[j].second];
+      if(v.empty() || v.back().first != words[j].first)
+        v.push_back(BowVector::value_type(words[j].first, w));
+      else
+        v.back().second += w;
+    }
+    
+    if(!v.empty() && !must)
+    {
+      // unnecessary when normalizing
+      const double nd = v.size();
+      for(BowVector::iterator vit = v.begin(); vit != v.end(); vit++) 
+        vit->second /= nd;
+    }
+  }
+  else // IDF || BINARY
+  {
+    for(size_t j = 0; j < words.size(); ++j)
+    {
+      if(v.empty() || v.back().first != words[j].first)
+        v.push_back(BowVector::value_type(words[j].first, 
+          ws[words[j].second]));
+    }
+  } // if m_weighting == ...
+  
+  if(must) v.normalize(norm);
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F> 
 inline double TemplatedVocabulary<TDescriptor,F>::score
   (const BowVector &v1, const BowVector &v2) const
@@ -1218,6 +1380,14 @@ template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature, 
   WordId &word_id, WordValue &weight, NodeId *nid, int levelsup) const
 { 
+  if(m_flat_desc_words > 0 && feature.isContinuous() &&
+    (int)(feature.total() * feature.elemSize()) == F::L)
+  {
+    transformFlat(feature.template ptr<unsigned char>(), word_id, weight, 
+      nid, levelsup);
+    return;
+  }
+
   // propagate the feature down the tree
   vector<NodeId> nodes;
   typename vector<NodeId>::const_iterator nit;
@@ -1260,6 +1430,110 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::transformFlat(
+  const unsigned char *feature, WordId &word_id, WordValue &weight, 
+  NodeId *nid, int levelsup) const
+{
+  // pack the feature the same way as the node descriptors
+  uint64_t q[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  memcpy(q, feature, F::L);
+  const int W = m_flat_desc_words;
+
+  // level at which the node must be stored in nid, if given
+  const int nid_level = m_L - levelsup;
+  if(nid_level <= 0 && nid != NULL) *nid = 0; // root
+
+  NodeId final_id = 0; // root
+  int current_level = 0;
+
+  do
+  {
+    ++current_level;
+    const unsigned int first = m_flat_first_child[final_id];
+    const unsigned int n = m_flat_num_children[final_id];
+    const uint64_t *d = &m_flat_descriptors[(size_t)first * W];
+
+    // Hamming distance to all the children. Ties keep the first child, as
+    // in the node-by-node descent
+    int best_d = INT_MAX;
+    unsigned int best_c = 0;
+    for(unsigned int c = 0; c < n; ++c, d += W)
+    {
+      int dist = 0;
+      for(int w = 0; w < W; ++w)
+        dist += __builtin_popcountll(q[w] ^ d[w]);
+      if(dist < best_d)
+      {
+        best_d = dist;
+        best_c = c;
+      }
+    }
+    final_id = m_flat_child_ids[first + best_c];
+
+    if(nid != NULL && current_level == nid_level)
+      *nid = final_id;
+
+  } while(m_flat_num_children[final_id] > 0);
+
+  // turn node id into word id
+  word_id = m_nodes[final_id].word_id;
+  weight = m_nodes[final_id].weight;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::buildFlatTree()
+{
+  m_flat_first_child.clear();
+  m_flat_num_children.clear();
+  m_flat_child_ids.clear();
+  m_flat_descriptors.clear();
+  m_flat_desc_words = 0;
+
+  if(m_nodes.empty() || F::L <= 0 || F::L > 64) return;
+
+  const int W = (F::L + 7) / 8;
+
+  m_flat_first_child.resize(m_nodes.size(), 0);
+  m_flat_num_children.resize(m_nodes.size(), 0);
+  m_flat_child_ids.reserve(m_nodes.size());
+  m_flat_descriptors.reserve(m_nodes.size() * W);
+
+  for(size_t i = 0; i < m_nodes.size(); ++i)
+  {
+    const vector<NodeId> &children = m_nodes[i].children;
+    m_flat_first_child[i] = m_flat_child_ids.size();
+    m_flat_num_children[i] = children.size();
+
+    for(size_t c = 0; c < children.size(); ++c)
+    {
+      const TDescriptor &desc = m_nodes[children[c]].descriptor;
+      if(!desc.isContinuous() || 
+        (int)(desc.total() * desc.elemSize()) != F::L)
+      {
+        // not a binary descriptor, keep using m_nodes
+        m_flat_first_child.clear();
+        m_flat_num_children.clear();
+        m_flat_child_ids.clear();
+        m_flat_descriptors.clear();
+        return;
+      }
+
+      uint64_t packed[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+      memcpy(packed, desc.template ptr<unsigned char>(), F::L);
+
+      m_flat_child_ids.push_back(children[c]);
+      m_flat_descriptors.insert(m_flat_descriptors.end(), packed, packed + W);
+    }
+  }
+
+  m_flat_desc_words = W;
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 NodeId TemplatedVocabulary<TDescriptor,F>::getParentNode
   (WordId wid, int levelsup) const
@@ -1419,6 +1693,8 @@ bool TemplatedVocabulary<TDescriptor,F>::loadFromTextFile(const std::string &fil
         }
     }
 
+    buildFlatTree();
+
     return true;
 
 }
@@ -1619,6 +1895,8 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
     m_nodes[nid].word_id = wid;
     m_words[wid] = &m_nodes[nid];
   }
+
+  buildFlatTree();
 }
 
 // --------------------------------------------------------------------------
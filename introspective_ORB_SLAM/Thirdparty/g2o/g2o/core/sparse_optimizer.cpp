@@ -43,12 +43,35 @@
 #include "../stuff/misc.h"
 #include "../../config.h"
 
+#ifdef G2O_OPENMP
+#include <omp.h>
+#endif
+
 namespace g2o{
   using namespace std;
 
+  namespace {
+    /**
+     * sets the number of OpenMP threads of the calling thread and restores it on destruction.
+     * The setting is per thread, so other threads running an optimizer are not affected.
+     */
+    class ScopedOpenMPThreads
+    {
+      public:
+#ifdef G2O_OPENMP
+        explicit ScopedOpenMPThreads(int numThreads) : _previous(omp_get_max_threads()) { omp_set_num_threads(numThreads);}
+        ~ScopedOpenMPThreads() { omp_set_num_threads(_previous);}
+      private:
+        int _previous;
+#else
+        explicit ScopedOpenMPThreads(int) {}
+#endif
+    };
+  }
+
 
   SparseOptimizer::SparseOptimizer() :
-    _forceStopFlag(0), _verbose(false), _algorithm(0), _computeBatchStatistics(false)
+    _forceStopFlag(0), _verbose(false), _numThreads(1), _algorithm(0), _computeBatchStatistics(false)
   {
     _graphActions.resize(AT_NUM_ELEMENTS);
   }
@@ -358,6 +381,8 @@ namespace g2o{
       return -1;
     }
 
+    ScopedOpenMPThreads threads(_numThreads);
+
     int cjIterations=0;
     double cumTime=0;
     bool ok=true;
@@ -187,6 +187,13 @@ namespace g2o {
     //! if external stop flag is given, return its state. False otherwise
     bool terminate() {return _forceStopFlag ? (*_forceStopFlag) : false; }
 
+    /**
+     * number of OpenMP threads used by optimize() to compute the errors, linearize the edges and
+     * build the Schur complement. Defaults to 1. Has no effect if g2o is built without OpenMP.
+     */
+    void setNumThreads(int numThreads) { _numThreads = numThreads > 0 ? numThreads : 1;}
+    int numThreads() const { return _numThreads;}
+
     //! the index mapping of the vertices
     const VertexContainer& indexMapping() const {return _ivMap;}
     //! the vertices active in the current optimization
@@ -289,6 +296,7 @@ namespace g2o {
     protected:
     bool* _forceStopFlag;
     bool _verbose;
+    int _numThreads;
 
     VertexContainer _ivMap;
     VertexContainer _activeVertices;   ///< sorted according to VertexIDCompare
@@ -29,6 +29,7 @@
 
 #include <Eigen/Sparse>
 #include <Eigen/SparseCholesky>
+#include <Eigen/Cholesky>
 
 #include "../core/linear_solver.h"
 #include "../core/batch_stats.h"
@@ -36,6 +37,8 @@
 
 #include "../core/eigen_types.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <iostream>
 #include <vector>
 
@@ -46,6 +49,14 @@ namespace g2o {
  *
  * Has no dependencies except Eigen. Hence, should compile almost everywhere
  * without to much issues. Performance should be similar to CSparse, I guess.
+ *
+ * The symbolic decomposition is kept when init() is called again and the
+ * block structure of A did not change. The fill-in reducing ordering of the
+ * last structure is also cached per thread, so that the next solver created
+ * on the same thread for a matrix with the same structure skips the
+ * ordering. Small and dense systems, such as the reduced camera system of a
+ * local BA, can be solved with a dense blocked Cholesky instead, see
+ * setDenseBlockPath().
  */
 template <typename MatrixType>
 class LinearSolverEigen: public LinearSolver<MatrixType>
@@ -77,7 +88,9 @@ class LinearSolverEigen: public LinearSolver<MatrixType>
   public:
     LinearSolverEigen() :
       LinearSolver<MatrixType>(),
-      _init(true), _blockOrdering(false), _writeDebug(false)
+      _init(true), _blockOrdering(false), _writeDebug(false),
+      _hasSymbolic(false), _structureHash(0),
+      _useDense(false), _denseMaxSize(0), _denseMinFill(1.)
     {
     }
 
@@ -93,12 +106,28 @@ class LinearSolverEigen: public LinearSolver<MatrixType>
 
     bool solve(const SparseBlockMatrix<MatrixType>& A, double* x, double* b)
     {
-      if (_init)
-        _sparseMatrix.resize(A.rows(), A.cols());
-      fillSparseMatrix(A, !_init);
-      if (_init) // compute the symbolic composition once
-        computeSymbolicDecomposition(A);
-      _init = false;
+      if (_init) {
+        _useDense = useDenseBlockPath(A);
+        if (_useDense) {
+          _denseMatrix.setZero(A.rows(), A.cols());
+        } else {
+          const std::size_t hash = structureHash(A);
+          if (_hasSymbolic && hash == _structureHash && samePattern(A)) {
+            // same pattern as the last system, only the values changed
+            fillSparseMatrix(A, true);
+          } else {
+            _sparseMatrix.resize(A.rows(), A.cols());
+            fillSparseMatrix(A, false);
+            computeSymbolicDecomposition(A, hash);
+          }
+        }
+        _init = false;
+      } else if (!_useDense) {
+        fillSparseMatrix(A, true);
+      }
+
+      if (_useDense)
+        return solveDense(A, x, b);
 
       double t=get_monotonic_time();
       _cholesky.factorize(_sparseMatrix);
@@ -127,27 +156,185 @@ class LinearSolverEigen: public LinearSolver<MatrixType>
     bool blockOrdering() const { return _blockOrdering;}
     void setBlockOrdering(bool blockOrdering) { _blockOrdering = blockOrdering;}
 
+    /**
+     * Solve systems with at most maxSize rows and at least minFill of the
+     * upper triangle filled with a dense blocked Cholesky decomposition. The
+     * sparse decomposition does not pay off for such systems. A maxSize of 0
+     * (default) always uses the sparse decomposition.
+     */
+    void setDenseBlockPath(int maxSize, double minFill) { _denseMaxSize = maxSize; _denseMinFill = minFill;}
+    int denseMaxSize() const { return _denseMaxSize;}
+    double denseMinFill() const { return _denseMinFill;}
+
     //! write a debug dump of the system matrix if it is not SPD in solve
     virtual bool writeDebug() const { return _writeDebug;}
     virtual void setWriteDebug(bool b) { _writeDebug = b;}
 
   protected:
+    /**
+     * Fill-in reducing ordering of the last analyzed structure. Kept per
+     * thread, as each optimizer runs on a single thread and the consecutive
+     * optimizations of a thread (e.g. the local BAs of the local mapping)
+     * often have the same structure.
+     */
+    struct OrderingCache
+    {
+      OrderingCache() : valid(false), hash(0) {}
+      bool valid;
+      std::size_t hash;
+      PermutationMatrix permutation;
+    };
+
+    static OrderingCache& orderingCache()
+    {
+      static thread_local OrderingCache cache;
+      return cache;
+    }
+
     bool _init;
     bool _blockOrdering;
     bool _writeDebug;
     SparseMatrix _sparseMatrix;
     CholeskyDecomposition _cholesky;
 
+    bool _hasSymbolic;
+    std::size_t _structureHash;
+
+    bool _useDense;
+    int _denseMaxSize;
+    double _denseMinFill;
+    Eigen::MatrixXd _denseMatrix;
+    Eigen::LLT<Eigen::MatrixXd, Eigen::Upper> _denseCholesky;
+
+    /**
+     * hash of the block structure of the upper triangle of A and of the
+     * ordering settings. Only a quick pre-check, samePattern() decides if the
+     * symbolic decomposition can be reused.
+     */
+    std::size_t structureHash(const SparseBlockMatrix<MatrixType>& A) const
+    {
+      std::size_t hash = 14695981039346656037ULL;
+      const std::size_t prime = 1099511628211ULL;
+      hash = (hash ^ static_cast<std::size_t>(_blockOrdering)) * prime;
+      hash = (hash ^ static_cast<std::size_t>(A.rows())) * prime;
+      for (size_t c = 0; c < A.blockCols().size(); ++c) {
+        hash = (hash ^ static_cast<std::size_t>(A.colsOfBlock(c))) * prime;
+        const typename SparseBlockMatrix<MatrixType>::IntBlockMap& column = A.blockCols()[c];
+        for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it = column.begin(); it != column.end(); ++it) {
+          if (it->first > static_cast<int>(c))
+            break;
+          hash = (hash ^ static_cast<std::size_t>(it->first + 1)) * prime;
+        }
+        // column separator, so that the same rows in other columns differ
+        hash = (hash ^ 0xffu) * prime;
+      }
+      return hash;
+    }
+
+    /**
+     * true if the upper triangle of A has the non-zero pattern of
+     * _sparseMatrix, i.e. the same size, column pointers and row indices as
+     * fillSparseMatrix would create for it.
+     */
+    bool samePattern(const SparseBlockMatrix<MatrixType>& A) const
+    {
+      if (_sparseMatrix.rows() != A.rows() || _sparseMatrix.cols() != A.cols() || ! _sparseMatrix.isCompressed())
+        return false;
+      const int* outer = _sparseMatrix.outerIndexPtr();
+      const int* inner = _sparseMatrix.innerIndexPtr();
+      const int nnz = _sparseMatrix.nonZeros();
+      int k = 0;
+      for (size_t c = 0; c < A.blockCols().size(); ++c) {
+        const int colBaseOfBlock = A.colBaseOfBlock(c);
+        const typename SparseBlockMatrix<MatrixType>::IntBlockMap& column = A.blockCols()[c];
+        for (int cc = 0; cc < A.colsOfBlock(c); ++cc) {
+          const int aux_c = colBaseOfBlock + cc;
+          if (outer[aux_c] != k)
+            return false;
+          for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it = column.begin(); it != column.end(); ++it) {
+            const int rowBaseOfBlock = A.rowBaseOfBlock(it->first);
+            if (rowBaseOfBlock > aux_c)
+              break;
+            const int lastRow = std::min(rowBaseOfBlock + A.rowsOfBlock(it->first) - 1, aux_c);
+            for (int aux_r = rowBaseOfBlock; aux_r <= lastRow; ++aux_r, ++k) {
+              if (k >= nnz || inner[k] != aux_r)
+                return false;
+            }
+          }
+        }
+      }
+      return k == nnz && outer[_sparseMatrix.cols()] == nnz;
+    }
+
+    bool useDenseBlockPath(const SparseBlockMatrix<MatrixType>& A) const
+    {
+      const int n = A.rows();
+      if (n == 0 || n > _denseMaxSize)
+        return false;
+      double nnz = 0.;
+      for (size_t c = 0; c < A.blockCols().size(); ++c) {
+        const typename SparseBlockMatrix<MatrixType>::IntBlockMap& column = A.blockCols()[c];
+        for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it = column.begin(); it != column.end(); ++it) {
+          if (it->first > static_cast<int>(c))
+            break;
+          nnz += A.rowsOfBlock(it->first) * A.colsOfBlock(c);
+        }
+      }
+      return nnz >= _denseMinFill * 0.5 * n * (n + 1);
+    }
+
+    bool solveDense(const SparseBlockMatrix<MatrixType>& A, double* x, double* b)
+    {
+      double t=get_monotonic_time();
+      // only the upper triangle is read by the decomposition
+      for (size_t c = 0; c < A.blockCols().size(); ++c) {
+        const int colBaseOfBlock = A.colBaseOfBlock(c);
+        const typename SparseBlockMatrix<MatrixType>::IntBlockMap& column = A.blockCols()[c];
+        for (typename SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it = column.begin(); it != column.end(); ++it) {
+          if (it->first > static_cast<int>(c))
+            break;
+          const MatrixType& m = *(it->second);
+          _denseMatrix.block(A.rowBaseOfBlock(it->first), colBaseOfBlock, m.rows(), m.cols()) = m;
+        }
+      }
+
+      _denseCholesky.compute(_denseMatrix);
+      if (_denseCholesky.info() != Eigen::Success) { // the matrix is not positive definite
+        if (_writeDebug) {
+          std::cerr << "Cholesky failure, writing debug.txt (Hessian loadable by Octave)" << std::endl;
+          A.writeOctave("debug.txt");
+        }
+        return false;
+      }
+
+      VectorXD::MapType xx(x, _denseMatrix.cols());
+      VectorXD::ConstMapType bb(b, _denseMatrix.cols());
+      xx = _denseCholesky.solve(bb);
+      G2OBatchStatistics* globalStats = G2OBatchStatistics::globalStats();
+      if (globalStats) {
+        globalStats->timeNumericDecomposition = get_monotonic_time() - t;
+        globalStats->choleskyNNZ = static_cast<size_t>(_denseMatrix.cols()) * (_denseMatrix.cols() + 1) / 2;
+      }
+      return true;
+    }
+
     /**
      * compute the symbolic decompostion of the matrix only once.
      * Since A has the same pattern in all the iterations, we only
      * compute the fill-in reducing ordering once and re-use for all
-     * the following iterations.
+     * the following iterations. If the ordering cache of this thread holds
+     * the ordering of the same structure, only the elimination tree is
+     * computed.
      */
-    void computeSymbolicDecomposition(const SparseBlockMatrix<MatrixType>& A)
+    void computeSymbolicDecomposition(const SparseBlockMatrix<MatrixType>& A, std::size_t hash)
     {
       double t=get_monotonic_time();
-      if (! _blockOrdering) {
+      OrderingCache& cache = orderingCache();
+      // a permutation of the right size is a valid ordering even if a hash
+      // collision made it belong to another structure
+      if (cache.valid && cache.hash == hash && cache.permutation.size() == _sparseMatrix.cols()) {
+        _cholesky.analyzePatternWithPermutation(_sparseMatrix, cache.permutation);
+      } else if (! _blockOrdering) {
         _cholesky.analyzePattern(_sparseMatrix);
       } else {
         // block ordering with the Eigen Interface
@@ -195,6 +382,16 @@ class LinearSolverEigen: public LinearSolver<MatrixType>
         _cholesky.analyzePatternWithPermutation(_sparseMatrix, scalarP);
 
       }
+
+      // the ordering is empty if Eigen did not permute the matrix
+      cache.valid = _cholesky.permutationPinv().size() == _sparseMatrix.cols();
+      if (cache.valid) {
+        cache.hash = hash;
+        cache.permutation = _cholesky.permutationPinv();
+      }
+      _hasSymbolic = true;
+      _structureHash = hash;
+
       G2OBatchStatistics* globalStats = G2OBatchStatistics::globalStats();
       if (globalStats)
         globalStats->timeSymbolicDecomposition = get_monotonic_time() - t;
@@ -0,0 +1,100 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ORB_SLAM2_BENCHMARK_UTILS_H
+#define ORB_SLAM2_BENCHMARK_UTILS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "latency_stats.h"
+
+namespace ORB_SLAM2 {
+namespace benchmark {
+
+// Returns the time elapsed since the given point in milliseconds
+inline double ElapsedMs(const std::chrono::steady_clock::time_point &t0) {
+  return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(
+             std::chrono::steady_clock::now() - t0)
+      .count();
+}
+
+inline void PrintStatsHeader() {
+  std::printf("%-36s %8s %10s %10s %10s %10s\n",
+              "benchmark",
+              "iters",
+              "mean[ms]",
+              "p50[ms]",
+              "p99[ms]",
+              "max[ms]");
+}
+
+inline void PrintStats(const std::string &name, const LatencyStats &stats) {
+  std::printf("%-36s %8d %10.4f %10.4f %10.4f %10.4f\n",
+              name.c_str(),
+              stats.count,
+              stats.mean,
+              stats.p50,
+              stats.p99,
+              stats.max);
+}
+
+// Runs setup() (untimed) followed by func() (timed) n_iter times after
+// n_warmup untimed runs, and prints the latency statistics of func().
+template <typename Setup, typename Func>
+LatencyStats RunBenchmark(const std::string &name,
+                          int n_warmup,
+                          int n_iter,
+                          Setup setup,
+                          Func func) {
+  for (int i = 0; i < n_warmup; i++) {
+    setup();
+    func();
+  }
+
+  std::vector<double> samples;
+  samples.reserve(n_iter);
+  for (int i = 0; i < n_iter; i++) {
+    setup();
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    func();
+    samples.push_back(ElapsedMs(t0));
+  }
+
+  LatencyStats stats = ComputeLatencyStats(samples);
+  PrintStats(name, stats);
+  return stats;
+}
+
+template <typename Func>
+LatencyStats RunBenchmark(const std::string &name,
+                          int n_warmup,
+                          int n_iter,
+                          Func func) {
+  return RunBenchmark(name, n_warmup, n_iter, [] {}, func);
+}
+
+}  // namespace benchmark
+}  // namespace ORB_SLAM2
+
+#endif  // ORB_SLAM2_BENCHMARK_UTILS_H
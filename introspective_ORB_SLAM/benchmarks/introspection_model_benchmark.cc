@@ -0,0 +1,188 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compares two exported introspection models, typically the fp32 reference
+// and a quantized or fp16 export of the same network, over the left images
+// of a sequence. For every frame both models are run through the same
+// IntrospectionSession used by the SLAM drivers. The tool reports the
+// per-frame latency of each model and how far the candidate heatmaps
+// deviate from the reference ones, in 8-bit cost levels.
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <string>
+#include <vector>
+
+#include "benchmark_utils.h"
+#include "introspection_session.h"
+
+#if (CV_VERSION_MAJOR >= 4)
+#include <opencv2/imgcodecs/legacy/constants_c.h>
+#endif
+
+DEFINE_string(reference_model_path,
+              "",
+              "Path to the reference (usually fp32) TorchScript model.");
+DEFINE_string(candidate_model_path,
+              "",
+              "Path to the TorchScript model that is compared to the "
+              "reference.");
+DEFINE_string(data_path,
+              "",
+              "Path to the sequence. The images in data_path/image_0 are "
+              "used.");
+DEFINE_int32(input_width,
+             0,
+             "If set together with input_height, images are resized to this "
+             "size before inference (e.g. 512 for the AirSim models).");
+DEFINE_int32(input_height, 0, "See input_width.");
+DEFINE_int32(end_frame, -1, "Last frame (exclusive). All frames if negative.");
+DEFINE_int32(deviation_threshold,
+             25,
+             "Pixels whose cost differs by more than this many levels (out "
+             "of 255) are counted as deviating.");
+DEFINE_bool(use_gpu, false, "Runs both models on the GPU if available.");
+DEFINE_string(report_path,
+              "",
+              "If set, per-frame latencies and deviations are written to "
+              "this file as comma separated values.");
+
+using namespace std;
+using namespace ORB_SLAM2;
+using namespace ORB_SLAM2::benchmark;
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  gflags::SetUsageMessage(
+      "Compares the heatmaps and the latency of two introspection models "
+      "over a sequence.");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (FLAGS_reference_model_path.empty() ||
+      FLAGS_candidate_model_path.empty() || FLAGS_data_path.empty()) {
+    LOG(FATAL) << "reference_model_path, candidate_model_path and data_path "
+               << "must be set.";
+  }
+
+  vector<cv::String> image_paths;
+  cv::glob(FLAGS_data_path + "/image_0/*.png", image_paths, false);
+  int n_images = image_paths.size();
+  if (FLAGS_end_frame > 0) n_images = min(n_images, FLAGS_end_frame);
+  if (n_images == 0) {
+    LOG(FATAL) << "No images found in " << FLAGS_data_path << "/image_0";
+  }
+
+  const cv::Size input_size(FLAGS_input_width, FLAGS_input_height);
+  IntrospectionSession reference, candidate;
+  if (!reference.Load(FLAGS_reference_model_path, FLAGS_use_gpu, input_size)) {
+    LOG(FATAL) << "Failed to load " << FLAGS_reference_model_path;
+  }
+  if (!candidate.Load(FLAGS_candidate_model_path, FLAGS_use_gpu, input_size)) {
+    LOG(FATAL) << "Failed to load " << FLAGS_candidate_model_path;
+  }
+
+  ofstream report;
+  if (!FLAGS_report_path.empty()) {
+    report.open(FLAGS_report_path.c_str());
+    report << "frame,reference_ms,candidate_ms,mean_abs_diff,max_abs_diff,"
+           << "deviating_ratio" << endl;
+  }
+
+  vector<double> reference_latencies, candidate_latencies;
+  vector<double> mean_abs_diffs, deviating_ratios;
+  double max_abs_diff_all = 0.0;
+  for (int ni = 0; ni < n_images; ni++) {
+    const cv::Mat im = cv::imread(image_paths[ni], CV_LOAD_IMAGE_COLOR);
+    if (im.empty()) {
+      LOG(FATAL) << "Failed to load " << image_paths[ni];
+    }
+
+    // Both sessions warm up on their first call, outside of the timing
+    reference.Warmup(im.size());
+    candidate.Warmup(im.size());
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    const cv::Mat heatmap_ref = reference.Predict(im);
+    reference_latencies.push_back(ElapsedMs(t0));
+
+    t0 = chrono::steady_clock::now();
+    const cv::Mat heatmap_cand = candidate.Predict(im);
+    candidate_latencies.push_back(ElapsedMs(t0));
+
+    CHECK_EQ(heatmap_ref.size(), heatmap_cand.size())
+        << "The two models return heatmaps of different sizes.";
+
+    cv::Mat abs_diff;
+    cv::absdiff(heatmap_ref, heatmap_cand, abs_diff);
+    double max_abs_diff;
+    cv::minMaxLoc(abs_diff, NULL, &max_abs_diff);
+    const double mean_abs_diff = cv::mean(abs_diff)[0];
+    const double deviating_ratio =
+        static_cast<double>(
+            cv::countNonZero(abs_diff > FLAGS_deviation_threshold)) /
+        abs_diff.total();
+
+    mean_abs_diffs.push_back(mean_abs_diff);
+    deviating_ratios.push_back(deviating_ratio);
+    max_abs_diff_all = max(max_abs_diff_all, max_abs_diff);
+
+    if (report.is_open()) {
+      report << fixed << setprecision(4) << ni << ","
+             << reference_latencies.back() << ","
+             << candidate_latencies.back() << "," << mean_abs_diff << ","
+             << max_abs_diff << "," << deviating_ratio << endl;
+    }
+  }
+
+  cout << endl << "--------------------" << endl;
+  cout << "Sequence: " << FLAGS_data_path << endl;
+  cout << "Frames: " << n_images << endl << endl;
+  PrintStatsHeader();
+  const LatencyStats reference_stats =
+      ComputeLatencyStats(reference_latencies);
+  const LatencyStats candidate_stats =
+      ComputeLatencyStats(candidate_latencies);
+  PrintStats("reference", reference_stats);
+  PrintStats("candidate", candidate_stats);
+
+  const LatencyStats mae_stats = ComputeLatencyStats(mean_abs_diffs);
+  const LatencyStats ratio_stats = ComputeLatencyStats(deviating_ratios);
+  cout << endl << fixed << setprecision(3);
+  cout << "Speedup (mean latency): "
+       << reference_stats.mean / candidate_stats.mean << "x" << endl;
+  cout << "Mean abs heatmap difference [levels] mean / p99 / max: "
+       << mae_stats.mean << " / " << mae_stats.p99 << " / " << mae_stats.max
+       << endl;
+  cout << "Max abs pixel difference [levels]: " << max_abs_diff_all << endl;
+  cout << "Pixels off by more than " << FLAGS_deviation_threshold
+       << " levels [%] mean / max: " << 100.0 * ratio_stats.mean << " / "
+       << 100.0 * ratio_stats.max << endl;
+  cout << "--------------------" << endl;
+
+  return 0;
+}
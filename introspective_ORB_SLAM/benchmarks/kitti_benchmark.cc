@@ -0,0 +1,333 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Sequence level benchmark. Replays a KITTI format stereo sequence in single
+// threaded mode, so that every frame includes its share of local mapping and
+// loop closing work, and reports the throughput, the per-frame latency
+// distribution and the absolute trajectory error (ATE) against ground truth.
+// Image loading is not included in the latencies. With --check_replay the
+// sequence is replayed twice with --deterministic_replay and the two saved
+// trajectories must be identical.
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "System.h"
+#include "benchmark_utils.h"
+
+#if (CV_VERSION_MAJOR >= 4)
+#include <opencv2/imgcodecs/legacy/constants_c.h>
+#endif
+
+DEFINE_string(vocab_path, "", "Path to ORB vocabulary.");
+DEFINE_string(settings_path, "", "Path to ORB-SLAM config file.");
+DEFINE_string(data_path,
+              "",
+              "Path to the sequence. It must contain image_0/, image_1/ and "
+              "the timestamps file.");
+DEFINE_string(times_file,
+              "times.txt",
+              "Name of the timestamps file inside data_path.");
+DEFINE_string(ground_truth_path,
+              "",
+              "Path to the KITTI format ground truth poses. ATE is not "
+              "computed if not set.");
+DEFINE_string(out_path,
+              ".",
+              "Directory where the estimated trajectory is saved.");
+DEFINE_string(report_path,
+              "",
+              "If set, the summary is also appended to this file as one "
+              "line of comma separated values.");
+DEFINE_int32(end_frame, -1, "Last frame (exclusive). All frames if negative.");
+DEFINE_bool(check_replay,
+            false,
+            "Replay the sequence a second time with --deterministic_replay "
+            "and fail if the two trajectories are not identical.");
+
+using namespace std;
+using namespace ORB_SLAM2;
+using namespace ORB_SLAM2::benchmark;
+
+namespace {
+
+void LoadImages(const string &path_to_sequence,
+                const string &times_file,
+                vector<string> *image_left,
+                vector<string> *image_right,
+                vector<double> *timestamps) {
+  ifstream f_times((path_to_sequence + "/" + times_file).c_str());
+  string line;
+  while (getline(f_times, line)) {
+    if (line.empty()) continue;
+    stringstream ss(line);
+    double t;
+    ss >> t;
+    timestamps->push_back(t);
+  }
+
+  const string prefix_left = path_to_sequence + "/image_0/";
+  const string prefix_right = path_to_sequence + "/image_1/";
+  for (size_t i = 0; i < timestamps->size(); i++) {
+    stringstream ss;
+    ss << setfill('0') << setw(6) << i;
+    image_left->push_back(prefix_left + ss.str() + ".png");
+    image_right->push_back(prefix_right + ss.str() + ".png");
+  }
+}
+
+// Reads the camera positions of a KITTI format pose file (3x4 Twc per line)
+vector<Eigen::Vector3d> LoadPositions(const string &path) {
+  vector<Eigen::Vector3d> positions;
+  ifstream f(path.c_str());
+  string line;
+  while (getline(f, line)) {
+    if (line.empty()) continue;
+    stringstream ss(line);
+    double v[12];
+    for (int i = 0; i < 12; i++) ss >> v[i];
+    positions.push_back(Eigen::Vector3d(v[3], v[7], v[11]));
+  }
+  return positions;
+}
+
+vector<double> LoadTimestamps(const string &path) {
+  vector<double> timestamps;
+  ifstream f(path.c_str());
+  double t;
+  while (f >> t) timestamps.push_back(t);
+  return timestamps;
+}
+
+// Root mean square of the position error after a rigid alignment of the
+// estimated trajectory to the ground truth. Returns -1 with fewer than three
+// associated poses.
+double ComputeATE(const vector<Eigen::Vector3d> &estimated,
+                  const vector<Eigen::Vector3d> &ground_truth) {
+  const int n = estimated.size();
+  if (n < 3) return -1.0;
+
+  Eigen::Matrix3Xd src(3, n), dst(3, n);
+  for (int i = 0; i < n; i++) {
+    src.col(i) = estimated[i];
+    dst.col(i) = ground_truth[i];
+  }
+
+  const Eigen::Matrix4d T = Eigen::umeyama(src, dst, false);
+  const Eigen::Matrix3Xd aligned =
+      (T.topLeftCorner<3, 3>() * src).colwise() + T.topRightCorner<3, 1>();
+
+  return sqrt((aligned - dst).colwise().squaredNorm().mean());
+}
+
+// Tracks frames [0, n_images) of the sequence with a new SLAM system in single
+// threaded mode and saves the trajectory. Returns the per-frame latencies.
+vector<double> RunSequence(const vector<string> &image_left,
+                           const vector<string> &image_right,
+                           const vector<double> &timestamps,
+                           const int n_images,
+                           const string &trajectory_path,
+                           const string &trajectory_times_path,
+                           double *wall_time_s) {
+  const bool use_viewer = false;
+  const bool single_threaded = true;
+  const bool use_BoW = true;
+  const bool silent_mode = true;
+  System SLAM(FLAGS_vocab_path,
+              FLAGS_settings_path,
+              System::STEREO,
+              use_viewer,
+              false,
+              false,
+              false,
+              false,
+              single_threaded,
+              use_BoW,
+              "",
+              "",
+              silent_mode);
+
+  vector<double> latencies;
+  latencies.reserve(n_images);
+  cv::Mat im_left, im_right;
+  const chrono::steady_clock::time_point t_start = chrono::steady_clock::now();
+  for (int ni = 0; ni < n_images; ni++) {
+    im_left = cv::imread(image_left[ni], CV_LOAD_IMAGE_UNCHANGED);
+    im_right = cv::imread(image_right[ni], CV_LOAD_IMAGE_UNCHANGED);
+    if (im_left.empty() || im_right.empty()) {
+      LOG(FATAL) << "Failed to load frame " << ni;
+    }
+
+    const chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    SLAM.TrackStereo(im_left, im_right, timestamps[ni]);
+    latencies.push_back(ElapsedMs(t0));
+  }
+  *wall_time_s = ElapsedMs(t_start) / 1000.0;
+
+  SLAM.Shutdown();
+  SLAM.SaveTrajectoryKITTI(trajectory_path, trajectory_times_path);
+  return latencies;
+}
+
+// Returns true if the two text files have the same lines. Otherwise
+// line_idx is set to the index of the first line that differs.
+bool CompareFiles(const string &path_a, const string &path_b, int *line_idx) {
+  ifstream f_a(path_a.c_str());
+  ifstream f_b(path_b.c_str());
+  string line_a, line_b;
+  *line_idx = 0;
+  while (true) {
+    const bool has_a = static_cast<bool>(getline(f_a, line_a));
+    const bool has_b = static_cast<bool>(getline(f_b, line_b));
+    if (!has_a && !has_b) return true;
+    if (has_a != has_b || line_a != line_b) return false;
+    (*line_idx)++;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  gflags::SetUsageMessage(
+      "Replays a KITTI format stereo sequence and reports FPS, latency "
+      "percentiles and ATE.");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (FLAGS_vocab_path.empty() || FLAGS_settings_path.empty() ||
+      FLAGS_data_path.empty()) {
+    LOG(FATAL) << "vocab_path, settings_path and data_path must be set.";
+  }
+
+  vector<string> image_left, image_right;
+  vector<double> timestamps;
+  LoadImages(FLAGS_data_path,
+             FLAGS_times_file,
+             &image_left,
+             &image_right,
+             &timestamps);
+  int n_images = timestamps.size();
+  if (FLAGS_end_frame > 0) n_images = min(n_images, FLAGS_end_frame);
+  if (n_images == 0) {
+    LOG(FATAL) << "No images found in " << FLAGS_data_path;
+  }
+
+  if (FLAGS_check_replay) FLAGS_deterministic_replay = true;
+
+  const string trajectory_path = FLAGS_out_path + "/CameraTrajectory.txt";
+  const string trajectory_times_path =
+      FLAGS_out_path + "/CameraTrajectory_times.txt";
+  double wall_time_s = 0.0;
+  const vector<double> latencies = RunSequence(image_left,
+                                               image_right,
+                                               timestamps,
+                                               n_images,
+                                               trajectory_path,
+                                               trajectory_times_path,
+                                               &wall_time_s);
+
+  if (FLAGS_check_replay) {
+    const string replay_path = FLAGS_out_path + "/CameraTrajectory_replay.txt";
+    const string replay_times_path =
+        FLAGS_out_path + "/CameraTrajectory_replay_times.txt";
+    double replay_wall_time_s = 0.0;
+    RunSequence(image_left,
+                image_right,
+                timestamps,
+                n_images,
+                replay_path,
+                replay_times_path,
+                &replay_wall_time_s);
+
+    int line_idx = 0;
+    if (!CompareFiles(trajectory_path, replay_path, &line_idx) ||
+        !CompareFiles(trajectory_times_path, replay_times_path, &line_idx)) {
+      LOG(ERROR) << "Replay check failed: the trajectories differ at pose "
+                 << line_idx << ". See " << trajectory_path << " and "
+                 << replay_path;
+      return 1;
+    }
+    cout << "Replay check passed: both runs saved identical trajectories."
+         << endl;
+  }
+
+  const LatencyStats stats = ComputeLatencyStats(latencies);
+  double tracking_time_s = 0.0;
+  for (double l : latencies) tracking_time_s += l / 1000.0;
+  const double fps = n_images / tracking_time_s;
+
+  // Associate the saved poses to the frames through their timestamps. Frames
+  // where tracking was lost are not in the trajectory.
+  double ate = -1.0;
+  int n_associated = 0;
+  if (!FLAGS_ground_truth_path.empty()) {
+    const vector<Eigen::Vector3d> gt = LoadPositions(FLAGS_ground_truth_path);
+    const vector<Eigen::Vector3d> est = LoadPositions(trajectory_path);
+    const vector<double> est_times = LoadTimestamps(trajectory_times_path);
+
+    vector<Eigen::Vector3d> est_associated, gt_associated;
+    int ni = 0;
+    for (size_t i = 0; i < est.size() && i < est_times.size(); i++) {
+      while (ni < n_images && timestamps[ni] < est_times[i] - 1e-6) ni++;
+      if (ni == n_images || ni >= static_cast<int>(gt.size())) break;
+      if (fabs(timestamps[ni] - est_times[i]) > 1e-6) continue;
+      est_associated.push_back(est[i]);
+      gt_associated.push_back(gt[ni]);
+    }
+    n_associated = est_associated.size();
+    ate = ComputeATE(est_associated, gt_associated);
+  }
+
+  cout << endl << "--------------------" << endl;
+  cout << "Sequence: " << FLAGS_data_path << endl;
+  cout << "Frames: " << n_images << endl;
+  cout << fixed << setprecision(3);
+  cout << "Wall time [s] (incl. image loading): " << wall_time_s << endl;
+  cout << "FPS (tracking only): " << fps << endl;
+  cout << "Latency [ms] mean / p50 / p99 / max: " << stats.mean << " / "
+       << stats.p50 << " / " << stats.p99 << " / " << stats.max << endl;
+  if (ate >= 0) {
+    cout << "ATE RMSE [m]: " << ate << " (" << n_associated << " poses)"
+         << endl;
+  }
+  cout << "--------------------" << endl;
+
+  if (!FLAGS_report_path.empty()) {
+    ofstream report(FLAGS_report_path.c_str(), ios::app);
+    report << fixed << setprecision(4) << FLAGS_data_path << "," << n_images
+           << "," << fps << "," << stats.mean << "," << stats.p50 << ","
+           << stats.p99 << "," << stats.max << "," << ate << endl;
+  }
+
+  return 0;
+}
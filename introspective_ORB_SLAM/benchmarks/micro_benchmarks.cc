@@ -0,0 +1,478 @@
+/**
+ * This file is part of ORB-SLAM2.
+ *
+ * Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University
+ * of Zaragoza) For more information see <https://github.com/raulmur/ORB_SLAM2>
+ *
+ * ORB-SLAM2 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * ORB-SLAM2 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Micro-benchmarks of the main per-frame and per-keyframe kernels on fixed
+// synthetic inputs. The inputs only depend on --seed, so the numbers of two
+// builds can be compared directly. Pass --left_image/--right_image to use a
+// real rectified stereo pair instead of the synthetic one.
+
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include <Eigen/Core>
+#include <algorithm>
+#include <iostream>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <vector>
+
+#include "Frame.h"
+#include "KeyFrame.h"
+#include "KeyFrameDatabase.h"
+#include "LocalMapCuller.h"
+#include "Map.h"
+#include "MapPoint.h"
+#include "ORBVocabulary.h"
+#include "ORBextractor.h"
+#include "ORBmatcher.h"
+#include "Optimizer.h"
+#include "SessionContext.h"
+#include "ThreadPool.h"
+#include "benchmark_utils.h"
+#include "feature_evaluator.h"
+
+#if (CV_VERSION_MAJOR >= 4)
+#include <opencv2/imgcodecs/legacy/constants_c.h>
+#endif
+
+DEFINE_string(vocab_path,
+              "",
+              "Path to the ORB vocabulary. The vocabulary transform benchmark "
+              "is skipped if not set.");
+DEFINE_string(left_image, "", "Optional left image of a rectified pair.");
+DEFINE_string(right_image, "", "Optional right image of a rectified pair.");
+DEFINE_int32(seed, 42, "Seed of the synthetic inputs.");
+DEFINE_int32(iterations, 50, "Timed iterations per benchmark.");
+DEFINE_int32(warmup, 5, "Untimed iterations before each benchmark.");
+DEFINE_int32(num_features, 2000, "Features extracted per image.");
+DEFINE_int32(gp_num_points, 300, "Training points of the GP benchmarks.");
+
+using namespace std;
+using namespace ORB_SLAM2;
+using namespace ORB_SLAM2::benchmark;
+
+namespace {
+
+// KITTI 00-02 calibration
+const int kRows = 376;
+const int kCols = 1241;
+const float kFx = 718.856f;
+const float kFy = 718.856f;
+const float kCx = 607.1928f;
+const float kCy = 185.2157f;
+const float kBf = 386.1448f;
+const float kThDepth = 35.0f;
+
+// Disparity of the synthetic right image in pixels
+const int kSyntheticDisparity = 16;
+
+// Textured image made of random blobs and boxes, so that FAST finds plenty of
+// corners at all pyramid levels
+cv::Mat MakeSyntheticImage(cv::RNG &rng) {
+  cv::Mat im(kRows, kCols, CV_8U, cv::Scalar(128));
+  for (int i = 0; i < 4000; i++) {
+    const cv::Point c(rng.uniform(0, kCols), rng.uniform(0, kRows));
+    const int r = rng.uniform(2, 14);
+    const cv::Scalar color(rng.uniform(0, 256));
+    if (i % 2 == 0) {
+      cv::circle(im, c, r, color, -1);
+    } else {
+      cv::rectangle(im, c, c + cv::Point(r, r), color, -1);
+    }
+  }
+  cv::GaussianBlur(im, im, cv::Size(3, 3), 0);
+  return im;
+}
+
+// Right view of a fronto-parallel scene with a constant disparity
+cv::Mat MakeRightImage(const cv::Mat &im_left) {
+  cv::Mat M = (cv::Mat_<double>(2, 3) << 1, 0, -kSyntheticDisparity, 0, 1, 0);
+  cv::Mat im_right;
+  cv::warpAffine(im_left,
+                 im_right,
+                 M,
+                 im_left.size(),
+                 cv::INTER_LINEAR,
+                 cv::BORDER_REFLECT);
+  return im_right;
+}
+
+// Smooth cost map as produced by the introspection function
+cv::Mat MakeCostMap(cv::RNG &rng) {
+  cv::Mat small(kRows / 16, kCols / 16, CV_8U);
+  rng.fill(small, cv::RNG::UNIFORM, 0, 256);
+  cv::Mat cost;
+  cv::resize(small, cost, cv::Size(kCols, kRows), 0, 0, cv::INTER_LINEAR);
+  return cost;
+}
+
+// Adds a map point for every keypoint of the keyframe with a stereo depth
+vector<MapPoint *> AddStereoMapPoints(KeyFrame *kf, Frame &frame, Map *map) {
+  vector<MapPoint *> map_points;
+  for (int i = 0; i < frame.N; i++) {
+    if (frame.mvDepth[i] <= 0) continue;
+    MapPoint *pMP = new MapPoint(frame.UnprojectStereo(i), kf, map);
+    pMP->AddObservation(kf, i);
+    kf->AddMapPoint(pMP, i);
+    pMP->ComputeDistinctiveDescriptors();
+    pMP->UpdateNormalAndDepth();
+    map->AddMapPoint(pMP);
+    map_points.push_back(pMP);
+  }
+  return map_points;
+}
+
+// Gives both frames a keyframe with its own stereo map points, so that every
+// point of the current keyframe duplicates one of the reference keyframe, and
+// fuses the reference points into the current keyframe. Returns the map
+// point of every keypoint of both keyframes, as its index in creation order
+// (-1 if none), followed by its number of observations.
+vector<int> FuseDuplicateMapPoints(const Frame &frame_ref,
+                                   const Frame &frame_cur,
+                                   ORBVocabulary &vocabulary,
+                                   ThreadPool *thread_pool,
+                                   int *n_fused) {
+  Map map;
+  KeyFrameDatabase keyframe_db(vocabulary);
+  Frame frame_ref_copy(frame_ref);
+  Frame frame_cur_copy(frame_cur);
+  for (Frame *frame : {&frame_ref_copy, &frame_cur_copy}) {
+    fill(frame->mvpMapPoints.begin(),
+         frame->mvpMapPoints.end(),
+         static_cast<MapPoint *>(NULL));
+  }
+  KeyFrame *kf_ref = new KeyFrame(frame_ref_copy, &map, &keyframe_db);
+  KeyFrame *kf_cur = new KeyFrame(frame_cur_copy, &map, &keyframe_db);
+  map.AddKeyFrame(kf_ref);
+  map.AddKeyFrame(kf_cur);
+  const vector<MapPoint *> ref_points =
+      AddStereoMapPoints(kf_ref, frame_ref_copy, &map);
+  AddStereoMapPoints(kf_cur, frame_cur_copy, &map);
+  CHECK(!ref_points.empty());
+  const long unsigned int first_id = ref_points.front()->mnId;
+
+  ORBmatcher matcher;
+  *n_fused = matcher.Fuse(kf_cur, ref_points, 3.0, thread_pool);
+
+  vector<int> result;
+  for (KeyFrame *kf : {kf_ref, kf_cur}) {
+    for (MapPoint *pMP : kf->GetMapPointMatches()) {
+      if (!pMP || pMP->isBad()) {
+        result.push_back(-1);
+        result.push_back(0);
+        continue;
+      }
+      result.push_back(pMP->mnId - first_id);
+      result.push_back(pMP->Observations());
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  gflags::SetUsageMessage(
+      "Runs micro-benchmarks of the ORB-SLAM kernels on fixed inputs.");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  cv::RNG rng(FLAGS_seed);
+
+  cv::Mat im_left, im_right;
+  if (!FLAGS_left_image.empty() && !FLAGS_right_image.empty()) {
+    im_left = cv::imread(FLAGS_left_image, CV_LOAD_IMAGE_GRAYSCALE);
+    im_right = cv::imread(FLAGS_right_image, CV_LOAD_IMAGE_GRAYSCALE);
+    if (im_left.empty() || im_right.empty()) {
+      LOG(FATAL) << "Failed to load the stereo pair.";
+    }
+  } else {
+    im_left = MakeSyntheticImage(rng);
+    im_right = MakeRightImage(im_left);
+  }
+  const cv::Mat cost_map = MakeCostMap(rng);
+
+  cv::Mat K = cv::Mat::eye(3, 3, CV_32F);
+  K.at<float>(0, 0) = kFx;
+  K.at<float>(1, 1) = kFy;
+  K.at<float>(0, 2) = kCx;
+  K.at<float>(1, 2) = kCy;
+  cv::Mat dist_coef = cv::Mat::zeros(4, 1, CV_32F);
+
+  ORBVocabulary vocabulary;
+  const bool vocabulary_loaded =
+      !FLAGS_vocab_path.empty() &&
+      vocabulary.loadFromTextFile(FLAGS_vocab_path);
+  if (!FLAGS_vocab_path.empty() && !vocabulary_loaded) {
+    LOG(FATAL) << "Failed to load the vocabulary from " << FLAGS_vocab_path;
+  }
+
+  SessionContext context;
+
+  ORBextractor extractor_left(FLAGS_num_features, 1.2f, 8, 20, 7);
+  ORBextractor extractor_right(FLAGS_num_features, 1.2f, 8, 20, 7);
+  ORBextractor extractor_weighted(FLAGS_num_features, 1.2f, 8, 20, 7, true);
+  ORBextractor extractor_quantized(FLAGS_num_features, 1.2f, 8, 20, 7);
+  extractor_quantized.SetQuantizedAngles(true);
+
+  const int n_iter = FLAGS_iterations;
+  const int n_warmup = FLAGS_warmup;
+
+  PrintStatsHeader();
+
+  // Feature extraction
+  {
+    vector<cv::KeyPoint> keypoints;
+    cv::Mat descriptors;
+    RunBenchmark("ORBextractor", n_warmup, n_iter, [&] {
+      extractor_left(im_left, cv::Mat(), keypoints, descriptors);
+    });
+    RunBenchmark("ORBextractor (cost map)", n_warmup, n_iter, [&] {
+      extractor_weighted(im_left, cost_map, keypoints, descriptors);
+    });
+    RunBenchmark("ORBextractor (quantized angles)", n_warmup, n_iter, [&] {
+      extractor_quantized(im_left, cv::Mat(), keypoints, descriptors);
+    });
+
+    // The keypoints do not depend on the angle quantization, only the
+    // descriptors do
+    vector<cv::KeyPoint> keypoints_exact;
+    cv::Mat descriptors_exact;
+    extractor_left(im_left, cv::Mat(), keypoints_exact, descriptors_exact);
+    extractor_quantized(im_left, cv::Mat(), keypoints, descriptors);
+    CHECK_EQ(descriptors.rows, descriptors_exact.rows);
+    double hamming_sum = 0.0;
+    for (int i = 0; i < descriptors.rows; i++) {
+      hamming_sum += cv::norm(
+          descriptors.row(i), descriptors_exact.row(i), cv::NORM_HAMMING);
+    }
+    cout << "Quantized angles, mean descriptor Hamming distance: "
+         << hamming_sum / std::max(descriptors.rows, 1) << " / 256 bits"
+         << endl;
+
+    // The SIMD angle and descriptor kernels must give the same results as
+    // the scalar reference kernels on the detected keypoints
+    int n_checked, n_angle_mismatches, n_descriptor_mismatches;
+    extractor_left.CheckKernels(
+        im_left, n_checked, n_angle_mismatches, n_descriptor_mismatches);
+    cout << "ORB kernels vs scalar reference on " << n_checked
+         << " keypoints: " << n_angle_mismatches << " angles and "
+         << n_descriptor_mismatches << " descriptors differ" << endl;
+    CHECK_EQ(n_angle_mismatches, 0);
+    CHECK_EQ(n_descriptor_mismatches, 0);
+  }
+
+  // A reference frame and the current frame, both at the origin. The current
+  // frame is built last, so the extractor pyramids belong to it.
+  Frame frame_ref(im_left,
+                  im_right,
+                  0.0,
+                  &extractor_left,
+                  &extractor_right,
+                  &vocabulary,
+                  &context,
+                  K,
+                  dist_coef,
+                  kBf,
+                  kThDepth);
+  Frame frame_cur(im_left,
+                  im_right,
+                  0.1,
+                  &extractor_left,
+                  &extractor_right,
+                  &vocabulary,
+                  &context,
+                  K,
+                  dist_coef,
+                  kBf,
+                  kThDepth);
+  frame_ref.SetPose(cv::Mat::eye(4, 4, CV_32F));
+  frame_cur.SetPose(cv::Mat::eye(4, 4, CV_32F));
+
+  RunBenchmark("Frame::ComputeStereoMatches", n_warmup, n_iter, [&] {
+    frame_cur.ComputeStereoMatches();
+  });
+
+  // Descriptor distance, all pairs of 256 left and right descriptors
+  {
+    const int n = min(256, min(frame_cur.mDescriptors.rows,
+                               frame_cur.mDescriptorsRight.rows));
+    volatile int sink = 0;
+    RunBenchmark("DescriptorDistance (256x256)", n_warmup, n_iter, [&] {
+      int sum = 0;
+      for (int i = 0; i < n; i++) {
+        const cv::Mat a = frame_cur.mDescriptors.row(i);
+        for (int j = 0; j < n; j++) {
+          sum += ORBmatcher::DescriptorDistance(
+              a, frame_cur.mDescriptorsRight.row(j));
+        }
+      }
+      sink = sum;
+    });
+    (void)sink;
+  }
+
+  // Local map made of the stereo points of the reference keyframe
+  Map map;
+  KeyFrameDatabase keyframe_db(vocabulary);
+  KeyFrame *kf_ref = new KeyFrame(frame_ref, &map, &keyframe_db);
+  map.AddKeyFrame(kf_ref);
+  const vector<MapPoint *> local_map_points =
+      AddStereoMapPoints(kf_ref, frame_ref, &map);
+  cout << "Local map points: " << local_map_points.size() << endl;
+
+  // Local map search
+  {
+    LocalMapCuller culler;
+    culler.SetMapPoints(local_map_points);
+    ORBmatcher matcher(0.8);
+    RunBenchmark("LocalMapCuller::Cull",
+                 n_warmup,
+                 n_iter,
+                 [&] { culler.Cull(frame_cur, 0.5); });
+    RunBenchmark(
+        "SearchByProjection (local map)",
+        n_warmup,
+        n_iter,
+        [&] {
+          fill(frame_cur.mvpMapPoints.begin(),
+               frame_cur.mvpMapPoints.end(),
+               static_cast<MapPoint *>(NULL));
+          culler.Cull(frame_cur, 0.5);
+        },
+        [&] { matcher.SearchByProjection(frame_cur, culler, 3); });
+  }
+
+  // Motion-only BA, starting from a perturbed pose every time
+  {
+    cv::Mat Tcw_init = cv::Mat::eye(4, 4, CV_32F);
+    Tcw_init.at<float>(0, 3) = 0.05f;
+    Tcw_init.at<float>(2, 3) = -0.1f;
+    Frame frame_opt(frame_cur);
+    RunBenchmark(
+        "Optimizer::PoseOptimization",
+        n_warmup,
+        n_iter,
+        [&] {
+          frame_opt.SetPose(Tcw_init);
+          fill(frame_opt.mvbOutlier.begin(), frame_opt.mvbOutlier.end(), false);
+        },
+        [&] { Optimizer::PoseOptimization(&frame_opt); });
+  }
+
+  // Local BA over the two keyframes. Poses and positions are restored before
+  // every run.
+  {
+    KeyFrame *kf_cur = new KeyFrame(frame_cur, &map, &keyframe_db);
+    map.AddKeyFrame(kf_cur);
+    for (int i = 0; i < frame_cur.N; i++) {
+      MapPoint *pMP = frame_cur.mvpMapPoints[i];
+      if (!pMP) continue;
+      pMP->AddObservation(kf_cur, i);
+      kf_cur->AddMapPoint(pMP, i);
+    }
+    kf_ref->UpdateConnections();
+    kf_cur->UpdateConnections();
+
+    const cv::Mat Tcw_cur = kf_cur->GetPose();
+    vector<Eigen::Vector3f> positions(local_map_points.size());
+    for (size_t i = 0; i < local_map_points.size(); i++) {
+      positions[i] = local_map_points[i]->GetWorldPosEig();
+    }
+
+    bool stop_flag = false;
+    RunBenchmark(
+        "Optimizer::LocalBundleAdjustment",
+        min(n_warmup, 1),
+        max(1, n_iter / 5),
+        [&] {
+          kf_cur->SetPose(Tcw_cur);
+          for (size_t i = 0; i < local_map_points.size(); i++) {
+            local_map_points[i]->SetWorldPos(positions[i]);
+          }
+        },
+        [&] {
+          Optimizer::LocalBundleAdjustment(kf_cur, &stop_flag, &map, true);
+        });
+  }
+
+  // Map point fusion must give the same map with any number of threads
+  {
+    int n_fused_serial, n_fused_1, n_fused_4;
+    const vector<int> fused_serial = FuseDuplicateMapPoints(
+        frame_ref, frame_cur, vocabulary, NULL, &n_fused_serial);
+    ThreadPool thread_pool_1(1);
+    const vector<int> fused_1 = FuseDuplicateMapPoints(
+        frame_ref, frame_cur, vocabulary, &thread_pool_1, &n_fused_1);
+    ThreadPool thread_pool_4(4);
+    const vector<int> fused_4 = FuseDuplicateMapPoints(
+        frame_ref, frame_cur, vocabulary, &thread_pool_4, &n_fused_4);
+    cout << "ORBmatcher::Fuse, fused points with 1 and 4 threads: "
+         << n_fused_1 << " and " << n_fused_4 << endl;
+    CHECK_EQ(n_fused_1, n_fused_serial);
+    CHECK_EQ(n_fused_4, n_fused_serial);
+    CHECK(fused_1 == fused_serial);
+    CHECK(fused_4 == fused_serial);
+  }
+
+  // Vocabulary lookup of the descriptors of a frame
+  if (vocabulary_loaded) {
+    DBoW2::BowVector bow_vec;
+    DBoW2::FeatureVector feat_vec;
+    RunBenchmark("ORBVocabulary::transform", n_warmup, n_iter, [&] {
+      vocabulary.transform(frame_cur.mDescriptors, bow_vec, feat_vec, 4, 1);
+    });
+    RunBenchmark("ORBVocabulary::transform (4 thr)", n_warmup, n_iter, [&] {
+      vocabulary.transform(frame_cur.mDescriptors, bow_vec, feat_vec, 4, 4);
+    });
+  }
+
+  // Gaussian process used to build the training heatmaps
+  {
+    feature_evaluation::FeatureEvaluator evaluator(feature_evaluation::kORB,
+                                                   feature_evaluation::kKITTI);
+    vector<Eigen::Vector2f> locs(FLAGS_gp_num_points);
+    Eigen::VectorXf values(FLAGS_gp_num_points);
+    for (int i = 0; i < FLAGS_gp_num_points; i++) {
+      locs[i] = Eigen::Vector2f(rng.uniform(0.0f, float(kCols)),
+                                rng.uniform(0.0f, float(kRows)));
+      values(i) = rng.uniform(0.0f, 10.0f);
+    }
+
+    Eigen::MatrixXf K_mat;
+    RunBenchmark("FeatureEvaluator::Kmatrix", n_warmup, n_iter, [&] {
+      K_mat = evaluator.Kmatrix(locs);
+    });
+
+    // One prediction per cell of a 20 pixel grid
+    RunBenchmark("FeatureEvaluator::GPPredict (grid)", n_warmup, n_iter, [&] {
+      float mean, variance;
+      for (int y = 10; y < kRows; y += 20) {
+        for (int x = 10; x < kCols; x += 20) {
+          evaluator.GPPredict(x, y, locs, values, K_mat, mean, variance);
+        }
+      }
+    });
+  }
+
+  return 0;
+}
@@ -12,7 +12,9 @@ echo "Configuring and building Thirdparty/g2o ..."
 
 mkdir build
 cd build
-cmake .. -DCMAKE_BUILD_TYPE=Release
+# OpenMP is only used by the optimizers that ask for more than one thread
+# (the global BA), see SparseOptimizer::setNumThreads
+cmake .. -DCMAKE_BUILD_TYPE=Release -DG2O_USE_OPENMP=ON
 make -j
 
 cd ../../../
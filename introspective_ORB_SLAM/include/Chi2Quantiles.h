@@ -0,0 +1,52 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHI2QUANTILES_H
+#define CHI2QUANTILES_H
+
+#include<vector>
+
+namespace ORB_SLAM2
+{
+
+// Quantiles of the chi-square distribution at a fixed probability. They are
+// tabulated for 1 to nMaxDof degrees of freedom on construction, so that a
+// lookup does not run the iterative inverse gamma solve of boost. Larger
+// degrees of freedom are computed on demand.
+class Chi2QuantileTable
+{
+public:
+    Chi2QuantileTable(const double probability, const int nMaxDof = 512);
+
+    // Quantile for dof degrees of freedom. dof must be positive.
+    double operator()(const int dof) const;
+
+    double GetProbability() const { return mProbability; }
+
+private:
+    double mProbability;
+
+    // mvQuantiles[i] is the quantile for i+1 degrees of freedom
+    std::vector<double> mvQuantiles;
+};
+
+} //namespace ORB_SLAM
+
+#endif // CHI2QUANTILES_H
@@ -44,10 +44,14 @@ public:
     static cv::Mat toCvMat(const Eigen::Matrix3d &m);
     static cv::Mat toCvMat(const Eigen::Matrix<double,3,1> &m);
     static cv::Mat toCvSE3(const Eigen::Matrix<double,3,3> &R, const Eigen::Matrix<double,3,1> &t);
+    static cv::Mat toCvMat(const Eigen::Matrix<float,3,3> &m);
+    static cv::Mat toCvMat(const Eigen::Matrix<float,3,1> &m);
 
     static Eigen::Matrix<double,3,1> toVector3d(const cv::Mat &cvVector);
     static Eigen::Matrix<double,3,1> toVector3d(const cv::Point3f &cvPoint);
     static Eigen::Matrix<double,3,3> toMatrix3d(const cv::Mat &cvMat3);
+    static Eigen::Matrix<float,3,1> toVector3f(const cv::Mat &cvVector);
+    static Eigen::Matrix<float,3,3> toMatrix3f(const cv::Mat &cvMat3);
 
     static std::vector<float> toQuaternion(const cv::Mat &M);
 };
@@ -35,9 +35,12 @@
 #include "ORBVocabulary.h"
 #include "KeyFrame.h"
 #include "ORBextractor.h"
+#include "SessionContext.h"
 
 #include <opencv2/opencv.hpp>
 
+DECLARE_int32(bow_transform_num_threads);
+
 namespace ORB_SLAM2
 {
 #define FRAME_GRID_ROWS 48
@@ -67,6 +70,7 @@ public:
           ORBextractor* extractorLeft, 
           ORBextractor* extractorRight, 
           ORBVocabulary* voc, 
+          SessionContext* pContext,
           cv::Mat &K, 
           cv::Mat &distCoef, 
           const float &bf, 
@@ -77,8 +81,8 @@ public:
 
     // Constructor for RGB-D cameras.
     Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double 
-&timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat 
-&distCoef, const float &bf, const float &thDepth, 
+&timeStamp, ORBextractor* extractor,ORBVocabulary* voc, 
+SessionContext* pContext, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth, 
 const bool &bLogOutliers = false);
 
     // Constructor for Monocular cameras.
@@ -91,6 +95,7 @@ const bool &bLogOutliers = false);
     Frame(const cv::Mat &imGray, 
           const double &timeStamp, 
           ORBextractor* extractor,ORBVocabulary* voc, 
+          SessionContext* pContext,
           cv::Mat &K, 
           cv::Mat &distCoef, 
           const float &bf, 
@@ -149,9 +154,19 @@ const bool &bLogOutliers = false);
         return mRwc.clone();
     }
 
-    // Check if a MapPoint is in the frustum of the camera
-    // and fill variables of the MapPoint to be used by the tracking
-    bool isInFrustum(MapPoint* pMP, float viewingCosLimit);
+    // Fixed-size versions of the pose matrices, used in the per-point
+    // projection hot paths to avoid cv::Mat allocations
+    inline const Eigen::Vector3f& GetCameraCenterEig() const {
+        return mOwEig;
+    }
+
+    inline const Eigen::Matrix3f& GetRotationEig() const {
+        return mRcwEig;
+    }
+
+    inline const Eigen::Vector3f& GetTranslationEig() const {
+        return mtcwEig;
+    }
 
     // Compute the cell of a keypoint (return false if outside the grid)
     bool PosInGrid(const cv::KeyPoint &kp, int &posX, int &posY);
@@ -194,12 +209,12 @@ public:
 
     // Calibration matrix and OpenCV distortion parameters.
     cv::Mat mK;
-    static float fx;
-    static float fy;
-    static float cx;
-    static float cy;
-    static float invfx;
-    static float invfy;
+    float fx;
+    float fy;
+    float cx;
+    float cy;
+    float invfx;
+    float invfy;
     cv::Mat mDistCoef;
 
     // Stereo baseline multiplied by fx.
@@ -269,8 +284,8 @@ public:
     std::vector<bool> mvbOutlier;
 
     // Keypoints are assigned to cells in a grid to reduce matching complexity when projecting MapPoints.
-    static float mfGridElementWidthInv;
-    static float mfGridElementHeightInv;
+    float mfGridElementWidthInv;
+    float mfGridElementHeightInv;
     std::vector<std::size_t> mGrid[FRAME_GRID_COLS][FRAME_GRID_ROWS];
 
     // Camera pose.
@@ -298,8 +313,10 @@ public:
     
     std::string mstrLeftImgName;
 
-    // Current and Next Frame id.
-    static long unsigned int nNextId;
+    // State of the System the frame belongs to.
+    SessionContext* mpContext;
+
+    // Current Frame id.
     long unsigned int mnId;
 
     // Reference Keyframe.
@@ -314,13 +331,12 @@ public:
     vector<float> mvLevelSigma2;
     vector<float> mvInvLevelSigma2;
 
-    // Undistorted Image Bounds (computed once).
-    static float mnMinX;
-    static float mnMaxX;
-    static float mnMinY;
-    static float mnMaxY;
-
-    static bool mbInitialComputations;
+    // Undistorted Image Bounds (computed once per session, see
+    // SessionContext).
+    float mnMinX;
+    float mnMaxX;
+    float mnMinY;
+    float mnMaxY;
 
 
 private:
@@ -333,6 +349,10 @@ private:
     // Computes image bounds for the undistorted image (called in the constructor).
     void ComputeImageBounds(const cv::Mat &imLeft);
 
+    // Sets the calibration and image bounds of the frame. They are computed on the first frame
+    // of the session and copied from the session context afterwards (called in the constructor).
+    void SetCalibration(const cv::Mat &K, const cv::Mat &im);
+
     // Assign keypoints to the grid for speed up feature matching (called in the constructor).
     void AssignFeaturesToGrid();
 
@@ -341,6 +361,11 @@ private:
     cv::Mat mtcw;
     cv::Mat mRwc;
     cv::Mat mOw; //==mtwc
+
+    // Copies of the above, kept in sync by UpdatePoseMatrices()
+    Eigen::Matrix3f mRcwEig;
+    Eigen::Vector3f mtcwEig;
+    Eigen::Vector3f mOwEig;
 };
 
 }// namespace ORB_SLAM
@@ -77,6 +77,7 @@ protected:
     std::string mstrFrameName;
     std::string mstrSaveVisualizationPath;
     bool mbVisualizationPathSet = false;
+    bool mbOutputDirCreated = false;
 };
 
 } //namespace ORB_SLAM
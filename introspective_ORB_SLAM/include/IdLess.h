@@ -0,0 +1,43 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IDLESS_H
+#define IDLESS_H
+
+namespace ORB_SLAM2
+{
+
+// Orders KeyFrame and MapPoint pointers by their unique mnId instead of by
+// address. Containers keyed by these pointers then iterate in the same order
+// on every run, which keeps the optimizations and the datasets reproducible.
+// The id is assigned in the constructor and never changes, so the order is
+// stable for as long as the object lives.
+struct IdLess
+{
+    template<typename T>
+    bool operator()(const T* a, const T* b) const
+    {
+        return a->mnId < b->mnId;
+    }
+};
+
+} //namespace ORB_SLAM
+
+#endif // IDLESS_H
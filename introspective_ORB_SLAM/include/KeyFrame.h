@@ -22,6 +22,7 @@
 #define KEYFRAME_H
 
 #include "MapPoint.h"
+#include "IdLess.h"
 #include "Thirdparty/DBoW2/DBoW2/BowVector.h"
 #include "Thirdparty/DBoW2/DBoW2/FeatureVector.h"
 #include "ORBVocabulary.h"
@@ -56,6 +57,11 @@ public:
     cv::Mat GetRotation();
     cv::Mat GetTranslation();
 
+    // Fixed-size versions of the pose getters for the per-point hot paths
+    Eigen::Vector3f GetCameraCenterEig();
+    Eigen::Matrix3f GetRotationEig();
+    Eigen::Vector3f GetTranslationEig();
+
     // Bag of Words Representation
     void ComputeBoW();
 
@@ -64,23 +70,27 @@ public:
     void EraseConnection(KeyFrame* pKF);
     void UpdateConnections();
     void UpdateBestCovisibles();
-    std::set<KeyFrame *> GetConnectedKeyFrames();
+    std::set<KeyFrame*,IdLess> GetConnectedKeyFrames();
     std::vector<KeyFrame* > GetVectorCovisibleKeyFrames();
     std::vector<KeyFrame*> GetBestCovisibilityKeyFrames(const int &N);
     std::vector<KeyFrame*> GetCovisiblesByWeight(const int &w);
     int GetWeight(KeyFrame* pKF);
 
+    // Covisibility counters. They are kept up to date by the MapPoint observation
+    // functions, so UpdateConnections() does not have to recount the observations.
+    void ChangeCovisibility(KeyFrame* pKF, const int &n);
+
     // Spanning tree functions
     void AddChild(KeyFrame* pKF);
     void EraseChild(KeyFrame* pKF);
     void ChangeParent(KeyFrame* pKF);
-    std::set<KeyFrame*> GetChilds();
+    std::set<KeyFrame*,IdLess> GetChilds();
     KeyFrame* GetParent();
     bool hasChild(KeyFrame* pKF);
 
     // Loop Edges
     void AddLoopEdge(KeyFrame* pKF);
-    std::set<KeyFrame*> GetLoopEdges();
+    std::set<KeyFrame*,IdLess> GetLoopEdges();
 
     // MapPoint observation functions
     void AddMapPoint(MapPoint* pMP, const size_t &idx);
@@ -122,7 +132,9 @@ public:
     // The following variables are accesed from only 1 thread or never change (no mutex needed).
 public:
 
-    static long unsigned int nNextId;
+    // State of the System the keyframe belongs to.
+    SessionContext* const mpContext;
+
     // ID of the keyframe (this is an identification among all KeyFrames)
     long unsigned int mnId;
     // ID of the corresponding Frame (this is and identificaiton among all
@@ -226,6 +238,11 @@ protected:
 
     cv::Mat Cw; // Stereo middel point. Only for visualization
 
+    // Copies of the pose, kept in sync by SetPose()
+    Eigen::Matrix3f mRcwEig;
+    Eigen::Vector3f mtcwEig;
+    Eigen::Vector3f mOwEig;
+
     // MapPoints associated to keypoints
     std::vector<MapPoint*> mvpMapPoints;
 
@@ -236,15 +253,16 @@ protected:
     // Grid over the image to speed up feature matching
     std::vector< std::vector <std::vector<size_t> > > mGrid;
 
-    std::map<KeyFrame*,int> mConnectedKeyFrameWeights;
+    // Sorted by keyframe pointer
+    std::vector<std::pair<KeyFrame*,int> > mvConnectedKeyFrameWeights;
     std::vector<KeyFrame*> mvpOrderedConnectedKeyFrames;
     std::vector<int> mvOrderedWeights;
 
     // Spanning Tree and Loop Edges
     bool mbFirstConnection;
     KeyFrame* mpParent;
-    std::set<KeyFrame*> mspChildrens;
-    std::set<KeyFrame*> mspLoopEdges;
+    std::set<KeyFrame*,IdLess> mspChildrens;
+    std::set<KeyFrame*,IdLess> mspLoopEdges;
 
     // Bad flags
     bool mbNotErase;
@@ -258,6 +276,11 @@ protected:
     std::mutex mMutexPose;
     std::mutex mMutexConnections;
     std::mutex mMutexFeatures;
+
+    // Number of MapPoints shared with each other keyframe, sorted by keyframe
+    // pointer. Only keyframes with a positive count are stored.
+    std::vector<std::pair<KeyFrame*,int> > mvCovisibilityCounts;
+    std::mutex mMutexCovisibility;
 };
 
 } //namespace ORB_SLAM
@@ -0,0 +1,80 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LOCALMAPCULLER_H
+#define LOCALMAPCULLER_H
+
+#include <vector>
+#include <Eigen/Core>
+
+namespace ORB_SLAM2
+{
+
+class MapPoint;
+class Frame;
+
+// Frustum culling of the local map against the current frame. The geometry of
+// the local map points is gathered once into structure of arrays buffers so
+// that all the visibility tests (depth, image bounds, scale invariance region
+// and viewing angle) are evaluated as vectorized Eigen array expressions. The
+// output is a compact list of the visible points with their projections.
+class LocalMapCuller
+{
+public:
+    typedef Eigen::Array<float,Eigen::Dynamic,1> ArrayXf;
+
+    // Takes a snapshot of the position, normal and distance bounds of the points
+    void SetMapPoints(const std::vector<MapPoint*> &vpMapPoints);
+
+    // Tests every point against the frame. Points already seen in the frame
+    // (mnLastFrameSeen) and points flagged as bad are skipped. Returns the
+    // number of visible points.
+    int Cull(const Frame &F, const float viewingCosLimit);
+
+    size_t NumVisible() const { return mvpVisible.size(); }
+
+    // Visible points and their projection in the frame
+    std::vector<MapPoint*> mvpVisible;
+    std::vector<float> mvVisibleU;
+    std::vector<float> mvVisibleV;
+    std::vector<float> mvVisibleUR;
+    std::vector<float> mvVisibleViewCos;
+    std::vector<int> mvVisibleLevel;
+
+protected:
+    std::vector<MapPoint*> mvpMapPoints;
+
+    // Local map point geometry. The distance bounds already include the
+    // scale invariance margins, mMaxDistance is used to predict the scale.
+    ArrayXf mX, mY, mZ;
+    ArrayXf mNx, mNy, mNz;
+    ArrayXf mMinDistanceInv, mMaxDistanceInv, mMaxDistance;
+
+    // Per frame buffers, kept to avoid reallocations
+    ArrayXf mPcX, mPcY, mPcZ, mInvZ;
+    ArrayXf mPOx, mPOy, mPOz, mDist;
+    ArrayXf mU, mV, mViewCos, mLogRatio;
+    Eigen::Array<bool,Eigen::Dynamic,1> mbInView;
+};
+
+} //namespace ORB_SLAM
+
+#endif // LOCALMAPCULLER_H
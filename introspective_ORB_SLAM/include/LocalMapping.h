@@ -26,10 +26,10 @@
 #include "LoopClosing.h"
 #include "Tracking.h"
 #include "KeyFrameDatabase.h"
+#include "ThreadPool.h"
 
 #include <mutex>
 
-
 namespace ORB_SLAM2
 {
 
@@ -41,6 +41,7 @@ class LocalMapping
 {
 public:
     LocalMapping(Map* pMap, const float bMonocular);
+    ~LocalMapping();
 
     void SetLoopCloser(LoopClosing* pLoopCloser);
 
@@ -83,6 +84,18 @@ protected:
     void ProcessNewKeyFrame();
     void CreateNewMapPoints();
 
+    // A point triangulated from a match between the current keyframe and a neighbor
+    struct TriangulatedMatch
+    {
+        size_t idx1;
+        size_t idx2;
+        Eigen::Vector3f x3D;
+    };
+
+    // Matches the current keyframe with pKF2 and triangulates the matches that pass all checks.
+    // Does not modify the map, so it can run concurrently for several neighbors.
+    void TriangulateWithNeighbor(KeyFrame* pKF2, std::vector<TriangulatedMatch> &vTriangulated);
+
     void MapPointCulling();
     void SearchInNeighbors();
 
@@ -126,6 +139,9 @@ protected:
 
     bool mbAcceptKeyFrames;
     std::mutex mMutexAccept;
+
+    // Workers for the per-neighbor triangulation and fusion searches
+    ThreadPool* mpThreadPool;
 };
 
 } //namespace ORB_SLAM
@@ -21,6 +21,7 @@
 #ifndef LOOPCLOSING_H
 #define LOOPCLOSING_H
 
+#include "IdLess.h"
 #include "KeyFrame.h"
 #include "LocalMapping.h"
 #include "Map.h"
@@ -45,8 +46,8 @@ class LoopClosing
 {
 public:
 
-    typedef pair<set<KeyFrame*>,int> ConsistentGroup;    
-    typedef map<KeyFrame*,g2o::Sim3,std::less<KeyFrame*>,
+    typedef pair<set<KeyFrame*,IdLess>,int> ConsistentGroup;    
+    typedef map<KeyFrame*,g2o::Sim3,IdLess,
         Eigen::aligned_allocator<std::pair<const KeyFrame*, g2o::Sim3> > > KeyFrameAndPose;
 
 public:
@@ -60,6 +61,15 @@ public:
     // Main function
     void Run();
 
+    // Runs the loop closer inside the caller's thread instead of its own. The
+    // local mapper is not stopped around the loop correction and the global
+    // BA is run synchronously, so the result only depends on the input.
+    void SetInlineMode(const bool bInline);
+
+    // Processes all the queued keyframes. Only used in inline mode, where it
+    // must be called by the tracking thread once it has released the map.
+    void LoopOnce();
+
     void InsertKeyFrame(KeyFrame *pKF);
 
     void RequestReset();
@@ -94,6 +104,11 @@ protected:
 
     void CorrectLoop();
 
+    // Applies the result of the global BA to the keyframes and propagates it
+    // to the map points. The map points are corrected in chunks, each in its
+    // own critical section.
+    void UpdateMapAfterGBA(const unsigned long nLoopKF);
+
     void ResetIfRequested();
     bool mbResetRequested;
     std::mutex mMutexReset;
@@ -144,6 +159,8 @@ protected:
 
 
     bool mnFullBAIdx;
+
+    bool mbInline;
 };
 
 } //namespace ORB_SLAM
@@ -24,8 +24,10 @@
 #include "MapPoint.h"
 #include "KeyFrame.h"
 #include <set>
+#include <unordered_set>
 
 #include <mutex>
+#include <atomic>
 
 
 
@@ -48,6 +50,7 @@ public:
     void InformNewBigChange();
     int GetLastBigChangeIdx();
 
+    // Both are returned in ascending id order
     std::vector<KeyFrame*> GetAllKeyFrames();
     std::vector<MapPoint*> GetAllMapPoints();
     std::vector<MapPoint*> GetReferenceMapPoints();
@@ -57,6 +60,14 @@ public:
 
     long unsigned int GetMaxKFid();
 
+    // Log of the MapPoints that were added, moved or erased since the last call to
+    // TakeMapPointChanges(). It is only recorded after EnableMapPointChangeLog() and
+    // lets the headless MapRenderer update its buffers incrementally. bCleared is set
+    // if the map was cleared in the meantime.
+    void EnableMapPointChangeLog();
+    void InformMapPointChanged(MapPoint* pMP);
+    std::vector<MapPoint*> TakeMapPointChanges(bool &bCleared);
+
     void clear();
 
     vector<KeyFrame*> mvpKeyFrameOrigins;
@@ -81,6 +92,12 @@ protected:
     // Index related to a big change in the map (loop closure, global BA)
     int mnBigChangeIdx;
 
+    // Read without mMutexMap by InformMapPointChanged, which is called on
+    // every map point position update
+    std::atomic<bool> mbLogMapPointChanges;
+    bool mbClearedSinceLastTake;
+    std::unordered_set<MapPoint*> msChangedMapPoints;
+
     std::mutex mMutexMap;
 };
 
@@ -61,6 +61,12 @@ public:
     cv::Mat CalculateRelativeTransform(const cv::Mat& dest_frame_pose,
                                        const cv::Mat& src_frame_pose);
     cv::Mat CalculateInverseTransform(const cv::Mat& transform);
+
+    // Copies the current camera pose (Tcw), the ground truth pose (Twc_gt,
+    // left empty if not available) and the current frame name. Used by
+    // consumers that render outside of the Pangolin loop.
+    void GetCurrentCameraState(cv::Mat &Tcw, cv::Mat &Twc_gt,
+                               std::string &strFrameName);
     
     std::string mstrFrameName;
 
@@ -24,10 +24,14 @@
 #include"KeyFrame.h"
 #include"Frame.h"
 #include"Map.h"
+#include"IdLess.h"
 #include <gflags/gflags.h>
 
 #include<opencv2/core/core.hpp>
+#include<Eigen/Core>
+#include<atomic>
 #include<mutex>
+#include<stdint.h>
 
 DECLARE_bool(ivslam_propagate_keyptqual);
 
@@ -46,12 +50,15 @@ public:
     MapPoint(const cv::Mat &Pos,  Map* pMap, Frame* pFrame, const int &idxF);
 
     void SetWorldPos(const cv::Mat &Pos);
+    void SetWorldPos(const Eigen::Vector3f &Pos);
     cv::Mat GetWorldPos();
+    Eigen::Vector3f GetWorldPosEig();
 
     cv::Mat GetNormal();
+    Eigen::Vector3f GetNormalEig();
     KeyFrame* GetReferenceKeyFrame();
 
-    std::map<KeyFrame*,size_t> GetObservations();
+    std::map<KeyFrame*,size_t,IdLess> GetObservations();
     int Observations();
 
     void AddObservation(KeyFrame* pKF,size_t idx);
@@ -87,20 +94,48 @@ public:
     float GetQualityScore();
     void SetQualityScore(float score);
 
+    // Stores the squared norm of the normalized reprojection error of the
+    // observation in pKF after a bundle adjustment, and the degrees of freedom
+    // of its chi2 distribution. Ignored if pKF does not observe the point.
+    void SetObservationChi2(KeyFrame* pKF, const float chi2, const int dof);
+    // Sums of the stored errors and of their degrees of freedom over the
+    // current observations
+    void GetChi2Sum(double &chi2, int &dof);
+
+    // State of the point that the tracking reads for every local map point and
+    // frame. The functions that modify it publish a new version while holding
+    // the point mutexes, and the tracking copies it without taking any mutex.
+    struct TrackingState
+    {
+        Eigen::Vector3f mWorldPos;
+        Eigen::Vector3f mNormalVector;
+        float mfMinDistance;
+        float mfMaxDistance;
+        int nObs;
+        bool mbBad;
+        // False until the descriptor has been computed
+        bool mbHasDescriptor;
+        unsigned char mDescriptor[32];
+
+        float GetMinDistanceInvariance() const { return 0.8f*mfMinDistance; }
+        float GetMaxDistanceInvariance() const { return 1.2f*mfMaxDistance; }
+    };
+
+    // Lock free copy of the last published state (seqlock read)
+    void GetTrackingState(TrackingState &state) const;
+    // Lock free read of the published bad flag
+    bool isBadLockFree() const;
+
+    // Appends the keyframes observing the point, without copying the observations
+    void GetObservingKeyFrames(std::vector<KeyFrame*> &vpKFs);
+
 public:
     long unsigned int mnId;
-    static long unsigned int nNextId;
     long int mnFirstKFid;
     long int mnFirstFrame;
     int nObs;
 
     // Variables used by the tracking
-    float mTrackProjX;
-    float mTrackProjY;
-    float mTrackProjXR;
-    bool mbTrackInView;
-    int mnTrackScaleLevel;
-    float mTrackViewCos;
     long unsigned int mnTrackReferenceForFrame;
     long unsigned int mnLastFrameSeen;
 
@@ -115,40 +150,20 @@ public:
     cv::Mat mPosGBA;
     long unsigned int mnBAGlobalForKF;
 
-
-    static std::mutex mGlobalMutex;
     
     // True if quality score has been set
     bool mbQualityScoreCalculated = false;
-    
-    // The number of degrees of freedom for the chi2 distribution of the squared l2 norm 
-    // of the normalized reprojection error for each of the keyframes this map point has 
-    // been observed from
-    std::unordered_map<KeyFrame*, int> mlnChi2Dof;
-
-    // The squared l2 norm of the normalized reprojection error for each of the keyframes
-    // this map point has been observed from
-    std::unordered_map<KeyFrame*, double> mldChi2;
-    
-    // The number of keyframes from which, this map has been observed. Each
-    // item in the vector corresponds to the number of observations at a 
-    // specific optimization round.
-    std::vector<int> mvObsNum;
-    
-    // The changes in the 3D location of the map point as a result of each
-    // optimization round
-    std::vector<double> mvDeltaPos;
 
 protected:    
 
      // Position in absolute coordinates
-     cv::Mat mWorldPos;
+     Eigen::Vector3f mWorldPos;
 
      // Keyframes observing the point and associated index in keyframe
-     std::map<KeyFrame*,size_t> mObservations;
+     std::map<KeyFrame*,size_t,IdLess> mObservations;
 
      // Mean viewing direction
-     cv::Mat mNormalVector;
+     Eigen::Vector3f mNormalVector;
 
      // Best descriptor to fast matching
      cv::Mat mDescriptor;
@@ -170,10 +185,41 @@ protected:
 
      Map* mpMap;
 
+     // State of the System the map point belongs to
+     SessionContext* const mpContext;
+
      std::mutex mMutexPos;
      std::mutex mMutexFeatures;
      
      float mfQualityScore = 0.0;
+
+     // Reprojection error of an observation after the last bundle adjustment
+     // it was part of
+     struct ObservationChi2
+     {
+         KeyFrame* pKF;
+         float chi2;
+         int dof;
+     };
+
+     // One entry per observation that has been through a bundle adjustment.
+     // Entries are removed with their observation. Protected by
+     // mMutexFeatures.
+     std::vector<ObservationChi2> mvObservationChi2;
+
+     // Publishes the current state for GetTrackingState(). It takes
+     // mMutexFeatures and mMutexPos, which also serializes the writers.
+     void PublishTrackingState();
+
+     // Sequence number, odd while a new state is being written, and the
+     // state packed in words so that readers never see a torn value
+     static const int TRACKING_STATE_WORDS = 18;
+     std::atomic<unsigned int> mnTrackingStateSeq;
+     std::atomic<uint32_t> mvTrackingStateWords[TRACKING_STATE_WORDS];
+
+     // Removes the contribution of the point to the covisibility counters of
+     // the observing keyframes. Called with mMutexFeatures locked.
+     void EraseCovisibility(const std::map<KeyFrame*,size_t,IdLess> &observations);
 };
 
 } //namespace ORB_SLAM
@@ -0,0 +1,174 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MAPRENDERER_H
+#define MAPRENDERER_H
+
+#include "Map.h"
+#include "MapPoint.h"
+#include "KeyFrame.h"
+#include "MapDrawer.h"
+
+#include <Eigen/Core>
+#include <opencv2/core/core.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+DECLARE_bool(map_renderer_enabled);
+
+namespace ORB_SLAM2
+{
+
+class Tracking;
+
+// Offscreen replacement of the Pangolin map view for headless runs. It keeps a
+// CPU copy of the map point positions that is updated incrementally from the
+// change log of the Map, rasterizes the map, the keyframes and the estimated
+// and reference trajectories into an image with a follow camera, and hands the
+// images to a writer thread so that disk I/O does not stall the rendering.
+class MapRenderer
+{
+public:
+    MapRenderer(Map* pMap, MapDrawer* pMapDrawer, Tracking *pTracking, const string &strSettingPath);
+    ~MapRenderer();
+
+    // Main thread function. Renders every FLAGS_map_renderer_rate-th new frame
+    // published to the MapDrawer and queues the image to be saved.
+    void Run();
+
+    void RequestFinish();
+
+    void RequestStop();
+
+    bool isFinished();
+
+    bool isStopped();
+
+    void Release();
+
+protected:
+
+    bool Stop();
+    bool CheckFinish();
+    void SetFinish();
+
+    // Applies the map point changes logged by the Map to the vertex buffer
+    void UpdateVertexBuffer();
+
+    cv::Mat Render(const cv::Mat &Tcw, const cv::Mat &Twc_gt);
+
+    // Where and how a slot of the vertex buffer is drawn in a view
+    struct PointFootprint
+    {
+        bool bVisible;
+        int u0, v0;
+        float z;
+        cv::Vec3b color;
+    };
+
+    // Draws the map points into mPointLayer. The whole layer is redrawn when the view changes.
+    // Otherwise only the tiles covered by slots that changed since the last render are redrawn.
+    void RenderMapPoints(const Eigen::Matrix3f &Rvw, const Eigen::Vector3f &tvw);
+    void ComputeFootprint(size_t slot, const Eigen::Matrix3f &Rvw, const Eigen::Vector3f &tvw, PointFootprint &fp);
+    cv::Vec3b PointColor(MapPoint* pMP);
+    void MarkDirtyTiles(const PointFootprint &fp);
+    void RasterizePoint(const PointFootprint &fp, const cv::Rect &roi);
+
+    // Transformation from the world to the virtual viewpoint that follows the
+    // current camera, same as the Pangolin follow mode of the Viewer.
+    void ComputeViewTransform(const cv::Mat &Tcw, Eigen::Matrix3f &Rvw, Eigen::Vector3f &tvw);
+
+    bool Project(const Eigen::Vector3f &Pv, cv::Point2f &uv);
+    void DrawSegment(cv::Mat &im, const Eigen::Vector3f &P1v, const Eigen::Vector3f &P2v,
+                     const cv::Scalar &color, int thickness);
+    void DrawCamera(cv::Mat &im, const Eigen::Matrix3f &Rvw, const Eigen::Vector3f &tvw,
+                    const cv::Mat &Twc, float size, const cv::Scalar &color, int thickness);
+
+    // Writer thread
+    void WriterLoop();
+    void EnqueueImage(const std::string &strPath, const cv::Mat &im);
+
+    Map* mpMap;
+    MapDrawer* mpMapDrawer;
+
+    // 1/fps in ms
+    double mT;
+
+    int mnWidth, mnHeight;
+    float mViewpointX, mViewpointY, mViewpointZ, mViewpointF;
+    float mKeyFrameSize;
+    float mCameraSize;
+    int mnPointSize;
+
+    std::string mstrOutputPath;
+
+    // Vertex buffer. Slots of erased points are recycled.
+    std::unordered_map<MapPoint*,size_t> mmSlotOfMapPoint;
+    std::vector<MapPoint*> mvpSlotMapPoints;
+    std::vector<Eigen::Vector3f> mvSlotPositions;
+    std::vector<size_t> mvFreeSlots;
+    // Slots whose position was updated since the last render
+    std::vector<bool> mvbSlotDirty;
+
+    // Map points rendered in the last view, with their depth buffer and footprints
+    cv::Mat mPointLayer;
+    cv::Mat mDepth;
+    std::vector<PointFootprint> mvSlotFootprints;
+    bool mbPointLayerValid;
+    Eigen::Matrix3f mRvwPointLayer;
+    Eigen::Vector3f mtvwPointLayer;
+    // Tiles of the point layer to redraw
+    int mnTilesX, mnTilesY;
+    std::vector<bool> mvbDirtyTiles;
+
+    // Trajectories of the current camera and of its reference pose. The reference
+    // trajectory is aligned to the estimated one at its first pose.
+    std::vector<Eigen::Vector3f> mvTrajectory;
+    std::vector<Eigen::Vector3f> mvTrajectoryGT;
+    cv::Mat mTalign;
+
+    std::string mstrLastFrameName;
+    unsigned long mnFramesSeen;
+
+    bool mbFinishRequested;
+    bool mbFinished;
+    std::mutex mMutexFinish;
+
+    bool mbStopped;
+    bool mbStopRequested;
+    std::mutex mMutexStop;
+
+    // Bounded queue of images waiting to be written to disk
+    std::thread* mptWriter;
+    std::deque<std::pair<std::string,cv::Mat> > mqImagesToWrite;
+    bool mbWriterFinish;
+    std::mutex mMutexWriter;
+    std::condition_variable mcvWriter;
+};
+
+} //namespace ORB_SLAM
+
+#endif // MAPRENDERER_H
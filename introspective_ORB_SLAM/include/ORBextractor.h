@@ -55,7 +55,8 @@ public:
     enum {HARRIS_SCORE=0, FAST_SCORE=1 };
 
     ORBextractor(int nfeatures, float scaleFactor, int nlevels,
-                 int iniThFAST, int minThFAST, bool enableIntrospection =false);
+                 int iniThFAST, int minThFAST, bool enableIntrospection =false,
+                 float costGateThreshold =255.0f);
 
     ~ORBextractor(){}
 
@@ -88,9 +89,23 @@ public:
         return mvInvLevelSigma2;
     }
 
+    // If set, descriptors are computed with the BRIEF pattern pre-rotated to
+    // the closest of 30 quantized angles (12 degree steps) instead of the
+    // exact keypoint angle. Faster, but the descriptors are not identical.
+    void SetQuantizedAngles(const bool bQuantized);
+
+    // Detects the keypoints of image and recomputes their angles and exact
+    // angle descriptors with the scalar reference kernels. Counts the
+    // keypoints where the optimized kernels give a different result.
+    void CheckKernels(cv::InputArray image, int &nKeyPoints,
+                      int &nAngleMismatches, int &nDescriptorMismatches);
+
     std::vector<cv::Mat> mvImagePyramid;
     std::vector<cv::Mat> mvQualityImagePyramid;
 
+    // Gaussian blurred pyramid levels the descriptors are computed on
+    std::vector<cv::Mat> mvBlurredPyramid;
+
 protected:
 
     void ComputePyramid(cv::Mat image);
@@ -104,6 +119,14 @@ protected:
     void ComputeKeyPointsOld(std::vector<std::vector<cv::KeyPoint> >& allKeypoints);
     std::vector<cv::Point> pattern;
 
+    // Pattern coordinates as floats for rotating them with SIMD
+    std::vector<float> mvPatternX;
+    std::vector<float> mvPatternY;
+
+    // Pattern rotated by each quantized angle. Empty unless SetQuantizedAngles
+    // enabled it.
+    std::vector<std::vector<cv::Point> > mvRotatedPatterns;
+
     int nfeatures;
     double scaleFactor;
     int nlevels;
@@ -115,8 +138,19 @@ protected:
     bool benableIntrospection = false;
     bool bqualityScoresAvailable = false;
 
+    // Grid cells with a mean predicted cost (0-255) above this threshold are
+    // skipped before running FAST and their feature budget is given to the
+    // other cells. 255 disables the gating.
+    float mfCostGateThreshold = 255.0f;
+
     std::vector<int> mnFeaturesPerLevel;
 
+    // Images with a border of EDGE_THRESHOLD pixels that back the pyramid
+    // levels. They are allocated for the first image and reused as long as
+    // the image size does not change.
+    std::vector<cv::Mat> mvImagePyramidBuffers;
+    std::vector<cv::Mat> mvQualityPyramidBuffers;
+
     std::vector<int> umax;
 
     std::vector<float> mvScaleFactor;
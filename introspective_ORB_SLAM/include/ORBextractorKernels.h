@@ -0,0 +1,50 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ORBEXTRACTORKERNELS_H
+#define ORBEXTRACTORKERNELS_H
+
+#include <opencv2/core/core.hpp>
+
+namespace ORB_SLAM2
+{
+
+const float factorPI = (float)(CV_PI/180.f);
+
+// Number of points in the BRIEF pattern (two per test)
+const int PATTERN_POINTS = 512;
+
+// Offsets from the keypoint pixel of the pattern points rotated by angle
+// (degrees). The rounding is the same as in computeOrbDescriptorReference,
+// four points at a time with SSE2. This only holds without FMA contraction,
+// which rounds x*b + y*a once instead of twice, so ORBextractorKernels.cc is
+// compiled with -ffp-contract=off.
+void computeRotatedOffsets(const float* patternX, const float* patternY,
+                           float angle, int step, int* offsets);
+
+// Descriptor computed by rotating each pattern point by the keypoint angle.
+// This is the reference for computeRotatedOffsets and computeOrbDescriptor.
+void computeOrbDescriptorReference(const cv::KeyPoint& kpt,
+                                   const cv::Mat& img, const cv::Point* pattern,
+                                   uchar* desc);
+
+} //namespace ORB_SLAM
+
+#endif // ORBEXTRACTORKERNELS_H
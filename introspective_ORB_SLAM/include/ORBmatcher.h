@@ -29,6 +29,8 @@
 #include"MapPoint.h"
 #include"KeyFrame.h"
 #include"Frame.h"
+#include"LocalMapCuller.h"
+#include"ThreadPool.h"
 
 
 namespace ORB_SLAM2
@@ -43,9 +45,13 @@ public:
     // Computes the Hamming distance between two ORB descriptors
     static int DescriptorDistance(const cv::Mat &a, const cv::Mat &b);
 
-    // Search matches between Frame keypoints and projected MapPoints. Returns number of matches
+    // Search matches between Frame keypoints and the MapPoints that LocalMapCuller found visible,
+    // at the projections it computed. Returns number of matches
     // Used to track the local map (Tracking)
-    int SearchByProjection(Frame &F, const std::vector<MapPoint*> &vpMapPoints, const float th=3);
+    // The points are matched in parallel if a thread pool is given. When several points
+    // choose the same keypoint, the one with the smallest descriptor distance keeps it
+    // (the first one in the list on ties), so the result does not depend on the threads.
+    int SearchByProjection(Frame &F, const LocalMapCuller &culler, const float th=3, ThreadPool* pThreadPool=NULL);
 
     // Project MapPoints tracked in last frame into the current frame and search matches.
     // Used to track from previous frame (Tracking)
@@ -77,7 +83,33 @@ public:
     int SearchBySim3(KeyFrame* pKF1, KeyFrame* pKF2, std::vector<MapPoint *> &vpMatches12, const float &s12, const cv::Mat &R12, const cv::Mat &t12, const float th);
 
     // Project MapPoints into KeyFrame and search for duplicated MapPoints.
-    int Fuse(KeyFrame* pKF, const vector<MapPoint *> &vpMapPoints, const float th=3.0);
+    // The points are searched in parallel if a thread pool is given, in chunks of a fixed size,
+    // and fused in the order of the list, so the result does not depend on the threads.
+    int Fuse(KeyFrame* pKF, const vector<MapPoint *> &vpMapPoints, const float th=3.0, ThreadPool* pThreadPool=NULL);
+
+    // A MapPoint projected into a KeyFrame by SearchForFusion and the keypoint it matched (-1 if
+    // none). The descriptor is the one of the MapPoint when it was searched.
+    struct FusionCandidate
+    {
+        MapPoint* pMP;
+        float u;
+        float v;
+        float ur;
+        int nPredictedLevel;
+        float radius;
+        cv::Mat descriptor;
+        int bestIdx;
+    };
+
+    // The two stages of Fuse(). SearchForFusion only reads the map and can run concurrently for
+    // different keyframes or chunks of points. ApplyFusion modifies the map and must be called
+    // from a single thread, with the candidates in the order of the points. Each candidate is
+    // checked against the current map, and matched again if an earlier fusion has changed the
+    // descriptor of its MapPoint, so the result is the same as searching and fusing one point
+    // after the other.
+    int SearchForFusion(KeyFrame* pKF, const vector<MapPoint *> &vpMapPoints,
+                        vector<FusionCandidate> &vCandidates, const float th=3.0);
+    int ApplyFusion(KeyFrame* pKF, const vector<FusionCandidate> &vCandidates);
 
     // Project MapPoints into KeyFrame using a given Sim3 and search for duplicated MapPoints.
     int Fuse(KeyFrame* pKF, cv::Mat Scw, const std::vector<MapPoint*> &vpPoints, float th, vector<MapPoint *> &vpReplacePoint);
@@ -101,6 +133,10 @@ protected:
 
     float RadiusByViewingCos(const float &viewCos);
 
+    // Returns the keypoint of pKF around the projection of the candidate with the closest
+    // descriptor to dMP, or -1 if none is within TH_LOW
+    int MatchFusionCandidate(KeyFrame* pKF, const FusionCandidate &candidate, const cv::Mat &dMP);
+
     void ComputeThreeMaxima(std::vector<int>* histo, const int L, int &ind1, int &ind2, int &ind3);
 
     float mfNNratio;
@@ -37,11 +37,15 @@ class LoopClosing;
 class Optimizer
 {
 public:
+    // nThreads is the number of threads used to linearize the problem. If
+    // *pbStopFlag is set, the optimization is aborted and the map is not
+    // changed.
     void static BundleAdjustment(const std::vector<KeyFrame*> &vpKF, const std::vector<MapPoint*> &vpMP,
                                  int nIterations = 5, bool *pbStopFlag=NULL, const unsigned long nLoopKF=0,
-                                 const bool bRobust = true);
+                                 const bool bRobust = true, const int nThreads = 1);
     void static GlobalBundleAdjustemnt(Map* pMap, int nIterations=5, bool *pbStopFlag=NULL,
-                                       const unsigned long nLoopKF=0, const bool bRobust = true);
+                                       const unsigned long nLoopKF=0, const bool bRobust = true,
+                                       const int nThreads = 1);
     void static LocalBundleAdjustment(KeyFrame* pKF, 
                                       bool *pbStopFlag, 
                                       Map *pMap,
@@ -70,7 +74,7 @@ public:
     void static OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
-                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections,
+                                       const map<KeyFrame *, set<KeyFrame *, IdLess>, IdLess> &LoopConnections,
                                        const bool &bFixScale);
 
     // if bFixScale is true, optimize SE3 (stereo,rgbd), Sim3 otherwise (mono)
@@ -0,0 +1,65 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SESSIONCONTEXT_H
+#define SESSIONCONTEXT_H
+
+#include<mutex>
+
+namespace ORB_SLAM2
+{
+
+// State shared by all the frames, keyframes and map points of one System.
+// It used to be kept in static members, which made two Systems in the same
+// process overwrite each other and contend for one mutex. Each System now
+// owns one context and hands it to every Frame it creates; keyframes and map
+// points reach it through the frame or keyframe they are created from.
+class SessionContext
+{
+public:
+    SessionContext():
+        mnNextFrameId(0), mnNextKeyFrameId(0), mnNextMapPointId(0),
+        mbInitialComputations(true)
+    {}
+
+    // Next Frame, KeyFrame and MapPoint id. Ids start at 0 in every session.
+    // Frames and keyframes are only created by the tracking thread. Map points
+    // are also created by local mapping and take their id under
+    // Map::mMutexPointCreation.
+    long unsigned int mnNextFrameId;
+    long unsigned int mnNextKeyFrameId;
+    long unsigned int mnNextMapPointId;
+
+    // Calibration and undistorted image bounds. They are computed from the
+    // first Frame (or after a change in the calibration) and copied into
+    // every following Frame.
+    bool mbInitialComputations;
+    float fx, fy, cx, cy, invfx, invfy;
+    float mnMinX, mnMaxX, mnMinY, mnMaxY;
+    float mfGridElementWidthInv, mfGridElementHeightInv;
+
+    // Taken by MapPoint::SetWorldPos and by readers that need all the map
+    // point positions to stay fixed for a while (e.g. pose optimization).
+    std::mutex mMutexPointPos;
+};
+
+} //namespace ORB_SLAM
+
+#endif // SESSIONCONTEXT_H
@@ -0,0 +1,70 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef STEREOMATCHER_H
+#define STEREOMATCHER_H
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+#include "ThreadPool.h"
+
+namespace ORB_SLAM2
+{
+
+class Frame;
+
+// Stereo matching of the keypoints of a rectified stereo frame. Matches
+// are searched along the epipolar row by descriptor distance and refined by
+// an 11x11 SAD sliding window with parabola fitting. The row table is kept
+// between frames and the left keypoints are matched in parallel.
+class StereoMatcher
+{
+public:
+    StereoMatcher(int nThreads);
+
+    // Fills F.mvuRight and F.mvDepth. The results do not depend on the
+    // number of threads.
+    void Match(Frame &F);
+
+    // Sum of absolute differences between two 11x11 patches after removing
+    // the value of their central pixel. pL and pR point to the top left pixel.
+    static int PatchSAD(const uchar* pL, const size_t strideL, const uchar* pR, const size_t strideR);
+
+protected:
+    // Matches the left keypoints in [nBegin,nEnd). Writes only their entries.
+    void MatchRange(Frame &F, const int nBegin, const int nEnd);
+
+    ThreadPool mThreadPool;
+
+    // Right keypoints which may match a left keypoint in each row, stored
+    // contiguously: the candidates of row y are
+    // mvRowIndices[mvRowStart[y]] ... mvRowIndices[mvRowStart[y+1]-1]
+    std::vector<int> mvRowStart;
+    std::vector<int> mvRowIndices;
+
+    // SAD distance of the accepted matches, -1 otherwise
+    std::vector<int> mvBestSAD;
+};
+
+} //namespace ORB_SLAM
+
+#endif // STEREOMATCHER_H
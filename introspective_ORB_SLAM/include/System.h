@@ -33,10 +33,13 @@
 #include "LoopClosing.h"
 #include "Map.h"
 #include "MapDrawer.h"
+#include "MapRenderer.h"
 #include "ORBVocabulary.h"
 #include "Tracking.h"
 #include "Viewer.h"
 
+DECLARE_bool(deterministic_replay);
+
 namespace ORB_SLAM2 {
 
 class Viewer;
@@ -46,6 +49,32 @@ class Tracking;
 class LocalMapping;
 class LoopClosing;
 
+// Snapshot of the most recent frame, used for predicting the next frame
+// before it is tracked.
+struct TrackedFrameInfo {
+  // Camera pose of the frame (world to camera)
+  cv::Mat Tcw;
+  // Constant velocity motion model. Tcw of the next frame is predicted as
+  // velocity * Tcw. Empty if the motion model is not initialized.
+  cv::Mat velocity;
+  // Calibration matrix
+  cv::Mat K;
+  // Number of map point inliers
+  int num_inliers = 0;
+  // Undistorted keypoints and their stereo/RGBD depth (negative if unknown)
+  std::vector<cv::KeyPoint> keypoints;
+  std::vector<float> depths;
+};
+
+// Time the tracking thread waited for the map update mutex. The mutex is held
+// by the local BA, the loop correction and the map update after a global BA,
+// so this is how long they stalled tracking.
+struct MapLockWaitStats {
+  int num_frames = 0;
+  double total_ms = 0.0;
+  double max_ms = 0.0;
+};
+
 class System {
  public:
   // Input sensor
@@ -53,7 +82,9 @@ class System {
 
  public:
   // Initialize the SLAM system. It launches the Local Mapping, Loop Closing and
-  // Viewer threads.
+  // Viewer threads. If pVocabulary is given it is used instead of loading
+  // strVocFile. It is not copied and must outlive the System, so several
+  // Systems can share one vocabulary, which they only read.
   System(const string &strVocFile,
          const string &strSettingsFile,
          const eSensor sensor,
@@ -182,13 +213,31 @@ class System {
   // Returns false if the current tracking state is anything other than OK
   bool GetCurrentCamPose(cv::Mat &cam_pose);
 
+  // Fills info with the most recent frame. Returns false if the current
+  // tracking state is anything other than OK.
+  bool GetTrackedFrameInfo(TrackedFrameInfo &info);
+
+  // Map lock waits of all the frames tracked so far
+  MapLockWaitStats GetMapLockWaitStats();
+
  private:
+  // Runs the loop closer after a frame has been tracked, when it has no
+  // thread of its own (deterministic replay).
+  void RunInlineLoopClosing();
+
   // Input sensor
   eSensor mSensor;
 
   // ORB vocabulary used for place recognition and feature matching.
   ORBVocabulary *mpVocabulary;
 
+  // False if the vocabulary was passed in by the caller
+  bool mbOwnsVocabulary;
+
+  // Id counters and other state shared by the frames, keyframes and map
+  // points of this System.
+  SessionContext *mpContext;
+
   // KeyFrame database for place recognition (relocalization and loop
   // detection).
   KeyFrameDatabase *mpKeyFrameDatabase;
@@ -213,6 +262,10 @@ class System {
   // The viewer draws the map and the current camera pose. It uses Pangolin.
   Viewer *mpViewer;
 
+  // Offscreen map renderer, used instead of the viewer in headless runs when
+  // FLAGS_map_renderer_enabled is set.
+  MapRenderer *mpMapRenderer;
+
   FrameDrawer *mpFrameDrawer;
   MapDrawer *mpMapDrawer;
 
@@ -222,6 +275,7 @@ class System {
   std::thread *mptLocalMapping;
   std::thread *mptLoopClosing;
   std::thread *mptViewer;
+  std::thread *mptMapRenderer;
 
   // Reset flag
   std::mutex mMutexReset;
@@ -236,8 +290,12 @@ class System {
   int mTrackingState;
   std::vector<MapPoint *> mTrackedMapPoints;
   std::vector<cv::KeyPoint> mTrackedKeyPointsUn;
+  MapLockWaitStats mMapLockWaitStats;
   std::mutex mMutexState;
 
+  // Last big change index of the map seen by MapChanged()
+  int mnLastBigChangeIdx;
+
   // In single threaded mode, tracking and local mapping run in the same
   // thread and loop closing is disabled
   bool mbSingleThreaded;
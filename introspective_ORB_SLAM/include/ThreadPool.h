@@ -0,0 +1,74 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ORB_SLAM2
+{
+
+// A fixed set of worker threads used to run data parallel loops. The calling
+// thread takes part in the work, so a pool created with nThreads<=1 has no
+// workers and runs everything inline.
+class ThreadPool
+{
+public:
+    ThreadPool(int nThreads);
+    ~ThreadPool();
+
+    // Total number of threads that execute a ParallelFor (including the caller)
+    int NumThreads() const;
+
+    // Calls func(i) for every i in [0,n) and returns once all calls have
+    // finished. The order in which indices are processed is not defined, so
+    // func must only write to state owned by index i.
+    void ParallelFor(int n, const std::function<void(int)> &func);
+
+protected:
+    void WorkerLoop();
+    void RunJob();
+
+    std::vector<std::thread> mvWorkers;
+
+    // Serializes ParallelFor calls issued from different threads
+    std::mutex mMutexCall;
+
+    std::mutex mMutexJob;
+    std::condition_variable mcvJob;
+    std::condition_variable mcvDone;
+
+    const std::function<void(int)>* mpJob;
+    int mnJobSize;
+    std::atomic<int> mnNextIndex;
+    int mnActiveWorkers;
+    unsigned long mnJobId;
+    bool mbFinish;
+};
+
+} //namespace ORB_SLAM
+
+#endif // THREADPOOL_H
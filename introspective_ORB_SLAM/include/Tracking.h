@@ -45,6 +45,7 @@
 #include "feature_evaluator.h"
 #include "dataset_creator.h"
 #include "io_access.h"
+#include "LocalMapCuller.h"
 
 #include <mutex>
 
@@ -52,6 +53,7 @@ namespace ORB_SLAM2
 {
 
 class Viewer;
+class MapRenderer;
 class FrameDrawer;
 class Map;
 class LocalMapping;
@@ -68,11 +70,13 @@ public:
              MapDrawer* pMapDrawer, 
              Map* pMap,
              KeyFrameDatabase* pKFDB, 
+             SessionContext* pContext,
              const string &strSettingPath, 
              const int sensor,
              const bool bSingleThreaded=false,
              const bool bSilent=false,
              const bool bGuidedBA=false);
+    ~Tracking();
 
     // Preprocess the input and call Track(). Extract features and performs 
     // stereo matching.
@@ -109,6 +113,7 @@ public:
     void SetLocalMapper(LocalMapping* pLocalMapper);
     void SetLoopClosing(LoopClosing* pLoopClosing);
     void SetViewer(Viewer* pViewer);
+    void SetMapRenderer(MapRenderer* pMapRenderer);
 
     // Load new settings
     // The focal lenght should be similar or scale prediction will fail when projecting points
@@ -126,6 +131,18 @@ public:
         const vector<Eigen::Vector2f>* rel_cam_poses_uncertainty);
     
     cv::Mat CalculateInverseTransform(const cv::Mat& transform);
+
+    // Constant velocity motion model (Tcw of the last frame times Twc of the
+    // frame before it). Empty if not initialized.
+    cv::Mat GetVelocity() const { return mVelocity.clone(); }
+
+    // Number of map point inliers of the last tracked frame
+    int GetNumMatchesInliers() const { return mnMatchesInliers; }
+
+    // Map lock waits of all the frames tracked so far. Must be called from
+    // the thread that runs the tracking. Other threads use
+    // System::GetMapLockWaitStats.
+    MapLockWaitStats GetMapLockWaitStats() const { return mMapLockWaitStats; }
     
     // Release all allocated memory
     void Release();
@@ -156,6 +173,8 @@ public:
     // frames local BA is called once.
     int mFramesReceivedSinceLastLocalBA = 0;
 
+    MapLockWaitStats mMapLockWaitStats;
+
     // Current Frame
     Frame mCurrentFrame;
     cv::Mat mImGray;
@@ -312,6 +331,7 @@ protected:
     //BoW
     ORBVocabulary* mpORBVocabulary;
     KeyFrameDatabase* mpKeyFrameDB;
+    SessionContext* mpContext;
 
     // Initalization (only for monocular)
     Initializer* mpInitializer;
@@ -320,12 +340,19 @@ protected:
     KeyFrame* mpReferenceKF;
     std::vector<KeyFrame*> mvpLocalKeyFrames;
     std::vector<MapPoint*> mvpLocalMapPoints;
+
+    // SoA snapshot of the local map points used for frustum culling
+    LocalMapCuller mLocalMapCuller;
+
+    // Threads used to match the local map points in SearchByProjection
+    ThreadPool* mpThreadPool;
     
     // System
     System* mpSystem;
     
     //Drawers
     Viewer* mpViewer;
+    MapRenderer* mpMapRenderer=NULL;
     FrameDrawer* mpFrameDrawer=NULL;
     MapDrawer* mpMapDrawer;
 
@@ -358,6 +385,9 @@ protected:
     unsigned int mnLastKeyFrameId;
     unsigned int mnLastRelocFrameId;
 
+    //Number of frames that reached the feature evaluation step
+    int mnFramesEvaluated;
+
     //Motion Model
     cv::Mat mVelocity;
 
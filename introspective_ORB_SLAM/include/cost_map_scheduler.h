@@ -0,0 +1,95 @@
+// Copyright 2019 srabiee@cs.utexas.edu
+// College of Information and Computer Sciences,
+// University of Texas at Austin
+//
+//
+// This software is free: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License Version 3,
+// as published by the Free Software Foundation.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// Version 3 in the file COPYING that came with this distribution.
+// If not, see <http://www.gnu.org/licenses/>.
+// ========================================================================
+
+
+#ifndef IVSLAM_COST_MAP_SCHEDULER
+#define IVSLAM_COST_MAP_SCHEDULER
+
+#include <gflags/gflags.h>
+
+#include <opencv2/core/core.hpp>
+#include <string>
+
+#include "System.h"
+
+DECLARE_int32(introspection_inference_period);
+DECLARE_double(introspection_rerun_inlier_ratio);
+DECLARE_double(introspection_min_warp_coverage);
+
+namespace ORB_SLAM2 {
+
+// Decides on which frames the introspection function is run. The predicted
+// cost map of the last inference frame is reused for up to
+// introspection_inference_period - 1 following frames, warped into each of
+// them using the constant velocity motion model of the tracker and the stereo
+// depth of the inference frame. The network is run again earlier if tracking
+// is not OK, the number of tracked inliers drops, or the warped cost map no
+// longer covers enough of the image. The cost maps are in the frame of the
+// images passed to SLAM, i.e. after rectification.
+class CostMapScheduler {
+ public:
+  struct Stats {
+    int num_frames = 0;
+    int num_inferences = 0;
+    // Reasons for running the network before the period is over
+    int num_reruns_tracking = 0;
+    int num_reruns_inliers = 0;
+    int num_reruns_coverage = 0;
+  };
+
+  CostMapScheduler() = default;
+
+  // Call once before each frame is passed to slam. Returns true if the
+  // introspection function should be run on the frame, in which case the
+  // result has to be passed to SetPredictedCostMap(). Otherwise, cost_map is
+  // set to the last predicted cost map warped into the frame.
+  bool Schedule(System* slam, cv::Mat* cost_map);
+
+  // Stores the cost map predicted for the frame Schedule() was called for
+  void SetPredictedCostMap(const cv::Mat& cost_map);
+
+  Stats GetStats() const { return stats_; }
+
+  // One line summary of GetStats()
+  std::string GetSummary() const;
+
+ private:
+  // Stores the pose and the keypoint depths of the inference frame once it
+  // has been tracked
+  void InitSource(const TrackedFrameInfo& info);
+
+  // Warps the source cost map by the relative pose T_dst_src. Returns the
+  // fraction of the warped image that is covered by the source image.
+  float Warp(const cv::Mat& T_dst_src, const cv::Mat& K, cv::Mat* warped);
+
+  // Cost map predicted by the network and the state of its frame
+  cv::Mat source_cost_map_;
+  bool source_pending_ = false;
+  cv::Mat source_Tcw_;
+  int source_num_inliers_ = 0;
+  // Coarse grid of median inverse depths of the source frame keypoints
+  cv::Mat source_inv_depth_;
+
+  int frames_since_inference_ = 0;
+  Stats stats_;
+};
+
+}  // namespace ORB_SLAM2
+
+#endif  // IVSLAM_COST_MAP_SCHEDULER
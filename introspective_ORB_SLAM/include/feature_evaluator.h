@@ -395,6 +395,9 @@ class FeatureEvaluator {
 
   const bool kDebug_ = true;
   bool camera_calib_loaded_ = false;
+
+  // Set once the output directories of SaveImagesToFile() have been cleared
+  bool output_dirs_created_ = false;
   DescriptorType descriptor_type_ = kORB;
   Dataset dataset_ = kKITTI;
   TrainingMode training_mode_ = kCompareAgainstRefKeyFrameEpipolarNormalized;
@@ -0,0 +1,103 @@
+// Copyright 2019 srabiee@cs.utexas.edu
+// College of Information and Computer Sciences,
+// University of Texas at Austin
+//
+//
+// This software is free: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License Version 3,
+// as published by the Free Software Foundation.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// Version 3 in the file COPYING that came with this distribution.
+// If not, see <http://www.gnu.org/licenses/>.
+// ========================================================================
+
+#ifndef IVSLAM_INTROSPECTION_SESSION
+#define IVSLAM_INTROSPECTION_SESSION
+
+#include <gflags/gflags.h>
+#include <torch/script.h>
+#include <torch/torch.h>
+
+#include <mutex>
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+
+#include "latency_stats.h"
+
+DECLARE_int32(introspection_num_threads);
+DECLARE_int32(introspection_num_interop_threads);
+DECLARE_int32(introspection_warmup_iters);
+DECLARE_bool(introspection_freeze_model);
+DECLARE_string(introspection_quantized_engine);
+
+namespace ORB_SLAM2 {
+
+// Runs the TorchScript introspection function on input images and returns
+// the predicted cost heatmaps. The model is loaded once, prepared for
+// inference (eval mode, frozen and optimized when supported by the libtorch
+// version) and warmed up so that the first tracked frames do not pay for the
+// JIT profiling runs. Predict() may be called concurrently from several
+// threads.
+class IntrospectionSession {
+ public:
+  IntrospectionSession() = default;
+
+  // Loads the model at model_path and moves it to the GPU if use_gpu is set
+  // and CUDA is available. If input_size is not empty, images are resized to
+  // it before inference and the heatmaps are resized back to the image size.
+  // The libtorch thread pools are configured from the introspection_num_*
+  // flags and the backend of quantized models from
+  // introspection_quantized_engine. Returns false if the model cannot be
+  // loaded.
+  bool Load(const std::string& model_path,
+            const bool use_gpu,
+            const cv::Size& input_size = cv::Size());
+
+  // Runs introspection_warmup_iters forward passes on an image of the given
+  // size. Only the first call has an effect. Predict() runs the warm-up
+  // itself if this was not called before.
+  void Warmup(const cv::Size& image_size);
+
+  // Returns the CV_8U cost heatmap of a BGR image. The heatmap has the same
+  // size as the image.
+  cv::Mat Predict(const cv::Mat& img_bgr);
+
+  bool IsLoaded() const { return loaded_; }
+
+  // Latency of the Predict() calls so far, warm-up passes excluded. The
+  // percentiles are computed on a bounded random subset of the calls.
+  LatencyStats GetLatencyStats() const;
+
+  // One line summary of GetLatencyStats()
+  std::string GetLatencySummary() const;
+
+ private:
+  // Converts a BGR image to a normalized 1x3xHxW tensor on device_
+  at::Tensor ToInputTensor(const cv::Mat& img_bgr) const;
+
+  // Runs the model on an input tensor without recording autograd state
+  at::Tensor Forward(const at::Tensor& input);
+
+  void RunWarmup(const cv::Size& image_size);
+
+  torch::jit::script::Module module_;
+  torch::Device device_ = torch::kCPU;
+  cv::Size input_size_;
+  bool loaded_ = false;
+
+  std::once_flag warmup_flag_;
+
+  mutable std::mutex latency_mutex_;
+  LatencyReservoir latencies_ms_;
+};
+
+}  // namespace ORB_SLAM2
+
+#endif  // IVSLAM_INTROSPECTION_SESSION
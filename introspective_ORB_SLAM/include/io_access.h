@@ -35,6 +35,7 @@
 #include <cstdio>
 #include <bitset>
 
+#include <opencv2/core/core.hpp>
 
 
 namespace ORB_SLAM2 {
@@ -80,6 +81,16 @@ public:
     }
   }
 
+  // Reads a grayscale ("Pf") PFM file into a CV_32F image. The file is
+  // memory-mapped and the raster is copied exactly once into "img", which
+  // owns its memory. The buffer of "img" is reused if it already has the
+  // right size and type. If "flip_rows" is true, rows are reordered from the
+  // bottom-to-top order of the PFM spec to top-to-bottom; otherwise they are
+  // kept in file order. Returns false upon failure.
+  bool read_pfm( const std::string & filename,
+                 cv::Mat * img,
+                 bool flip_rows = true );
+
   // TODO - what types do expect here roughly? Might be good to have that in documentation
   template<typename T> 
   T * read_pfm( const std::string & filename ) 
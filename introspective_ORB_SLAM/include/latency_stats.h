@@ -0,0 +1,108 @@
+// Copyright 2019 srabiee@cs.utexas.edu
+// College of Information and Computer Sciences,
+// University of Texas at Austin
+//
+//
+// This software is free: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License Version 3,
+// as published by the Free Software Foundation.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// Version 3 in the file COPYING that came with this distribution.
+// If not, see <http://www.gnu.org/licenses/>.
+// ========================================================================
+
+
+#ifndef IVSLAM_LATENCY_STATS
+#define IVSLAM_LATENCY_STATS
+
+#include <algorithm>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+namespace ORB_SLAM2 {
+
+// Summary of a set of latency samples (milliseconds)
+struct LatencyStats {
+  int count = 0;
+  double mean = 0.0;
+  double p50 = 0.0;
+  double p99 = 0.0;
+  double max = 0.0;
+};
+
+// Nearest-rank percentile of a sorted vector, p in [0, 100]
+inline double Percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0.0;
+  size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.5);
+  rank = std::min(std::max<size_t>(rank, 1), sorted.size());
+  return sorted[rank - 1];
+}
+
+inline LatencyStats ComputeLatencyStats(std::vector<double> samples) {
+  LatencyStats stats;
+  if (samples.empty()) return stats;
+  std::sort(samples.begin(), samples.end());
+  stats.count = samples.size();
+  double sum = 0.0;
+  for (double s : samples) sum += s;
+  stats.mean = sum / samples.size();
+  stats.p50 = Percentile(samples, 50.0);
+  stats.p99 = Percentile(samples, 99.0);
+  stats.max = samples.back();
+  return stats;
+}
+
+// Latency samples of a process that runs for an unbounded time. The count,
+// mean and max cover all the samples. The percentiles are computed on a
+// uniform random subset of at most max_samples of them (reservoir sampling),
+// so the memory does not grow with the number of samples. Not thread safe.
+class LatencyReservoir {
+ public:
+  explicit LatencyReservoir(size_t max_samples = 4096)
+      : max_samples_(std::max<size_t>(max_samples, 1)) {}
+
+  void Add(double ms) {
+    count_++;
+    sum_ += ms;
+    max_ = std::max(max_, ms);
+    if (samples_.size() < max_samples_) {
+      samples_.push_back(ms);
+      return;
+    }
+    // Keeps every sample seen so far with the same probability
+    std::uniform_int_distribution<long> dist(0, count_ - 1);
+    const long i = dist(rng_);
+    if (i < static_cast<long>(max_samples_)) {
+      samples_[i] = ms;
+    }
+  }
+
+  LatencyStats GetStats() const {
+    LatencyStats stats = ComputeLatencyStats(samples_);
+    stats.count = count_;
+    if (count_ > 0) {
+      stats.mean = sum_ / count_;
+      stats.max = max_;
+    }
+    return stats;
+  }
+
+ private:
+  size_t max_samples_;
+  std::vector<double> samples_;
+  long count_ = 0;
+  double sum_ = 0.0;
+  double max_ = 0.0;
+  std::mt19937 rng_;
+};
+
+}  // namespace ORB_SLAM2
+
+#endif  // IVSLAM_LATENCY_STATS
@@ -17,6 +17,7 @@ IVSLAM_PROPAGATE_KEYPT_QUAL="false"
 RUN_SINGLE_THREADED="false"
 ENABLE_VIEWER="true"
 USE_GPU="true"
+INTROSPECTION_INFERENCE_PERIOD="1" # def: 1 (run on every frame)
 RECTIFY_IMGS="true"
 
 OPTIMIZER_RUN_EXTRA_ITERATIONS="true"
@@ -82,6 +83,7 @@ $PREDICTED_IMAGE_QUAL_BASE_DIR/$SESSION_NUM_STR/
   --save_visualizations=$SAVE_VISUALIZATIONS \
   --enable_viewer=$ENABLE_VIEWER \
   --use_gpu=$USE_GPU \
+  --introspection_inference_period=$INTROSPECTION_INFERENCE_PERIOD \
   --rectify_images=$RECTIFY_IMGS \
   --optimizer_run_extra_iter=$OPTIMIZER_RUN_EXTRA_ITERATIONS \
   --optimizer_pose_opt_iter_count=$OPTIMIZER_POSE_OPT_ITER_COUNT \
@@ -0,0 +1,81 @@
+#!/bin/bash
+
+# Same as run_stereo_jackal_batch_inference.bash, but runs all the sessions
+# in a single process that loads the vocabulary and the introspection model
+# only once. Set NUM_PARALLEL_SESSIONS to run several sessions at a time.
+
+# Full test list
+# SESSIONS="5 6 7 11 15 18 19 23 24 29 30 33 37 40 43"
+
+SESSIONS="37"
+NUM_PARALLEL_SESSIONS="1"
+START_FRAME="0" 
+CONFIG_FILE_NAME="jackal_visual_odom_stereo_inference.yaml"
+
+
+CREATE_IVSLAM_DATASET="false"
+INFERENCE_MODE="true"
+INTROSPECTION_FUNCTION_ENABLED="true"
+LOAD_IMG_QUAL_HEATMAPS_FROM_FILE="false"
+IVSLAM_PROPAGATE_KEYPT_QUAL="false"
+RUN_SINGLE_THREADED="false"
+USE_GPU="true"
+INTROSPECTION_INFERENCE_PERIOD="1" # def: 1 (run on every frame)
+RECTIFY_IMGS="true"
+
+OPTIMIZER_RUN_EXTRA_ITERATIONS="true"
+OPTIMIZER_POSE_OPT_ITER_COUNT="4" # def: 4
+TRACKING_BA_RATE="1" # def: 1
+MAP_DRAWER_VISUALIZE_GT_POSE="true"
+
+IVSLAM_ENABLED="true"
+LOAD_REL_POSE_UNCERTAINTY="false"
+
+CONFIG_FILE_DIR="../Examples/Stereo"
+SOURCE_DATASET_BASE_DIR=\
+"../../Jackal_Visual_Odom/"
+
+INTROSPECTION_MODEL_PATH=\
+"../../introspection_function/pretrained/iv_jackal_mobilenet_c1deepsup_light.pt"
+
+TARGET_RESULT_BASE_DIR="results/"
+
+TARGET_DATASET_BASE_DIR=""
+
+PREDICTED_IMAGE_QUAL_BASE_DIR=""
+
+mkdir -p $TARGET_RESULT_BASE_DIR
+
+SEQUENCE_PATH=$SOURCE_DATASET_BASE_DIR/"sequences"
+GROUND_TRUTH_PATH=$SOURCE_DATASET_BASE_DIR/"poses"
+LIDAR_POSE_UNC_PATH=$SOURCE_DATASET_BASE_DIR/"lidar_poses"
+
+
+../Examples/Stereo/stereo_kitti_batch \
+--vocab_path="../Vocabulary/ORBvoc.txt" \
+--settings_path=$CONFIG_FILE_DIR/$CONFIG_FILE_NAME \
+--sessions="$SESSIONS" \
+--num_parallel_sessions=$NUM_PARALLEL_SESSIONS \
+--sequences_dir=$SEQUENCE_PATH \
+--ground_truth_dir=$GROUND_TRUTH_PATH \
+--img_qual_base_dir=$PREDICTED_IMAGE_QUAL_BASE_DIR \
+--introspection_model_path=$INTROSPECTION_MODEL_PATH \
+--out_visualization_base_path=$TARGET_RESULT_BASE_DIR \
+--out_dataset_base_path=$TARGET_DATASET_BASE_DIR \
+--rel_pose_uncertainty_dir=$LIDAR_POSE_UNC_PATH \
+--start_frame=$START_FRAME \
+--introspection_func_enabled=$INTROSPECTION_FUNCTION_ENABLED \
+--load_img_qual_heatmaps=$LOAD_IMG_QUAL_HEATMAPS_FROM_FILE \
+--load_rel_pose_uncertainty=$LOAD_REL_POSE_UNCERTAINTY \
+--run_single_threaded=$RUN_SINGLE_THREADED \
+--create_ivslam_dataset=$CREATE_IVSLAM_DATASET \
+--ivslam_enabled=$IVSLAM_ENABLED \
+--inference_mode=$INFERENCE_MODE \
+--use_gpu=$USE_GPU \
+--introspection_inference_period=$INTROSPECTION_INFERENCE_PERIOD \
+--rectify_images=$RECTIFY_IMGS \
+--optimizer_run_extra_iter=$OPTIMIZER_RUN_EXTRA_ITERATIONS \
+--optimizer_pose_opt_iter_count=$OPTIMIZER_POSE_OPT_ITER_COUNT \
+--tracking_ba_rate=$TRACKING_BA_RATE \
+--map_drawer_visualize_gt_pose=$MAP_DRAWER_VISUALIZE_GT_POSE \
+--ivslam_propagate_keyptqual=$IVSLAM_PROPAGATE_KEYPT_QUAL 
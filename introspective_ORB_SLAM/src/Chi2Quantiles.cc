@@ -0,0 +1,48 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Chi2Quantiles.h"
+
+#include <boost/math/distributions/chi_squared.hpp>
+
+namespace ORB_SLAM2
+{
+
+Chi2QuantileTable::Chi2QuantileTable(const double probability, const int nMaxDof):
+    mProbability(probability)
+{
+    mvQuantiles.resize(nMaxDof);
+    for(int dof=1; dof<=nMaxDof; dof++)
+    {
+        boost::math::chi_squared_distribution<double> distribution(dof);
+        mvQuantiles[dof-1] = quantile(distribution, mProbability);
+    }
+}
+
+double Chi2QuantileTable::operator()(const int dof) const
+{
+    if(dof<=static_cast<int>(mvQuantiles.size()))
+        return mvQuantiles[dof-1];
+
+    boost::math::chi_squared_distribution<double> distribution(dof);
+    return quantile(distribution, mProbability);
+}
+
+} //namespace ORB_SLAM
@@ -21,8 +21,10 @@
 #include "Frame.h"
 #include "Converter.h"
 #include "ORBmatcher.h"
+#include "StereoMatcher.h"
+#include "Chi2Quantiles.h"
+#include <memory>
 #include <thread>
-#include <boost/math/distributions.hpp>
 #include <glog/logging.h>
 #include <gflags/gflags.h>
 
@@ -31,36 +33,40 @@ DEFINE_double(ivslam_keypt_qual_chi2_prob_thresh, 0.99,
              "threshold for the normalized reprojection errors (chi2 dist). "
              "This is used to generate the keypoint quality scores from "
              "reprojection erros when in unsupervised learning mode.");
+DEFINE_int32(bow_transform_num_threads, 1,
+             "Number of threads used to look up the vocabulary words of the "
+             "descriptors of a frame or keyframe.");
+DEFINE_int32(stereo_matching_num_threads, 1,
+             "Number of threads used to match the left and right keypoints "
+             "of stereo frames. The results do not depend on this value.");
 
 namespace ORB_SLAM2
 {
 
-long unsigned int Frame::nNextId=0;
-bool Frame::mbInitialComputations=true;
-float Frame::cx, Frame::cy, Frame::fx, Frame::fy, Frame::invfx, Frame::invfy;
-float Frame::mnMinX, Frame::mnMinY, Frame::mnMaxX, Frame::mnMaxY;
-float Frame::mfGridElementWidthInv, Frame::mfGridElementHeightInv;
-
-Frame::Frame()
+Frame::Frame():mpContext(static_cast<SessionContext*>(NULL))
 {}
 
 //Copy Constructor
 Frame::Frame(const Frame &frame)
     :mpORBvocabulary(frame.mpORBvocabulary), mpORBextractorLeft(frame.mpORBextractorLeft), mpORBextractorRight(frame.mpORBextractorRight),
-     mTimeStamp(frame.mTimeStamp), mK(frame.mK.clone()), mDistCoef(frame.mDistCoef.clone()),
+     mTimeStamp(frame.mTimeStamp), mK(frame.mK.clone()), fx(frame.fx), fy(frame.fy), cx(frame.cx),
+     cy(frame.cy), invfx(frame.invfx), invfy(frame.invfy), mDistCoef(frame.mDistCoef.clone()),
      mbf(frame.mbf), mb(frame.mb), mThDepth(frame.mThDepth), N(frame.N), mvKeys(frame.mvKeys),
      mvKeysRight(frame.mvKeysRight), mvKeysUn(frame.mvKeysUn),
      mvKeysGTDepth(frame.mvKeysGTDepth),
      mvKeyQualScore(frame.mvKeyQualScore), mvuRight(frame.mvuRight),
      mvDepth(frame.mvDepth), mBowVec(frame.mBowVec), mFeatVec(frame.mFeatVec),
      mDescriptors(frame.mDescriptors.clone()), mDescriptorsRight(frame.mDescriptorsRight.clone()),
-     mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier), mnId(frame.mnId),
+     mvpMapPoints(frame.mvpMapPoints), mvbOutlier(frame.mvbOutlier),
+     mfGridElementWidthInv(frame.mfGridElementWidthInv),
+     mfGridElementHeightInv(frame.mfGridElementHeightInv), mpContext(frame.mpContext), mnId(frame.mnId),
      mstrLeftImgName(frame.mstrLeftImgName),
      mpReferenceKF(frame.mpReferenceKF), mnScaleLevels(frame.mnScaleLevels),
      mfScaleFactor(frame.mfScaleFactor), mfLogScaleFactor(frame.mfLogScaleFactor),
      mvScaleFactors(frame.mvScaleFactors), mvInvScaleFactors(frame.mvInvScaleFactors),
      mvLevelSigma2(frame.mvLevelSigma2), 
      mvInvLevelSigma2(frame.mvInvLevelSigma2),
+     mnMinX(frame.mnMinX), mnMaxX(frame.mnMaxX), mnMinY(frame.mnMinY), mnMaxY(frame.mnMaxY),
      mvKeyQualScoreTrain(frame.mvKeyQualScoreTrain),
      mvChi2(frame.mvChi2), mvChi2Dof(frame.mvChi2Dof),
      mvpMapPointsComp(frame.mvpMapPointsComp)
@@ -88,17 +94,20 @@ Frame::Frame(const Frame &frame)
 
 Frame::Frame(const cv::Mat &imLeft, const cv::Mat &imRight, const double 
 &timeStamp, ORBextractor* extractorLeft, ORBextractor* extractorRight, 
-ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float 
-&thDepth, const bool &gtDepthAvailable, const cv::Mat &imDepth,
-   const bool &bLogOutliers)
+ORBVocabulary* voc, SessionContext* pContext, cv::Mat &K, cv::Mat &distCoef, 
+const float &bf, const float &thDepth, const bool &gtDepthAvailable, 
+const cv::Mat &imDepth, const bool &bLogOutliers)
     
 :mpORBvocabulary(voc),mpORBextractorLeft(extractorLeft),mpORBextractorRight(
 extractorRight), mTimeStamp(timeStamp), 
 mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth),
-     mpReferenceKF(static_cast<KeyFrame*>(NULL))
+     mpContext(pContext), mpReferenceKF(static_cast<KeyFrame*>(NULL))
 {
     // Frame ID
-    mnId=nNextId++;
+    mnId=mpContext->mnNextFrameId++;
+
+    // Calibration and image bounds
+    SetCalibration(K,imLeft);
 
     // Scale Level Info
     mnScaleLevels = mpORBextractorLeft->GetLevels();
@@ -202,44 +211,26 @@ mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), mThDepth(thDepth),
       mvKeyQualScoreTrain = vector<float>(N, 1.0f);
     }
 
-
-    // This is done only for the first Frame (or after a change in the 
-    // calibration)
-    if(mbInitialComputations)
-    {
-        ComputeImageBounds(imLeft);
-
-        
-mfGridElementWidthInv=static_cast<float>(FRAME_GRID_COLS)/(mnMaxX-mnMinX);
-        
-mfGridElementHeightInv=static_cast<float>(FRAME_GRID_ROWS)/(mnMaxY-mnMinY);
-
-        fx = K.at<float>(0,0);
-        fy = K.at<float>(1,1);
-        cx = K.at<float>(0,2);
-        cy = K.at<float>(1,2);
-        invfx = 1.0f/fx;
-        invfy = 1.0f/fy;
-
-        mbInitialComputations=false;
-    }
-
     mb = mbf/fx;
 
     AssignFeaturesToGrid();
 }
 
 Frame::Frame(const cv::Mat &imGray, const cv::Mat &imDepth, const double 
-&timeStamp, ORBextractor* extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat 
-&distCoef, const float &bf, const float &thDepth,const bool &bLogOutliers)
+&timeStamp, ORBextractor* extractor,ORBVocabulary* voc, SessionContext* 
+pContext, cv::Mat &K, cv::Mat &distCoef, const float &bf, const float &thDepth,
+const bool &bLogOutliers)
     
 :mpORBvocabulary(voc),mpORBextractorLeft(extractor),mpORBextractorRight(
 static_cast<ORBextractor*>(NULL)),
      mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), 
-mThDepth(thDepth)
+mThDepth(thDepth), mpContext(pContext)
 {
     // Frame ID
-    mnId=nNextId++;
+    mnId=mpContext->mnNextFrameId++;
+
+    // Calibration and image bounds
+    SetCalibration(K,imGray);
 
     // Scale Level Info
     mnScaleLevels = mpORBextractorLeft->GetLevels();
@@ -276,29 +267,6 @@ mThDepth(thDepth)
       mvKeyQualScoreTrain = vector<float>(N, 1.0f);
     }
 
-    // This is done only for the first Frame (or after a change in the 
-    // calibration)
-    if(mbInitialComputations)
-    {
-        ComputeImageBounds(imGray);
-
-        
-mfGridElementWidthInv=static_cast<float>(FRAME_GRID_COLS)/static_cast<float>(
-mnMaxX-mnMinX);
-        
-mfGridElementHeightInv=static_cast<float>(FRAME_GRID_ROWS)/static_cast<float>(
-mnMaxY-mnMinY);
-
-        fx = K.at<float>(0,0);
-        fy = K.at<float>(1,1);
-        cx = K.at<float>(0,2);
-        cy = K.at<float>(1,2);
-        invfx = 1.0f/fx;
-        invfy = 1.0f/fy;
-
-        mbInitialComputations=false;
-    }
-
     mb = mbf/fx;
 
     AssignFeaturesToGrid();
@@ -306,17 +274,20 @@ mnMaxY-mnMinY);
 
 
 Frame::Frame(const cv::Mat &imGray, const double &timeStamp, ORBextractor* 
-extractor,ORBVocabulary* voc, cv::Mat &K, cv::Mat &distCoef, const float &bf, 
-const float &thDepth, const bool &gtDepthAvailable, const cv::Mat &imDepth,
-  const bool &bLogOutliers)
+extractor,ORBVocabulary* voc, SessionContext* pContext, cv::Mat &K, 
+cv::Mat &distCoef, const float &bf, const float &thDepth, 
+const bool &gtDepthAvailable, const cv::Mat &imDepth, const bool &bLogOutliers)
     
 :mpORBvocabulary(voc),mpORBextractorLeft(extractor),mpORBextractorRight(
 static_cast<ORBextractor*>(NULL)),
      mTimeStamp(timeStamp), mK(K.clone()),mDistCoef(distCoef.clone()), mbf(bf), 
-mThDepth(thDepth)
+mThDepth(thDepth), mpContext(pContext)
 {
     // Frame ID
-    mnId=nNextId++;
+    mnId=mpContext->mnNextFrameId++;
+
+    // Calibration and image bounds
+    SetCalibration(K,imGray);
 
     // Scale Level Info
     mnScaleLevels = mpORBextractorLeft->GetLevels();
@@ -384,28 +355,6 @@ mThDepth(thDepth)
       mvKeyQualScoreTrain = vector<float>(N, 1.0f);
     }
       
-    // This is done only for the first Frame (or after a change in the 
-    // calibration)
-    if(mbInitialComputations)
-    {
-        ComputeImageBounds(imGray);
-
-        
-mfGridElementWidthInv=static_cast<float>(FRAME_GRID_COLS)/static_cast<float>(
-mnMaxX-mnMinX);
-        
-mfGridElementHeightInv=static_cast<float>(FRAME_GRID_ROWS)/static_cast<float>(
-mnMaxY-mnMinY);
-
-        fx = K.at<float>(0,0);
-        fy = K.at<float>(1,1);
-        cx = K.at<float>(0,2);
-        cy = K.at<float>(1,2);
-        invfx = 1.0f/fx;
-        invfy = 1.0f/fy;
-
-        mbInitialComputations=false;
-    }
 
     mb = mbf/fx;
 
@@ -498,15 +447,21 @@ void Frame::BackupNewMapPoints() {
 void Frame::ComputeKeyPtQualScores() {
   const float prob_thresh_low = 0.5; // 0.5
   const int min_obs = 3;
-  boost::math::chi_squared_distribution<float> dist_mono(2);
-  boost::math::chi_squared_distribution<float> dist_stereo(3);
+  // Observations have 2 (mono) or 3 (stereo) degrees of freedom
+  static const Chi2QuantileTable chi2_low(prob_thresh_low, 3);
+  // The high threshold comes from a flag that may change between calls, so
+  // the table is rebuilt whenever its probability no longer matches the flag
+  thread_local std::unique_ptr<Chi2QuantileTable> chi2_high;
+  if (!chi2_high || chi2_high->GetProbability() !=
+                        FLAGS_ivslam_keypt_qual_chi2_prob_thresh) {
+    chi2_high.reset(
+        new Chi2QuantileTable(FLAGS_ivslam_keypt_qual_chi2_prob_thresh, 3));
+  }
   
-  float thresh_high_mono = quantile(dist_mono, 
-                                    FLAGS_ivslam_keypt_qual_chi2_prob_thresh);
-  float thresh_high_stereo = quantile(dist_stereo, 
-                                      FLAGS_ivslam_keypt_qual_chi2_prob_thresh);
-  float thresh_low_mono = quantile(dist_mono, prob_thresh_low);
-  float thresh_low_stereo = quantile(dist_stereo, prob_thresh_low);
+  float thresh_high_mono = (*chi2_high)(2);
+  float thresh_high_stereo = (*chi2_high)(3);
+  float thresh_low_mono = chi2_low(2);
+  float thresh_low_stereo = chi2_low(3);
   
   for(size_t i = 0; i < mvChi2Dof.size(); i++) {
     if (mvChi2Dof[i] > 0) {
@@ -552,64 +507,10 @@ void Frame::UpdatePoseMatrices()
     mRwc = mRcw.t();
     mtcw = mTcw.rowRange(0,3).col(3);
     mOw = -mRcw.t()*mtcw;
-}
-
-bool Frame::isInFrustum(MapPoint *pMP, float viewingCosLimit)
-{
-    pMP->mbTrackInView = false;
-
-    // 3D in absolute coordinates
-    cv::Mat P = pMP->GetWorldPos(); 
-
-    // 3D in camera coordinates
-    const cv::Mat Pc = mRcw*P+mtcw;
-    const float &PcX = Pc.at<float>(0);
-    const float &PcY= Pc.at<float>(1);
-    const float &PcZ = Pc.at<float>(2);
-
-    // Check positive depth
-    if(PcZ<0.0f)
-        return false;
-
-    // Project in image and check it is not outside
-    const float invz = 1.0f/PcZ;
-    const float u=fx*PcX*invz+cx;
-    const float v=fy*PcY*invz+cy;
-
-    if(u<mnMinX || u>mnMaxX)
-        return false;
-    if(v<mnMinY || v>mnMaxY)
-        return false;
-
-    // Check distance is in the scale invariance region of the MapPoint
-    const float maxDistance = pMP->GetMaxDistanceInvariance();
-    const float minDistance = pMP->GetMinDistanceInvariance();
-    const cv::Mat PO = P-mOw;
-    const float dist = cv::norm(PO);
-
-    if(dist<minDistance || dist>maxDistance)
-        return false;
-
-   // Check viewing angle
-    cv::Mat Pn = pMP->GetNormal();
-
-    const float viewCos = PO.dot(Pn)/dist;
-
-    if(viewCos<viewingCosLimit)
-        return false;
-
-    // Predict scale in the image
-    const int nPredictedLevel = pMP->PredictScale(dist,this);
-
-    // Data used by the tracking
-    pMP->mbTrackInView = true;
-    pMP->mTrackProjX = u;
-    pMP->mTrackProjXR = u - mbf*invz;
-    pMP->mTrackProjY = v;
-    pMP->mnTrackScaleLevel= nPredictedLevel;
-    pMP->mTrackViewCos = viewCos;
 
-    return true;
+    mRcwEig = Converter::toMatrix3f(mRcw);
+    mtcwEig = Converter::toVector3f(mtcw);
+    mOwEig = Converter::toVector3f(mOw);
 }
 
 vector<size_t> Frame::GetFeaturesInArea(const float &x, const float  &y, const float  &r, const int minLevel, const int maxLevel) const
@@ -687,8 +588,7 @@ void Frame::ComputeBoW()
   if (mpORBvocabulary) {
     if(mBowVec.empty())
     {
-        vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
+        mpORBvocabulary->transform(mDescriptors,mBowVec,mFeatVec,4,FLAGS_bow_transform_num_threads);
     }
   }
 }
@@ -755,182 +655,64 @@ void Frame::ComputeImageBounds(const cv::Mat &imLeft)
     }
 }
 
-void Frame::ComputeStereoMatches()
+void Frame::SetCalibration(const cv::Mat &K, const cv::Mat &im)
 {
-    mvuRight = vector<float>(N,-1.0f);
-    mvDepth = vector<float>(N,-1.0f);
-
-    const int thOrbDist = (ORBmatcher::TH_HIGH+ORBmatcher::TH_LOW)/2;
-
-    const int nRows = mpORBextractorLeft->mvImagePyramid[0].rows;
-
-    //Assign keypoints to row table
-    vector<vector<size_t> > vRowIndices(nRows,vector<size_t>());
-
-    for(int i=0; i<nRows; i++)
-        vRowIndices[i].reserve(200);
-
-    const int Nr = mvKeysRight.size();
-
-    for(int iR=0; iR<Nr; iR++)
+    // This is done only for the first Frame of the session (or after a change
+    // in the calibration)
+    if(mpContext->mbInitialComputations)
     {
-        const cv::KeyPoint &kp = mvKeysRight[iR];
-        const float &kpY = kp.pt.y;
-        const float r = 2.0f*mvScaleFactors[mvKeysRight[iR].octave];
-        const int maxr = ceil(kpY+r);
-        const int minr = floor(kpY-r);
-
-        for(int yi=minr;yi<=maxr;yi++)
-            vRowIndices[yi].push_back(iR);
-    }
-
-    // Set limits for search
-    const float minZ = mb;
-    const float minD = 0;
-    const float maxD = mbf/minZ;
-
-    // For each left keypoint search a match in the right image
-    vector<pair<int, int> > vDistIdx;
-    vDistIdx.reserve(N);
-
-    for(int iL=0; iL<N; iL++)
-    {
-        const cv::KeyPoint &kpL = mvKeys[iL];
-        const int &levelL = kpL.octave;
-        const float &vL = kpL.pt.y;
-        const float &uL = kpL.pt.x;
-
-        const vector<size_t> &vCandidates = vRowIndices[vL];
-
-        if(vCandidates.empty())
-            continue;
-
-        const float minU = uL-maxD;
-        const float maxU = uL-minD;
-
-        if(maxU<0)
-            continue;
+        ComputeImageBounds(im);
 
-        int bestDist = ORBmatcher::TH_HIGH;
-        size_t bestIdxR = 0;
+        mfGridElementWidthInv=static_cast<float>(FRAME_GRID_COLS)/static_cast<float>(mnMaxX-mnMinX);
+        mfGridElementHeightInv=static_cast<float>(FRAME_GRID_ROWS)/static_cast<float>(mnMaxY-mnMinY);
 
-        const cv::Mat &dL = mDescriptors.row(iL);
-
-        // Compare descriptor to right keypoints
-        for(size_t iC=0; iC<vCandidates.size(); iC++)
-        {
-            const size_t iR = vCandidates[iC];
-            const cv::KeyPoint &kpR = mvKeysRight[iR];
-
-            if(kpR.octave<levelL-1 || kpR.octave>levelL+1)
-                continue;
-
-            const float &uR = kpR.pt.x;
-
-            if(uR>=minU && uR<=maxU)
-            {
-                const cv::Mat &dR = mDescriptorsRight.row(iR);
-                const int dist = ORBmatcher::DescriptorDistance(dL,dR);
-
-                if(dist<bestDist)
-                {
-                    bestDist = dist;
-                    bestIdxR = iR;
-                }
-            }
-        }
-
-        // Subpixel match by correlation
-        if(bestDist<thOrbDist)
-        {
-            // coordinates in image pyramid at keypoint scale
-            const float uR0 = mvKeysRight[bestIdxR].pt.x;
-            const float scaleFactor = mvInvScaleFactors[kpL.octave];
-            const float scaleduL = round(kpL.pt.x*scaleFactor);
-            const float scaledvL = round(kpL.pt.y*scaleFactor);
-            const float scaleduR0 = round(uR0*scaleFactor);
-
-            // sliding window search
-            const int w = 5;
-            cv::Mat IL = mpORBextractorLeft->mvImagePyramid[kpL.octave].rowRange(scaledvL-w,scaledvL+w+1).colRange(scaleduL-w,scaleduL+w+1);
-            IL.convertTo(IL,CV_32F);
-            IL = IL - IL.at<float>(w,w) *cv::Mat::ones(IL.rows,IL.cols,CV_32F);
-
-            int bestDist = INT_MAX;
-            int bestincR = 0;
-            const int L = 5;
-            vector<float> vDists;
-            vDists.resize(2*L+1);
-
-            const float iniu = scaleduR0+L-w;
-            const float endu = scaleduR0+L+w+1;
-            if(iniu<0 || endu >= mpORBextractorRight->mvImagePyramid[kpL.octave].cols)
-                continue;
-
-            for(int incR=-L; incR<=+L; incR++)
-            {
-                cv::Mat IR = mpORBextractorRight->mvImagePyramid[kpL.octave].rowRange(scaledvL-w,scaledvL+w+1).colRange(scaleduR0+incR-w,scaleduR0+incR+w+1);
-                IR.convertTo(IR,CV_32F);
-                IR = IR - IR.at<float>(w,w) *cv::Mat::ones(IR.rows,IR.cols,CV_32F);
-
-                float dist = cv::norm(IL,IR,cv::NORM_L1);
-                if(dist<bestDist)
-                {
-                    bestDist =  dist;
-                    bestincR = incR;
-                }
-
-                vDists[L+incR] = dist;
-            }
-
-            if(bestincR==-L || bestincR==L)
-                continue;
-
-            // Sub-pixel match (Parabola fitting)
-            const float dist1 = vDists[L+bestincR-1];
-            const float dist2 = vDists[L+bestincR];
-            const float dist3 = vDists[L+bestincR+1];
-
-            const float deltaR = (dist1-dist3)/(2.0f*(dist1+dist3-2.0f*dist2));
-
-            if(deltaR<-1 || deltaR>1)
-                continue;
-
-            // Re-scaled coordinate
-            float bestuR = mvScaleFactors[kpL.octave]*((float)scaleduR0+(float)bestincR+deltaR);
-
-            float disparity = (uL-bestuR);
+        fx = K.at<float>(0,0);
+        fy = K.at<float>(1,1);
+        cx = K.at<float>(0,2);
+        cy = K.at<float>(1,2);
+        invfx = 1.0f/fx;
+        invfy = 1.0f/fy;
 
-            if(disparity>=minD && disparity<maxD)
-            {
-                if(disparity<=0)
-                {
-                    disparity=0.01;
-                    bestuR = uL-0.01;
-                }
-                mvDepth[iL]=mbf/disparity;
-                mvuRight[iL] = bestuR;
-                vDistIdx.push_back(pair<int,int>(bestDist,iL));
-            }
-        }
+        mpContext->fx = fx;
+        mpContext->fy = fy;
+        mpContext->cx = cx;
+        mpContext->cy = cy;
+        mpContext->invfx = invfx;
+        mpContext->invfy = invfy;
+        mpContext->mnMinX = mnMinX;
+        mpContext->mnMaxX = mnMaxX;
+        mpContext->mnMinY = mnMinY;
+        mpContext->mnMaxY = mnMaxY;
+        mpContext->mfGridElementWidthInv = mfGridElementWidthInv;
+        mpContext->mfGridElementHeightInv = mfGridElementHeightInv;
+
+        mpContext->mbInitialComputations=false;
     }
-
-    sort(vDistIdx.begin(),vDistIdx.end());
-    const float median = vDistIdx[vDistIdx.size()/2].first;
-    const float thDist = 1.5f*1.4f*median;
-
-    for(int i=vDistIdx.size()-1;i>=0;i--)
+    else
     {
-        if(vDistIdx[i].first<thDist)
-            break;
-        else
-        {
-            mvuRight[vDistIdx[i].second]=-1;
-            mvDepth[vDistIdx[i].second]=-1;
-        }
+        fx = mpContext->fx;
+        fy = mpContext->fy;
+        cx = mpContext->cx;
+        cy = mpContext->cy;
+        invfx = mpContext->invfx;
+        invfy = mpContext->invfy;
+        mnMinX = mpContext->mnMinX;
+        mnMaxX = mpContext->mnMaxX;
+        mnMinY = mpContext->mnMinY;
+        mnMaxY = mpContext->mnMaxY;
+        mfGridElementWidthInv = mpContext->mfGridElementWidthInv;
+        mfGridElementHeightInv = mpContext->mfGridElementHeightInv;
     }
 }
 
+void Frame::ComputeStereoMatches()
+{
+    // One matcher per thread building stereo frames, so that its buffers and
+    // worker threads are reused across frames
+    static thread_local StereoMatcher matcher(FLAGS_stereo_matching_num_threads);
+    matcher.Match(*this);
+}
+
 
 void Frame::ComputeStereoFromRGBD(const cv::Mat &imDepth)
 {
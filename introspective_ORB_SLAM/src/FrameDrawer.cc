@@ -142,13 +142,11 @@ cv::Mat FrameDrawer::DrawFrame(bool save_to_file)
 
 
 void FrameDrawer::SaveToFile(const cv::Mat &im) {
-  static bool first_call = true;
-  
   if (!mbVisualizationPathSet) {
     return;
   }
 
-  if (first_call) {
+  if (!mbOutputDirCreated) {
     RemoveDirectory(mstrSaveVisualizationPath + "/frame_drawer/");
     CreateDirectory(mstrSaveVisualizationPath + "/frame_drawer/");
   }
@@ -158,7 +156,7 @@ void FrameDrawer::SaveToFile(const cv::Mat &im) {
                       img_name_truncated + ".jpg";
   cv::imwrite(file_path, im);
   
-  first_call = false;
+  mbOutputDirCreated = true;
 }
 
 
@@ -217,8 +215,6 @@ void FrameDrawer::DrawTextInfo(cv::Mat &im, int nState, cv::Mat &imText)
 
 void FrameDrawer::Update(Tracking *pTracker)
 { 
-    static bool first_call = true;
-    
     unique_lock<mutex> lock(mMutex);
     pTracker->mImGray.copyTo(mIm);
     mvCurrentKeys=pTracker->mCurrentFrame.mvKeys;  
@@ -271,12 +267,10 @@ void FrameDrawer::Update(Tracking *pTracker)
     mState=static_cast<int>(pTracker->mLastProcessedState);
     mstrFrameName = pTracker->mCurrentFrame.mstrLeftImgName;
     
-    if (first_call) {
+    if (!mbVisualizationPathSet) {
       mstrSaveVisualizationPath = pTracker->mvSaveVisualizationPath;
       mbVisualizationPathSet = true;
     }
-    
-    first_call = false;
 }
 
 } //namespace ORB_SLAM
@@ -22,14 +22,55 @@
 #include "Converter.h"
 #include "ORBmatcher.h"
 #include<mutex>
+#include<algorithm>
+#include<functional>
 
 namespace ORB_SLAM2
 {
 
-long unsigned int KeyFrame::nNextId=0;
+namespace
+{
+
+// Orders the flat (keyframe, weight) arrays by keyframe id
+bool KeyFrameLess(const pair<KeyFrame*,int> &a, KeyFrame* pKF)
+{
+    return a.first->mnId < pKF->mnId;
+}
+
+// Descending weight, ties broken by ascending keyframe id so that the
+// covisibility order does not depend on where the keyframes were allocated
+bool WeightGreater(const pair<int,KeyFrame*> &a, const pair<int,KeyFrame*> &b)
+{
+    if(a.first!=b.first)
+        return a.first > b.first;
+    return a.second->mnId < b.second->mnId;
+}
+
+vector<pair<KeyFrame*,int> >::iterator FindKeyFrame(vector<pair<KeyFrame*,int> > &vWeights, KeyFrame* pKF)
+{
+    vector<pair<KeyFrame*,int> >::iterator it = lower_bound(vWeights.begin(), vWeights.end(), pKF, KeyFrameLess);
+    if(it!=vWeights.end() && it->first==pKF)
+        return it;
+    return vWeights.end();
+}
+
+// Fills the keyframes and weights in descending order of weight
+void SortByWeight(vector<pair<int,KeyFrame*> > &vPairs, vector<KeyFrame*> &vpKFs, vector<int> &vWeights)
+{
+    sort(vPairs.begin(),vPairs.end(),WeightGreater);
+    vpKFs.resize(vPairs.size());
+    vWeights.resize(vPairs.size());
+    for(size_t i=0, iend=vPairs.size(); i<iend; i++)
+    {
+        vpKFs[i] = vPairs[i].second;
+        vWeights[i] = vPairs[i].first;
+    }
+}
+
+} // namespace
 
 KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
-    mnFrameId(F.mnId),  mTimeStamp(F.mTimeStamp), mnGridCols(FRAME_GRID_COLS), mnGridRows(FRAME_GRID_ROWS),
+    mpContext(F.mpContext), mnFrameId(F.mnId),  mTimeStamp(F.mTimeStamp), mnGridCols(FRAME_GRID_COLS), mnGridRows(FRAME_GRID_ROWS),
     mfGridElementWidthInv(F.mfGridElementWidthInv), mfGridElementHeightInv(F.mfGridElementHeightInv),
     mnTrackReferenceForFrame(0), mnFuseTargetForKF(0), mnBALocalForKF(0), mnBAFixedForKF(0),
     mnLoopQuery(0), mnLoopWords(0), mnRelocQuery(0), mnRelocWords(0),
@@ -48,7 +89,7 @@ KeyFrame::KeyFrame(Frame &F, Map *pMap, KeyFrameDatabase *pKFDB):
     mpORBvocabulary(F.mpORBvocabulary), mbFirstConnection(true), mpParent(NULL), mbNotErase(false),
     mbToBeErased(false), mbBad(false), mHalfBaseline(F.mb/2), mpMap(pMap)
 {
-    mnId=nNextId++;
+    mnId=mpContext->mnNextKeyFrameId++;
 
     mGrid.resize(mnGridCols);
     for(int i=0; i<mnGridCols;i++)
@@ -68,10 +109,9 @@ void KeyFrame::ComputeBoW()
   if (mpORBvocabulary) {
     if(mBowVec.empty() || mFeatVec.empty())
     {
-        vector<cv::Mat> vCurrentDesc = Converter::toDescriptorVector(mDescriptors);
         // Feature vector associate features with nodes in the 4th level (from leaves up)
         // We assume the vocabulary tree has 6 levels, change the 4 otherwise
-        mpORBvocabulary->transform(vCurrentDesc,mBowVec,mFeatVec,4);
+        mpORBvocabulary->transform(mDescriptors,mBowVec,mFeatVec,4,FLAGS_bow_transform_num_threads);
     }
   }
 }
@@ -90,6 +130,10 @@ void KeyFrame::SetPose(const cv::Mat &Tcw_)
     Ow.copyTo(Twc.rowRange(0,3).col(3));
     cv::Mat center = (cv::Mat_<float>(4,1) << mHalfBaseline, 0 , 0, 1);
     Cw = Twc*center;
+
+    mRcwEig = Converter::toMatrix3f(Rcw);
+    mtcwEig = Converter::toVector3f(tcw);
+    mOwEig = Converter::toVector3f(Ow);
 }
 
 cv::Mat KeyFrame::GetPose()
@@ -152,14 +196,33 @@ cv::Mat KeyFrame::GetTranslation()
     return Tcw.rowRange(0,3).col(3).clone();
 }
 
+Eigen::Vector3f KeyFrame::GetCameraCenterEig()
+{
+    unique_lock<mutex> lock(mMutexPose);
+    return mOwEig;
+}
+
+Eigen::Matrix3f KeyFrame::GetRotationEig()
+{
+    unique_lock<mutex> lock(mMutexPose);
+    return mRcwEig;
+}
+
+Eigen::Vector3f KeyFrame::GetTranslationEig()
+{
+    unique_lock<mutex> lock(mMutexPose);
+    return mtcwEig;
+}
+
 void KeyFrame::AddConnection(KeyFrame *pKF, const int &weight)
 {
     {
         unique_lock<mutex> lock(mMutexConnections);
-        if(!mConnectedKeyFrameWeights.count(pKF))
-            mConnectedKeyFrameWeights[pKF]=weight;
-        else if(mConnectedKeyFrameWeights[pKF]!=weight)
-            mConnectedKeyFrameWeights[pKF]=weight;
+        vector<pair<KeyFrame*,int> >::iterator it = lower_bound(mvConnectedKeyFrameWeights.begin(),mvConnectedKeyFrameWeights.end(),pKF,KeyFrameLess);
+        if(it==mvConnectedKeyFrameWeights.end() || it->first!=pKF)
+            mvConnectedKeyFrameWeights.insert(it,make_pair(pKF,weight));
+        else if(it->second!=weight)
+            it->second=weight;
         else
             return;
     }
@@ -171,29 +234,19 @@ void KeyFrame::UpdateBestCovisibles()
 {
     unique_lock<mutex> lock(mMutexConnections);
     vector<pair<int,KeyFrame*> > vPairs;
-    vPairs.reserve(mConnectedKeyFrameWeights.size());
-    for(map<KeyFrame*,int>::iterator mit=mConnectedKeyFrameWeights.begin(), mend=mConnectedKeyFrameWeights.end(); mit!=mend; mit++)
-       vPairs.push_back(make_pair(mit->second,mit->first));
-
-    sort(vPairs.begin(),vPairs.end());
-    list<KeyFrame*> lKFs;
-    list<int> lWs;
-    for(size_t i=0, iend=vPairs.size(); i<iend;i++)
-    {
-        lKFs.push_front(vPairs[i].second);
-        lWs.push_front(vPairs[i].first);
-    }
+    vPairs.reserve(mvConnectedKeyFrameWeights.size());
+    for(size_t i=0, iend=mvConnectedKeyFrameWeights.size(); i<iend; i++)
+       vPairs.push_back(make_pair(mvConnectedKeyFrameWeights[i].second,mvConnectedKeyFrameWeights[i].first));
 
-    mvpOrderedConnectedKeyFrames = vector<KeyFrame*>(lKFs.begin(),lKFs.end());
-    mvOrderedWeights = vector<int>(lWs.begin(), lWs.end());    
+    SortByWeight(vPairs, mvpOrderedConnectedKeyFrames, mvOrderedWeights);
 }
 
-set<KeyFrame*> KeyFrame::GetConnectedKeyFrames()
+set<KeyFrame*,IdLess> KeyFrame::GetConnectedKeyFrames()
 {
     unique_lock<mutex> lock(mMutexConnections);
-    set<KeyFrame*> s;
-    for(map<KeyFrame*,int>::iterator mit=mConnectedKeyFrameWeights.begin();mit!=mConnectedKeyFrameWeights.end();mit++)
-        s.insert(mit->first);
+    set<KeyFrame*,IdLess> s;
+    for(size_t i=0, iend=mvConnectedKeyFrameWeights.size(); i<iend; i++)
+        s.insert(mvConnectedKeyFrameWeights[i].first);
     return s;
 }
 
@@ -233,12 +286,29 @@ vector<KeyFrame*> KeyFrame::GetCovisiblesByWeight(const int &w)
 int KeyFrame::GetWeight(KeyFrame *pKF)
 {
     unique_lock<mutex> lock(mMutexConnections);
-    if(mConnectedKeyFrameWeights.count(pKF))
-        return mConnectedKeyFrameWeights[pKF];
+    vector<pair<KeyFrame*,int> >::iterator it = FindKeyFrame(mvConnectedKeyFrameWeights, pKF);
+    if(it!=mvConnectedKeyFrameWeights.end())
+        return it->second;
     else
         return 0;
 }
 
+void KeyFrame::ChangeCovisibility(KeyFrame *pKF, const int &n)
+{
+    unique_lock<mutex> lock(mMutexCovisibility);
+    vector<pair<KeyFrame*,int> >::iterator it = lower_bound(mvCovisibilityCounts.begin(),mvCovisibilityCounts.end(),pKF,KeyFrameLess);
+    if(it==mvCovisibilityCounts.end() || it->first!=pKF)
+    {
+        if(n>0)
+            mvCovisibilityCounts.insert(it,make_pair(pKF,n));
+        return;
+    }
+
+    it->second+=n;
+    if(it->second<=0)
+        mvCovisibilityCounts.erase(it);
+}
+
 void KeyFrame::AddMapPoint(MapPoint *pMP, const size_t &idx)
 {
     unique_lock<mutex> lock(mMutexFeatures);
@@ -320,39 +390,16 @@ MapPoint* KeyFrame::GetMapPoint(const size_t &idx)
 
 void KeyFrame::UpdateConnections()
 {
-    map<KeyFrame*,int> KFcounter;
-
-    vector<MapPoint*> vpMP;
-
+    // The number of MapPoints seen by this and every other keyframe is kept
+    // up to date by MapPoint::AddObservation/EraseObservation
+    vector<pair<KeyFrame*,int> > vKFcounter;
     {
-        unique_lock<mutex> lockMPs(mMutexFeatures);
-        vpMP = mvpMapPoints;
-    }
-
-    //For all map points in keyframe check in which other keyframes are they seen
-    //Increase counter for those keyframes
-    for(vector<MapPoint*>::iterator vit=vpMP.begin(), vend=vpMP.end(); vit!=vend; vit++)
-    {
-        MapPoint* pMP = *vit;
-
-        if(!pMP)
-            continue;
-
-        if(pMP->isBad())
-            continue;
-
-        map<KeyFrame*,size_t> observations = pMP->GetObservations();
-
-        for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
-        {
-            if(mit->first->mnId==mnId)
-                continue;
-            KFcounter[mit->first]++;
-        }
+        unique_lock<mutex> lock(mMutexCovisibility);
+        vKFcounter = mvCovisibilityCounts;
     }
 
     // This should not happen
-    if(KFcounter.empty())
+    if(vKFcounter.empty())
         return;
 
     //If the counter is greater than threshold add connection
@@ -362,18 +409,18 @@ void KeyFrame::UpdateConnections()
     int th = 15;
 
     vector<pair<int,KeyFrame*> > vPairs;
-    vPairs.reserve(KFcounter.size());
-    for(map<KeyFrame*,int>::iterator mit=KFcounter.begin(), mend=KFcounter.end(); mit!=mend; mit++)
+    vPairs.reserve(vKFcounter.size());
+    for(vector<pair<KeyFrame*,int> >::iterator vit=vKFcounter.begin(), vend=vKFcounter.end(); vit!=vend; vit++)
     {
-        if(mit->second>nmax)
+        if(vit->second>nmax)
         {
-            nmax=mit->second;
-            pKFmax=mit->first;
+            nmax=vit->second;
+            pKFmax=vit->first;
         }
-        if(mit->second>=th)
+        if(vit->second>=th)
         {
-            vPairs.push_back(make_pair(mit->second,mit->first));
-            (mit->first)->AddConnection(this,mit->second);
+            vPairs.push_back(make_pair(vit->second,vit->first));
+            (vit->first)->AddConnection(this,vit->second);
         }
     }
 
@@ -383,22 +430,17 @@ void KeyFrame::UpdateConnections()
         pKFmax->AddConnection(this,nmax);
     }
 
-    sort(vPairs.begin(),vPairs.end());
-    list<KeyFrame*> lKFs;
-    list<int> lWs;
-    for(size_t i=0; i<vPairs.size();i++)
-    {
-        lKFs.push_front(vPairs[i].second);
-        lWs.push_front(vPairs[i].first);
-    }
+    vector<KeyFrame*> vpOrderedKFs;
+    vector<int> vOrderedWeights;
+    SortByWeight(vPairs, vpOrderedKFs, vOrderedWeights);
 
     {
         unique_lock<mutex> lockCon(mMutexConnections);
 
         // mspConnectedKeyFrames = spConnectedKeyFrames;
-        mConnectedKeyFrameWeights = KFcounter;
-        mvpOrderedConnectedKeyFrames = vector<KeyFrame*>(lKFs.begin(),lKFs.end());
-        mvOrderedWeights = vector<int>(lWs.begin(), lWs.end());
+        mvConnectedKeyFrameWeights.swap(vKFcounter);
+        mvpOrderedConnectedKeyFrames.swap(vpOrderedKFs);
+        mvOrderedWeights.swap(vOrderedWeights);
 
         if(mbFirstConnection && mnId!=0)
         {
@@ -429,7 +471,7 @@ void KeyFrame::ChangeParent(KeyFrame *pKF)
     pKF->AddChild(this);
 }
 
-set<KeyFrame*> KeyFrame::GetChilds()
+set<KeyFrame*,IdLess> KeyFrame::GetChilds()
 {
     unique_lock<mutex> lockCon(mMutexConnections);
     return mspChildrens;
@@ -454,7 +496,7 @@ void KeyFrame::AddLoopEdge(KeyFrame *pKF)
     mspLoopEdges.insert(pKF);
 }
 
-set<KeyFrame*> KeyFrame::GetLoopEdges()
+set<KeyFrame*,IdLess> KeyFrame::GetLoopEdges()
 {
     unique_lock<mutex> lockCon(mMutexConnections);
     return mspLoopEdges;
@@ -495,8 +537,8 @@ void KeyFrame::SetBadFlag()
         }
     }
 
-    for(map<KeyFrame*,int>::iterator mit = mConnectedKeyFrameWeights.begin(), mend=mConnectedKeyFrameWeights.end(); mit!=mend; mit++)
-        mit->first->EraseConnection(this);
+    for(vector<pair<KeyFrame*,int> >::iterator vit = mvConnectedKeyFrameWeights.begin(), vend=mvConnectedKeyFrameWeights.end(); vit!=vend; vit++)
+        vit->first->EraseConnection(this);
 
     for(size_t i=0; i<mvpMapPoints.size(); i++)
         if(mvpMapPoints[i])
@@ -505,11 +547,11 @@ void KeyFrame::SetBadFlag()
         unique_lock<mutex> lock(mMutexConnections);
         unique_lock<mutex> lock1(mMutexFeatures);
 
-        mConnectedKeyFrameWeights.clear();
+        mvConnectedKeyFrameWeights.clear();
         mvpOrderedConnectedKeyFrames.clear();
 
         // Update Spanning Tree
-        set<KeyFrame*> sParentCandidates;
+        set<KeyFrame*,IdLess> sParentCandidates;
         sParentCandidates.insert(mpParent);
 
         // Assign at each iteration one children with a parent (the pair with highest covisibility weight)
@@ -522,7 +564,7 @@ void KeyFrame::SetBadFlag()
             KeyFrame* pC;
             KeyFrame* pP;
 
-            for(set<KeyFrame*>::iterator sit=mspChildrens.begin(), send=mspChildrens.end(); sit!=send; sit++)
+            for(set<KeyFrame*,IdLess>::iterator sit=mspChildrens.begin(), send=mspChildrens.end(); sit!=send; sit++)
             {
                 KeyFrame* pKF = *sit;
                 if(pKF->isBad())
@@ -532,7 +574,7 @@ void KeyFrame::SetBadFlag()
                 vector<KeyFrame*> vpConnected = pKF->GetVectorCovisibleKeyFrames();
                 for(size_t i=0, iend=vpConnected.size(); i<iend; i++)
                 {
-                    for(set<KeyFrame*>::iterator spcit=sParentCandidates.begin(), spcend=sParentCandidates.end(); spcit!=spcend; spcit++)
+                    for(set<KeyFrame*,IdLess>::iterator spcit=sParentCandidates.begin(), spcend=sParentCandidates.end(); spcit!=spcend; spcit++)
                     {
                         if(vpConnected[i]->mnId == (*spcit)->mnId)
                         {
@@ -561,7 +603,7 @@ void KeyFrame::SetBadFlag()
 
         // If a children has no covisibility links with any parent candidate, assign to the original parent of this KF
         if(!mspChildrens.empty())
-            for(set<KeyFrame*>::iterator sit=mspChildrens.begin(); sit!=mspChildrens.end(); sit++)
+            for(set<KeyFrame*,IdLess>::iterator sit=mspChildrens.begin(); sit!=mspChildrens.end(); sit++)
             {
                 (*sit)->ChangeParent(mpParent);
             }
@@ -592,9 +634,10 @@ void KeyFrame::EraseConnection(KeyFrame* pKF)
     bool bUpdate = false;
     {
         unique_lock<mutex> lock(mMutexConnections);
-        if(mConnectedKeyFrameWeights.count(pKF))
+        vector<pair<KeyFrame*,int> >::iterator it = FindKeyFrame(mvConnectedKeyFrameWeights, pKF);
+        if(it!=mvConnectedKeyFrameWeights.end())
         {
-            mConnectedKeyFrameWeights.erase(pKF);
+            mvConnectedKeyFrameWeights.erase(it);
             bUpdate=true;
         }
     }
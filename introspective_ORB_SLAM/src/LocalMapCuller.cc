@@ -0,0 +1,130 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "LocalMapCuller.h"
+#include "MapPoint.h"
+#include "Frame.h"
+
+#include <cmath>
+
+namespace ORB_SLAM2
+{
+
+void LocalMapCuller::SetMapPoints(const std::vector<MapPoint*> &vpMapPoints)
+{
+    mvpMapPoints = vpMapPoints;
+
+    const int N = mvpMapPoints.size();
+    mX.resize(N); mY.resize(N); mZ.resize(N);
+    mNx.resize(N); mNy.resize(N); mNz.resize(N);
+    mMinDistanceInv.resize(N); mMaxDistanceInv.resize(N); mMaxDistance.resize(N);
+
+    MapPoint::TrackingState state;
+    for(int i=0; i<N; i++)
+    {
+        mvpMapPoints[i]->GetTrackingState(state);
+        mX(i) = state.mWorldPos(0);
+        mY(i) = state.mWorldPos(1);
+        mZ(i) = state.mWorldPos(2);
+        mNx(i) = state.mNormalVector(0);
+        mNy(i) = state.mNormalVector(1);
+        mNz(i) = state.mNormalVector(2);
+        mMinDistanceInv(i) = state.GetMinDistanceInvariance();
+        mMaxDistanceInv(i) = state.GetMaxDistanceInvariance();
+        mMaxDistance(i) = state.mfMaxDistance;
+    }
+}
+
+int LocalMapCuller::Cull(const Frame &F, const float viewingCosLimit)
+{
+    mvpVisible.clear();
+    mvVisibleU.clear();
+    mvVisibleV.clear();
+    mvVisibleUR.clear();
+    mvVisibleViewCos.clear();
+    mvVisibleLevel.clear();
+
+    const int N = mvpMapPoints.size();
+    if(N==0)
+        return 0;
+
+    const Eigen::Matrix3f &Rcw = F.GetRotationEig();
+    const Eigen::Vector3f &tcw = F.GetTranslationEig();
+    const Eigen::Vector3f &Ow = F.GetCameraCenterEig();
+
+    // 3D in camera coordinates
+    mPcX = Rcw(0,0)*mX + Rcw(0,1)*mY + Rcw(0,2)*mZ + tcw(0);
+    mPcY = Rcw(1,0)*mX + Rcw(1,1)*mY + Rcw(1,2)*mZ + tcw(1);
+    mPcZ = Rcw(2,0)*mX + Rcw(2,1)*mY + Rcw(2,2)*mZ + tcw(2);
+
+    // Projection in the image
+    mInvZ = mPcZ.inverse();
+    mU = F.fx*mPcX*mInvZ + F.cx;
+    mV = F.fy*mPcY*mInvZ + F.cy;
+
+    // Distance and viewing angle from the camera center
+    mPOx = mX - Ow(0);
+    mPOy = mY - Ow(1);
+    mPOz = mZ - Ow(2);
+    mDist = (mPOx.square() + mPOy.square() + mPOz.square()).sqrt();
+    mViewCos = (mPOx*mNx + mPOy*mNy + mPOz*mNz)/mDist;
+
+    // Positive depth, inside the image, inside the scale invariance region
+    // and viewing angle below the limit
+    mbInView = (mPcZ>=0.0f) &&
+               (mU>=F.mnMinX) && (mU<=F.mnMaxX) &&
+               (mV>=F.mnMinY) && (mV<=F.mnMaxY) &&
+               (mDist>=mMinDistanceInv) && (mDist<=mMaxDistanceInv) &&
+               (mViewCos>=viewingCosLimit);
+
+    // Scale prediction, see MapPoint::PredictScale
+    mLogRatio = (mMaxDistance/mDist).log()/F.mfLogScaleFactor;
+
+    const int nMaxLevel = F.mnScaleLevels-1;
+    for(int i=0; i<N; i++)
+    {
+        if(!mbInView(i))
+            continue;
+
+        MapPoint* pMP = mvpMapPoints[i];
+        if(pMP->mnLastFrameSeen==F.mnId)
+            continue;
+        if(pMP->isBadLockFree())
+            continue;
+
+        int nLevel = std::ceil(mLogRatio(i));
+        if(nLevel<0)
+            nLevel = 0;
+        else if(nLevel>nMaxLevel)
+            nLevel = nMaxLevel;
+
+        mvpVisible.push_back(pMP);
+        mvVisibleU.push_back(mU(i));
+        mvVisibleV.push_back(mV(i));
+        mvVisibleUR.push_back(mU(i) - F.mbf*mInvZ(i));
+        mvVisibleViewCos.push_back(mViewCos(i));
+        mvVisibleLevel.push_back(nLevel);
+    }
+
+    return mvpVisible.size();
+}
+
+} //namespace ORB_SLAM
@@ -28,9 +28,28 @@
 
 #include "ORBmatcher.h"
 
+#include<algorithm>
+#include<chrono>
 #include<mutex>
 #include<thread>
 
+// Leaves two cores to tracking and local mapping, which run next to the GBA
+static int DefaultGlobalBANumThreads()
+{
+    const int nCores = (int)std::thread::hardware_concurrency();
+    return std::max(1, std::min(4, nCores - 2));
+}
+
+DEFINE_int32(global_ba_num_threads, DefaultGlobalBANumThreads(),
+             "Number of threads used by the global BA after a loop closure "
+             "to linearize the problem. Only has an effect if g2o is built "
+             "with OpenMP. Defaults to the number of cores minus the two "
+             "used by tracking and local mapping, between 1 and 4.");
+DEFINE_int32(global_ba_map_update_chunk_size, 1000,
+             "Number of map points corrected at a time after a global BA. "
+             "Tracking can only run between chunks, so smaller chunks shorten "
+             "its stalls.");
+
 
 namespace ORB_SLAM2
 {
@@ -38,7 +57,7 @@ namespace ORB_SLAM2
 LoopClosing::LoopClosing(Map *pMap, KeyFrameDatabase *pDB, ORBVocabulary *pVoc, const bool bFixScale):
     mbResetRequested(false), mbFinishRequested(false), mbFinished(true), mpMap(pMap),
     mpKeyFrameDB(pDB), mpORBVocabulary(pVoc), mpMatchedKF(NULL), mLastLoopKFid(0), mbRunningGBA(false), mbFinishedGBA(true),
-    mbStopGBA(false), mpThreadGBA(NULL), mbFixScale(bFixScale), mnFullBAIdx(0)
+    mbStopGBA(false), mpThreadGBA(NULL), mbFixScale(bFixScale), mnFullBAIdx(0), mbInline(false)
 {
     mnCovisibilityConsistencyTh = 3;
 }
@@ -53,6 +72,25 @@ void LoopClosing::SetLocalMapper(LocalMapping *pLocalMapper)
     mpLocalMapper=pLocalMapper;
 }
 
+void LoopClosing::SetInlineMode(const bool bInline)
+{
+    mbInline=bInline;
+}
+
+void LoopClosing::LoopOnce()
+{
+    while(CheckNewKeyFrames())
+    {
+        if(DetectLoop())
+        {
+            if(ComputeSim3())
+                CorrectLoop();
+        }
+    }
+
+    ResetIfRequested();
+}
+
 
 void LoopClosing::Run()
 {
@@ -166,17 +204,17 @@ bool LoopClosing::DetectLoop()
     {
         KeyFrame* pCandidateKF = vpCandidateKFs[i];
 
-        set<KeyFrame*> spCandidateGroup = pCandidateKF->GetConnectedKeyFrames();
+        set<KeyFrame*,IdLess> spCandidateGroup = pCandidateKF->GetConnectedKeyFrames();
         spCandidateGroup.insert(pCandidateKF);
 
         bool bEnoughConsistent = false;
         bool bConsistentForSomeGroup = false;
         for(size_t iG=0, iendG=mvConsistentGroups.size(); iG<iendG; iG++)
         {
-            set<KeyFrame*> sPreviousGroup = mvConsistentGroups[iG].first;
+            set<KeyFrame*,IdLess> sPreviousGroup = mvConsistentGroups[iG].first;
 
             bool bConsistent = false;
-            for(set<KeyFrame*>::iterator sit=spCandidateGroup.begin(), send=spCandidateGroup.end(); sit!=send;sit++)
+            for(set<KeyFrame*,IdLess>::iterator sit=spCandidateGroup.begin(), send=spCandidateGroup.end(); sit!=send;sit++)
             {
                 if(sPreviousGroup.count(*sit))
                 {
@@ -410,7 +448,9 @@ void LoopClosing::CorrectLoop()
 
     // Send a stop signal to Local Mapping
     // Avoid new keyframes are inserted while correcting the loop
-    mpLocalMapper->RequestStop();
+    // Inline, the local mapper runs in the same thread and is already idle
+    if(!mbInline)
+        mpLocalMapper->RequestStop();
 
     // If a Global Bundle Adjustment is running, abort it
     if(isRunningGBA())
@@ -428,7 +468,7 @@ void LoopClosing::CorrectLoop()
     }
 
     // Wait until Local Mapping has effectively stopped
-    while(!mpLocalMapper->isStopped())
+    while(!mbInline && !mpLocalMapper->isStopped())
     {
         usleep(1000);
     }
@@ -548,7 +588,7 @@ void LoopClosing::CorrectLoop()
 
 
     // After the MapPoint fusion, new links in the covisibility graph will appear attaching both sides of the loop
-    map<KeyFrame*, set<KeyFrame*> > LoopConnections;
+    map<KeyFrame*, set<KeyFrame*,IdLess>, IdLess> LoopConnections;
 
     for(vector<KeyFrame*>::iterator vit=mvpCurrentConnectedKFs.begin(), vend=mvpCurrentConnectedKFs.end(); vit!=vend; vit++)
     {
@@ -577,14 +617,22 @@ void LoopClosing::CorrectLoop()
     mpMatchedKF->AddLoopEdge(mpCurrentKF);
     mpCurrentKF->AddLoopEdge(mpMatchedKF);
 
-    // Launch a new thread to perform Global Bundle Adjustment
+    // Launch a new thread to perform Global Bundle Adjustment, or run it
+    // right away in inline mode
     mbRunningGBA = true;
     mbFinishedGBA = false;
     mbStopGBA = false;
-    mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment,this,mpCurrentKF->mnId);
+    if(mbInline)
+    {
+        RunGlobalBundleAdjustment(mpCurrentKF->mnId);
+    }
+    else
+    {
+        mpThreadGBA = new thread(&LoopClosing::RunGlobalBundleAdjustment,this,mpCurrentKF->mnId);
 
-    // Loop closed. Release Local Mapping.
-    mpLocalMapper->Release();    
+        // Loop closed. Release Local Mapping.
+        mpLocalMapper->Release();
+    }
 
     mLastLoopKFid = mpCurrentKF->mnId;   
 }
@@ -625,6 +673,12 @@ void LoopClosing::RequestReset()
         mbResetRequested = true;
     }
 
+    if(mbInline)
+    {
+        ResetIfRequested();
+        return;
+    }
+
     while(1)
     {
         {
@@ -652,7 +706,10 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
     cout << "Starting Global Bundle Adjustment" << endl;
 
     int idx =  mnFullBAIdx;
-    Optimizer::GlobalBundleAdjustemnt(mpMap,10,&mbStopGBA,nLoopKF,false);
+    // Inline, the result must not depend on the order in which the threads
+    // accumulate the Hessian
+    const int nThreads = mbInline ? 1 : FLAGS_global_ba_num_threads;
+    Optimizer::GlobalBundleAdjustemnt(mpMap,10,&mbStopGBA,nLoopKF,false,nThreads);
 
     // Update all MapPoints and KeyFrames
     // Local Mapping was active during BA, that means that there might be new keyframes
@@ -667,90 +724,125 @@ void LoopClosing::RunGlobalBundleAdjustment(unsigned long nLoopKF)
         {
             cout << "Global Bundle Adjustment finished" << endl;
             cout << "Updating map ..." << endl;
-            mpLocalMapper->RequestStop();
+            if(!mbInline)
+                mpLocalMapper->RequestStop();
             // Wait until Local Mapping has effectively stopped
 
-            while(!mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
+            while(!mbInline && !mpLocalMapper->isStopped() && !mpLocalMapper->isFinished())
             {
                 usleep(1000);
             }
 
-            // Get Map Mutex
-            unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+            UpdateMapAfterGBA(nLoopKF);
+
+            mpMap->InformNewBigChange();
+
+            if(!mbInline)
+                mpLocalMapper->Release();
+
+            cout << "Map updated!" << endl;
+        }
+
+        mbFinishedGBA = true;
+        mbRunningGBA = false;
+    }
+}
+
+void LoopClosing::UpdateMapAfterGBA(const unsigned long nLoopKF)
+{
+    const chrono::steady_clock::time_point tStart = chrono::steady_clock::now();
+    int nChunks = 0;
+    double maxLockMs = 0;
 
-            // Correct keyframes starting at map first keyframe
-            list<KeyFrame*> lpKFtoCheck(mpMap->mvpKeyFrameOrigins.begin(),mpMap->mvpKeyFrameOrigins.end());
+    // Correct keyframes starting at map first keyframe. There are few of them,
+    // so they are all corrected at once.
+    {
+        const chrono::steady_clock::time_point tLock = chrono::steady_clock::now();
+        unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
 
-            while(!lpKFtoCheck.empty())
+        vector<KeyFrame*> vpKFtoCheck(mpMap->mvpKeyFrameOrigins.begin(),mpMap->mvpKeyFrameOrigins.end());
+        for(size_t i=0; i<vpKFtoCheck.size(); i++)
+        {
+            KeyFrame* pKF = vpKFtoCheck[i];
+            const set<KeyFrame*,IdLess> sChilds = pKF->GetChilds();
+            cv::Mat Twc = pKF->GetPoseInverse();
+            for(set<KeyFrame*,IdLess>::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
             {
-                KeyFrame* pKF = lpKFtoCheck.front();
-                const set<KeyFrame*> sChilds = pKF->GetChilds();
-                cv::Mat Twc = pKF->GetPoseInverse();
-                for(set<KeyFrame*>::const_iterator sit=sChilds.begin();sit!=sChilds.end();sit++)
+                KeyFrame* pChild = *sit;
+                if(pChild->mnBAGlobalForKF!=nLoopKF)
                 {
-                    KeyFrame* pChild = *sit;
-                    if(pChild->mnBAGlobalForKF!=nLoopKF)
-                    {
-                        cv::Mat Tchildc = pChild->GetPose()*Twc;
-                        pChild->mTcwGBA = Tchildc*pKF->mTcwGBA;//*Tcorc*pKF->mTcwGBA;
-                        pChild->mnBAGlobalForKF=nLoopKF;
-
-                    }
-                    lpKFtoCheck.push_back(pChild);
-                }
+                    cv::Mat Tchildc = pChild->GetPose()*Twc;
+                    pChild->mTcwGBA = Tchildc*pKF->mTcwGBA;//*Tcorc*pKF->mTcwGBA;
+                    pChild->mnBAGlobalForKF=nLoopKF;
 
-                pKF->mTcwBefGBA = pKF->GetPose();
-                pKF->SetPose(pKF->mTcwGBA);
-                lpKFtoCheck.pop_front();
+                }
+                vpKFtoCheck.push_back(pChild);
             }
 
-            // Correct MapPoints
-            const vector<MapPoint*> vpMPs = mpMap->GetAllMapPoints();
+            pKF->mTcwBefGBA = pKF->GetPose();
+            pKF->SetPose(pKF->mTcwGBA);
+        }
 
-            for(size_t i=0; i<vpMPs.size(); i++)
-            {
-                MapPoint* pMP = vpMPs[i];
+        nChunks++;
+        maxLockMs = chrono::duration<double,milli>(chrono::steady_clock::now()-tLock).count();
+    }
 
-                if(pMP->isBad())
-                    continue;
+    // Correct MapPoints. The map is released after every chunk so that
+    // tracking can go on, at the cost of seeing a partly corrected map.
+    const vector<MapPoint*> vpMPs = mpMap->GetAllMapPoints();
+    const size_t nChunkSize = max(FLAGS_global_ba_map_update_chunk_size, 1);
 
-                if(pMP->mnBAGlobalForKF==nLoopKF)
-                {
-                    // If optimized by Global BA, just update
-                    pMP->SetWorldPos(pMP->mPosGBA);
-                }
-                else
-                {
-                    // Update according to the correction of its reference keyframe
-                    KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
+    for(size_t iStart=0; iStart<vpMPs.size(); iStart+=nChunkSize)
+    {
+        // Give a waiting tracking thread the chance to take the map
+        if(!mbInline)
+            usleep(100);
 
-                    if(pRefKF->mnBAGlobalForKF!=nLoopKF)
-                        continue;
+        const chrono::steady_clock::time_point tLock = chrono::steady_clock::now();
+        unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
 
-                    // Map to non-corrected camera
-                    cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
-                    cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
-                    cv::Mat Xc = Rcw*pMP->GetWorldPos()+tcw;
+        const size_t iEnd = min(iStart+nChunkSize, vpMPs.size());
+        for(size_t i=iStart; i<iEnd; i++)
+        {
+            MapPoint* pMP = vpMPs[i];
 
-                    // Backproject using corrected camera
-                    cv::Mat Twc = pRefKF->GetPoseInverse();
-                    cv::Mat Rwc = Twc.rowRange(0,3).colRange(0,3);
-                    cv::Mat twc = Twc.rowRange(0,3).col(3);
+            if(pMP->isBad())
+                continue;
 
-                    pMP->SetWorldPos(Rwc*Xc+twc);
-                }
-            }            
+            if(pMP->mnBAGlobalForKF==nLoopKF)
+            {
+                // If optimized by Global BA, just update
+                pMP->SetWorldPos(pMP->mPosGBA);
+            }
+            else
+            {
+                // Update according to the correction of its reference keyframe
+                KeyFrame* pRefKF = pMP->GetReferenceKeyFrame();
 
-            mpMap->InformNewBigChange();
+                if(pRefKF->mnBAGlobalForKF!=nLoopKF)
+                    continue;
 
-            mpLocalMapper->Release();
+                // Map to non-corrected camera
+                cv::Mat Rcw = pRefKF->mTcwBefGBA.rowRange(0,3).colRange(0,3);
+                cv::Mat tcw = pRefKF->mTcwBefGBA.rowRange(0,3).col(3);
+                cv::Mat Xc = Rcw*pMP->GetWorldPos()+tcw;
 
-            cout << "Map updated!" << endl;
+                // Backproject using corrected camera
+                cv::Mat Twc = pRefKF->GetPoseInverse();
+                cv::Mat Rwc = Twc.rowRange(0,3).colRange(0,3);
+                cv::Mat twc = Twc.rowRange(0,3).col(3);
+
+                pMP->SetWorldPos(Rwc*Xc+twc);
+            }
         }
 
-        mbFinishedGBA = true;
-        mbRunningGBA = false;
+        nChunks++;
+        maxLockMs = max(maxLockMs, chrono::duration<double,milli>(chrono::steady_clock::now()-tLock).count());
     }
+
+    const double totalMs = chrono::duration<double,milli>(chrono::steady_clock::now()-tStart).count();
+    cout << "Map update took " << totalMs << " ms in " << nChunks << " chunks, longest map lock "
+         << maxLockMs << " ms" << endl;
 }
 
 void LoopClosing::RequestFinish()
@@ -20,12 +20,13 @@
 
 #include "Map.h"
 
+#include<algorithm>
 #include<mutex>
 
 namespace ORB_SLAM2
 {
 
-Map::Map():mnMaxKFid(0),mnBigChangeIdx(0)
+Map::Map():mnMaxKFid(0),mnBigChangeIdx(0),mbLogMapPointChanges(false),mbClearedSinceLastTake(false)
 {
 }
 
@@ -41,6 +42,8 @@ void Map::AddMapPoint(MapPoint *pMP)
 {
     unique_lock<mutex> lock(mMutexMap);
     mspMapPoints.insert(pMP);
+    if(mbLogMapPointChanges)
+        msChangedMapPoints.insert(pMP);
 }
 
 void Map::EraseMapPoint(MapPoint *pMP)
@@ -48,6 +51,8 @@ void Map::EraseMapPoint(MapPoint *pMP)
     unique_lock<mutex> lock(mMutexMap);
     mspMapPoints.erase(pMP);
     mspMapPointsToRemove.insert(pMP);
+    if(mbLogMapPointChanges)
+        msChangedMapPoints.insert(pMP);
 
     // TODO: This only erase the pointer.
     // Delete the MapPoint
@@ -82,14 +87,25 @@ int Map::GetLastBigChangeIdx()
 
 vector<KeyFrame*> Map::GetAllKeyFrames()
 {
-    unique_lock<mutex> lock(mMutexMap);
-    return vector<KeyFrame*>(mspKeyFrames.begin(),mspKeyFrames.end());
+    vector<KeyFrame*> vpKFs;
+    {
+        unique_lock<mutex> lock(mMutexMap);
+        vpKFs.assign(mspKeyFrames.begin(),mspKeyFrames.end());
+    }
+    // The sets are keyed by address, return them in id order
+    sort(vpKFs.begin(),vpKFs.end(),IdLess());
+    return vpKFs;
 }
 
 vector<MapPoint*> Map::GetAllMapPoints()
 {
-    unique_lock<mutex> lock(mMutexMap);
-    return vector<MapPoint*>(mspMapPoints.begin(),mspMapPoints.end());
+    vector<MapPoint*> vpMPs;
+    {
+        unique_lock<mutex> lock(mMutexMap);
+        vpMPs.assign(mspMapPoints.begin(),mspMapPoints.end());
+    }
+    sort(vpMPs.begin(),vpMPs.end(),IdLess());
+    return vpMPs;
 }
 
 long unsigned int Map::MapPointsInMap()
@@ -116,6 +132,42 @@ long unsigned int Map::GetMaxKFid()
     return mnMaxKFid;
 }
 
+void Map::EnableMapPointChangeLog()
+{
+    unique_lock<mutex> lock(mMutexMap);
+    mbLogMapPointChanges = true;
+}
+
+void Map::InformMapPointChanged(MapPoint *pMP)
+{
+    // Skip the map lock when no one consumes the change log
+    if(!mbLogMapPointChanges)
+        return;
+
+    unique_lock<mutex> lock(mMutexMap);
+    msChangedMapPoints.insert(pMP);
+}
+
+vector<MapPoint*> Map::TakeMapPointChanges(bool &bCleared)
+{
+    unique_lock<mutex> lock(mMutexMap);
+    bCleared = mbClearedSinceLastTake;
+    mbClearedSinceLastTake = false;
+
+    vector<MapPoint*> vpChanged;
+    vpChanged.reserve(msChangedMapPoints.size());
+    for(unordered_set<MapPoint*>::iterator sit=msChangedMapPoints.begin(), send=msChangedMapPoints.end(); sit!=send; sit++)
+    {
+        // Temporal points created by the tracking are never added to the map
+        // and are deleted right away. Only report points the map owns.
+        if(mspMapPoints.count(*sit) || mspMapPointsToRemove.count(*sit))
+            vpChanged.push_back(*sit);
+    }
+    msChangedMapPoints.clear();
+
+    return vpChanged;
+}
+
 void Map::clear()
 {
     for(set<MapPoint*>::iterator sit=mspMapPoints.begin(), send=mspMapPoints.end(); sit!=send; sit++)
@@ -131,6 +183,8 @@ void Map::clear()
     
     mspMapPoints.clear();
     mspMapPointsToRemove.clear();
+    msChangedMapPoints.clear();
+    mbClearedSinceLastTake = true;
     mspKeyFrames.clear();
     mnMaxKFid = 0;
     mvpReferenceMapPoints.clear();
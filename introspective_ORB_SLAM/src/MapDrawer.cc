@@ -264,8 +264,8 @@ glVertex3f(Ow2.at<float>(0),Ow2.at<float>(1),Ow2.at<float>(2));
             }
 
             // Loops
-            set<KeyFrame*> sLoopKFs = vpKFs[i]->GetLoopEdges();
-            for(set<KeyFrame*>::iterator sit=sLoopKFs.begin(), 
+            set<KeyFrame*,IdLess> sLoopKFs = vpKFs[i]->GetLoopEdges();
+            for(set<KeyFrame*,IdLess>::iterator sit=sLoopKFs.begin(), 
 send=sLoopKFs.end(); sit!=send; sit++)
             {
                 if((*sit)->mnId<vpKFs[i]->mnId)
@@ -406,6 +406,18 @@ void MapDrawer::SetCurrentCameraPosewithGT(const cv::Mat &Tcw,
     mstrFrameName = strFrameName.substr(0, strFrameName.length()-4);
 }
 
+void MapDrawer::GetCurrentCameraState(cv::Mat &Tcw, cv::Mat &Twc_gt,
+                                      std::string &strFrameName)
+{
+    unique_lock<mutex> lock(mMutexCamera);
+    Tcw = mCameraPose.clone();
+    if(mbGTPoseAvailable)
+        Twc_gt = mTwc_gt.clone();
+    else
+        Twc_gt.release();
+    strFrameName = mstrFrameName;
+}
+
 void MapDrawer::GetCurrentOpenGLCameraMatrix(pangolin::OpenGlMatrix &M)
 {
     if(!mCameraPose.empty())
@@ -20,8 +20,10 @@
 
 #include "MapPoint.h"
 #include "ORBmatcher.h"
+#include "Converter.h"
 
 #include<mutex>
+#include<cstring>
 
 DEFINE_bool(ivslam_propagate_keyptqual, false, "Propagates the predicted "
              "keypoint quality scores to the matched map point. If enabled "
@@ -31,36 +33,36 @@ DEFINE_bool(ivslam_propagate_keyptqual, false, "Propagates the predicted "
 namespace ORB_SLAM2
 {
 
-long unsigned int MapPoint::nNextId=0;
-mutex MapPoint::mGlobalMutex;
-
 MapPoint::MapPoint(const cv::Mat &Pos, KeyFrame *pRefKF, Map* pMap):
     mnFirstKFid(pRefKF->mnId), mnFirstFrame(pRefKF->mnFrameId), nObs(0), mnTrackReferenceForFrame(0),
     mnLastFrameSeen(0), mnBALocalForKF(0), mnFuseCandidateForKF(0), mnLoopPointForKF(0), mnCorrectedByKF(0),
     mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(pRefKF), mnVisible(1), mnFound(1), mbBad(false),
-    mpReplaced(static_cast<MapPoint*>(NULL)), mfMinDistance(0), mfMaxDistance(0), mpMap(pMap)
+    mpReplaced(static_cast<MapPoint*>(NULL)), mfMinDistance(0), mfMaxDistance(0), mpMap(pMap),
+    mpContext(pRefKF->mpContext), mnTrackingStateSeq(0)
 {
-    Pos.copyTo(mWorldPos);
-    mNormalVector = cv::Mat::zeros(3,1,CV_32F);
+    mWorldPos = Converter::toVector3f(Pos);
+    mNormalVector.setZero();
+
+    PublishTrackingState();
 
     // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
     unique_lock<mutex> lock(mpMap->mMutexPointCreation);
-    mnId=nNextId++;
+    mnId=mpContext->mnNextMapPointId++;
 }
 
 MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF):
     mnFirstKFid(-1), mnFirstFrame(pFrame->mnId), nObs(0), mnTrackReferenceForFrame(0), mnLastFrameSeen(0),
     mnBALocalForKF(0), mnFuseCandidateForKF(0),mnLoopPointForKF(0), mnCorrectedByKF(0),
     mnCorrectedReference(0), mnBAGlobalForKF(0), mpRefKF(static_cast<KeyFrame*>(NULL)), mnVisible(1),
-    mnFound(1), mbBad(false), mpReplaced(NULL), mpMap(pMap)
+    mnFound(1), mbBad(false), mpReplaced(NULL), mpMap(pMap), mpContext(pFrame->mpContext),
+    mnTrackingStateSeq(0)
 {
-    Pos.copyTo(mWorldPos);
-    cv::Mat Ow = pFrame->GetCameraCenter();
-    mNormalVector = mWorldPos - Ow;
-    mNormalVector = mNormalVector/cv::norm(mNormalVector);
+    mWorldPos = Converter::toVector3f(Pos);
+    const Eigen::Vector3f Ow = pFrame->GetCameraCenterEig();
+    const Eigen::Vector3f PC = mWorldPos - Ow;
+    const float dist = PC.norm();
+    mNormalVector = PC/dist;
 
-    cv::Mat PC = Pos - Ow;
-    const float dist = cv::norm(PC);
     const int level = pFrame->mvKeysUn[idxF].octave;
     const float levelScaleFactor =  pFrame->mvScaleFactors[level];
     const int nLevels = pFrame->mnScaleLevels;
@@ -70,28 +72,49 @@ MapPoint::MapPoint(const cv::Mat &Pos, Map* pMap, Frame* pFrame, const int &idxF
 
     pFrame->mDescriptors.row(idxF).copyTo(mDescriptor);
 
+    PublishTrackingState();
+
     // MapPoints can be created from Tracking and Local Mapping. This mutex avoid conflicts with id.
     unique_lock<mutex> lock(mpMap->mMutexPointCreation);
-    mnId=nNextId++;
+    mnId=mpContext->mnNextMapPointId++;
 }
 
 void MapPoint::SetWorldPos(const cv::Mat &Pos)
 {
-    unique_lock<mutex> lock2(mGlobalMutex);
-    unique_lock<mutex> lock(mMutexPos);
-    Pos.copyTo(mWorldPos);
+    SetWorldPos(Converter::toVector3f(Pos));
+}
+
+void MapPoint::SetWorldPos(const Eigen::Vector3f &Pos)
+{
+    {
+        unique_lock<mutex> lock2(mpContext->mMutexPointPos);
+        unique_lock<mutex> lock(mMutexPos);
+        mWorldPos = Pos;
+    }
+    PublishTrackingState();
+    mpMap->InformMapPointChanged(this);
 }
 
 cv::Mat MapPoint::GetWorldPos()
+{
+    return Converter::toCvMat(GetWorldPosEig());
+}
+
+Eigen::Vector3f MapPoint::GetWorldPosEig()
 {
     unique_lock<mutex> lock(mMutexPos);
-    return mWorldPos.clone();
+    return mWorldPos;
 }
 
 cv::Mat MapPoint::GetNormal()
+{
+    return Converter::toCvMat(GetNormalEig());
+}
+
+Eigen::Vector3f MapPoint::GetNormalEig()
 {
     unique_lock<mutex> lock(mMutexPos);
-    return mNormalVector.clone();
+    return mNormalVector;
 }
 
 KeyFrame* MapPoint::GetReferenceKeyFrame()
@@ -102,15 +125,30 @@ KeyFrame* MapPoint::GetReferenceKeyFrame()
 
 void MapPoint::AddObservation(KeyFrame* pKF, size_t idx)
 {
-    unique_lock<mutex> lock(mMutexFeatures);
-    if(mObservations.count(pKF))
-        return;
-    mObservations[pKF]=idx;
+    {
+        unique_lock<mutex> lock(mMutexFeatures);
+        if(mObservations.count(pKF))
+            return;
 
-    if(pKF->mvuRight[idx]>=0)
-        nObs+=2;
-    else
-        nObs++;
+        // Keep the covisibility counters of the keyframes up to date
+        if(!mbBad)
+        {
+            for(map<KeyFrame*,size_t,IdLess>::iterator mit=mObservations.begin(), mend=mObservations.end(); mit!=mend; mit++)
+            {
+                mit->first->ChangeCovisibility(pKF,1);
+                pKF->ChangeCovisibility(mit->first,1);
+            }
+        }
+
+        mObservations[pKF]=idx;
+
+        if(pKF->mvuRight[idx]>=0)
+            nObs+=2;
+        else
+            nObs++;
+    }
+
+    PublishTrackingState();
 }
 
 void MapPoint::EraseObservation(KeyFrame* pKF)
@@ -128,6 +166,25 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
 
             mObservations.erase(pKF);
 
+            for(size_t i=0; i<mvObservationChi2.size(); i++)
+            {
+                if(mvObservationChi2[i].pKF==pKF)
+                {
+                    mvObservationChi2[i] = mvObservationChi2.back();
+                    mvObservationChi2.pop_back();
+                    break;
+                }
+            }
+
+            if(!mbBad)
+            {
+                for(map<KeyFrame*,size_t,IdLess>::iterator mit=mObservations.begin(), mend=mObservations.end(); mit!=mend; mit++)
+                {
+                    mit->first->ChangeCovisibility(pKF,-1);
+                    pKF->ChangeCovisibility(mit->first,-1);
+                }
+            }
+
             if(mpRefKF==pKF)
                 mpRefKF=mObservations.begin()->first;
 
@@ -139,14 +196,23 @@ void MapPoint::EraseObservation(KeyFrame* pKF)
 
     if(bBad)
         SetBadFlag();
+    else
+        PublishTrackingState();
 }
 
-map<KeyFrame*, size_t> MapPoint::GetObservations()
+map<KeyFrame*,size_t,IdLess> MapPoint::GetObservations()
 {
     unique_lock<mutex> lock(mMutexFeatures);
     return mObservations;
 }
 
+void MapPoint::GetObservingKeyFrames(vector<KeyFrame*> &vpKFs)
+{
+    unique_lock<mutex> lock(mMutexFeatures);
+    for(map<KeyFrame*,size_t,IdLess>::const_iterator mit=mObservations.begin(), mend=mObservations.end(); mit!=mend; mit++)
+        vpKFs.push_back(mit->first);
+}
+
 int MapPoint::Observations()
 {
     unique_lock<mutex> lock(mMutexFeatures);
@@ -155,20 +221,24 @@ int MapPoint::Observations()
 
 void MapPoint::SetBadFlag()
 {
-    map<KeyFrame*,size_t> obs;
+    map<KeyFrame*,size_t,IdLess> obs;
     {
         unique_lock<mutex> lock1(mMutexFeatures);
         unique_lock<mutex> lock2(mMutexPos);
+        if(!mbBad)
+            EraseCovisibility(mObservations);
         mbBad=true;
         obs = mObservations;
         mObservations.clear();
+        mvObservationChi2.clear();
     }
-    for(map<KeyFrame*,size_t>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
+    for(map<KeyFrame*,size_t,IdLess>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
     {
         KeyFrame* pKF = mit->first;
         pKF->EraseMapPointMatch(mit->second);
     }
 
+    PublishTrackingState();
     mpMap->EraseMapPoint(this);
 }
 
@@ -185,19 +255,22 @@ void MapPoint::Replace(MapPoint* pMP)
         return;
 
     int nvisible, nfound;
-    map<KeyFrame*,size_t> obs;
+    map<KeyFrame*,size_t,IdLess> obs;
     {
         unique_lock<mutex> lock1(mMutexFeatures);
         unique_lock<mutex> lock2(mMutexPos);
+        if(!mbBad)
+            EraseCovisibility(mObservations);
         obs=mObservations;
         mObservations.clear();
+        mvObservationChi2.clear();
         mbBad=true;
         nvisible = mnVisible;
         nfound = mnFound;
         mpReplaced = pMP;
     }
 
-    for(map<KeyFrame*,size_t>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
+    for(map<KeyFrame*,size_t,IdLess>::iterator mit=obs.begin(), mend=obs.end(); mit!=mend; mit++)
     {
         // Replace measurement in keyframe
         KeyFrame* pKF = mit->first;
@@ -216,9 +289,23 @@ void MapPoint::Replace(MapPoint* pMP)
     pMP->IncreaseVisible(nvisible);
     pMP->ComputeDistinctiveDescriptors();
 
+    PublishTrackingState();
     mpMap->EraseMapPoint(this);
 }
 
+void MapPoint::EraseCovisibility(const map<KeyFrame*,size_t,IdLess> &observations)
+{
+    for(map<KeyFrame*,size_t,IdLess>::const_iterator mit1=observations.begin(), mend=observations.end(); mit1!=mend; mit1++)
+    {
+        map<KeyFrame*,size_t,IdLess>::const_iterator mit2=mit1;
+        for(mit2++; mit2!=mend; mit2++)
+        {
+            mit1->first->ChangeCovisibility(mit2->first,-1);
+            mit2->first->ChangeCovisibility(mit1->first,-1);
+        }
+    }
+}
+
 bool MapPoint::isBad()
 {
     unique_lock<mutex> lock(mMutexFeatures);
@@ -249,7 +336,7 @@ void MapPoint::ComputeDistinctiveDescriptors()
     // Retrieve all observed descriptors
     vector<cv::Mat> vDescriptors;
 
-    map<KeyFrame*,size_t> observations;
+    map<KeyFrame*,size_t,IdLess> observations;
 
     {
         unique_lock<mutex> lock1(mMutexFeatures);
@@ -263,7 +350,7 @@ void MapPoint::ComputeDistinctiveDescriptors()
 
     vDescriptors.reserve(observations.size());
 
-    for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+    for(map<KeyFrame*,size_t,IdLess>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
     {
         KeyFrame* pKF = mit->first;
 
@@ -309,6 +396,8 @@ void MapPoint::ComputeDistinctiveDescriptors()
         unique_lock<mutex> lock(mMutexFeatures);
         mDescriptor = vDescriptors[BestIdx].clone();
     }
+
+    PublishTrackingState();
 }
 
 cv::Mat MapPoint::GetDescriptor()
@@ -334,9 +423,9 @@ bool MapPoint::IsInKeyFrame(KeyFrame *pKF)
 
 void MapPoint::UpdateNormalAndDepth()
 {
-    map<KeyFrame*,size_t> observations;
+    map<KeyFrame*,size_t,IdLess> observations;
     KeyFrame* pRefKF;
-    cv::Mat Pos;
+    Eigen::Vector3f Pos;
     {
         unique_lock<mutex> lock1(mMutexFeatures);
         unique_lock<mutex> lock2(mMutexPos);
@@ -344,25 +433,23 @@ void MapPoint::UpdateNormalAndDepth()
             return;
         observations=mObservations;
         pRefKF=mpRefKF;
-        Pos = mWorldPos.clone();
+        Pos = mWorldPos;
     }
 
     if(observations.empty())
         return;
 
-    cv::Mat normal = cv::Mat::zeros(3,1,CV_32F);
+    Eigen::Vector3f normal = Eigen::Vector3f::Zero();
     int n=0;
-    for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+    for(map<KeyFrame*,size_t,IdLess>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
     {
         KeyFrame* pKF = mit->first;
-        cv::Mat Owi = pKF->GetCameraCenter();
-        cv::Mat normali = mWorldPos - Owi;
-        normal = normal + normali/cv::norm(normali);
+        const Eigen::Vector3f normali = Pos - pKF->GetCameraCenterEig();
+        normal += normali/normali.norm();
         n++;
     }
 
-    cv::Mat PC = Pos - pRefKF->GetCameraCenter();
-    const float dist = cv::norm(PC);
+    const float dist = (Pos - pRefKF->GetCameraCenterEig()).norm();
     const int level = pRefKF->mvKeysUn[observations[pRefKF]].octave;
     const float levelScaleFactor =  pRefKF->mvScaleFactors[level];
     const int nLevels = pRefKF->mnScaleLevels;
@@ -373,6 +460,8 @@ void MapPoint::UpdateNormalAndDepth()
         mfMinDistance = mfMaxDistance/pRefKF->mvScaleFactors[nLevels-1];
         mNormalVector = normal/n;
     }
+
+    PublishTrackingState();
 }
 
 float MapPoint::GetMinDistanceInvariance()
@@ -421,6 +510,65 @@ int MapPoint::PredictScale(const float &currentDist, Frame* pF)
     return nScale;
 }
 
+void MapPoint::PublishTrackingState()
+{
+    uint32_t words[TRACKING_STATE_WORDS];
+
+    unique_lock<mutex> lock1(mMutexFeatures);
+    unique_lock<mutex> lock2(mMutexPos);
+
+    const int nObsCopy = nObs;
+    const bool bHasDescriptor = mDescriptor.isContinuous() && mDescriptor.total()*mDescriptor.elemSize()==32;
+    memcpy(&words[0], mWorldPos.data(), 3*sizeof(float));
+    memcpy(&words[3], mNormalVector.data(), 3*sizeof(float));
+    memcpy(&words[6], &mfMinDistance, sizeof(float));
+    memcpy(&words[7], &mfMaxDistance, sizeof(float));
+    memcpy(&words[8], &nObsCopy, sizeof(int));
+    words[9] = (mbBad ? 1u : 0u) | (bHasDescriptor ? 2u : 0u);
+    if(bHasDescriptor)
+        memcpy(&words[10], mDescriptor.data, 32);
+    else
+        memset(&words[10], 0, 32);
+
+    // Writers are serialized by the mutexes above
+    const unsigned int seq = mnTrackingStateSeq.load(std::memory_order_relaxed);
+    mnTrackingStateSeq.store(seq+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for(int i=0; i<TRACKING_STATE_WORDS; i++)
+        mvTrackingStateWords[i].store(words[i], std::memory_order_relaxed);
+    mnTrackingStateSeq.store(seq+2, std::memory_order_release);
+}
+
+void MapPoint::GetTrackingState(TrackingState &state) const
+{
+    uint32_t words[TRACKING_STATE_WORDS];
+
+    unsigned int seq1, seq2;
+    do
+    {
+        seq1 = mnTrackingStateSeq.load(std::memory_order_acquire);
+        for(int i=0; i<TRACKING_STATE_WORDS; i++)
+            words[i] = mvTrackingStateWords[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        seq2 = mnTrackingStateSeq.load(std::memory_order_relaxed);
+    } while((seq1 & 1u) || seq1!=seq2);
+
+    memcpy(state.mWorldPos.data(), &words[0], 3*sizeof(float));
+    memcpy(state.mNormalVector.data(), &words[3], 3*sizeof(float));
+    memcpy(&state.mfMinDistance, &words[6], sizeof(float));
+    memcpy(&state.mfMaxDistance, &words[7], sizeof(float));
+    memcpy(&state.nObs, &words[8], sizeof(int));
+    state.mbBad = words[9] & 1u;
+    state.mbHasDescriptor = words[9] & 2u;
+    memcpy(state.mDescriptor, &words[10], 32);
+}
+
+bool MapPoint::isBadLockFree() const
+{
+    // A single word is never torn, no need to check the sequence
+    return mvTrackingStateWords[9].load(std::memory_order_acquire) & 1u;
+}
+
 float MapPoint::GetQualityScore() {
   return mfQualityScore;
 }
@@ -430,6 +578,41 @@ void MapPoint::SetQualityScore(float score) {
   mbQualityScoreCalculated = true;
 }
 
+void MapPoint::SetObservationChi2(KeyFrame* pKF, const float chi2, const int dof)
+{
+    unique_lock<mutex> lock(mMutexFeatures);
+    if(!mObservations.count(pKF))
+        return;
+
+    for(size_t i=0; i<mvObservationChi2.size(); i++)
+    {
+        if(mvObservationChi2[i].pKF==pKF)
+        {
+            mvObservationChi2[i].chi2 = chi2;
+            mvObservationChi2[i].dof = dof;
+            return;
+        }
+    }
+
+    ObservationChi2 obs;
+    obs.pKF = pKF;
+    obs.chi2 = chi2;
+    obs.dof = dof;
+    mvObservationChi2.push_back(obs);
+}
+
+void MapPoint::GetChi2Sum(double &chi2, int &dof)
+{
+    unique_lock<mutex> lock(mMutexFeatures);
+    chi2 = 0;
+    dof = 0;
+    for(size_t i=0; i<mvObservationChi2.size(); i++)
+    {
+        chi2 += mvObservationChi2[i].chi2;
+        dof += mvObservationChi2[i].dof;
+    }
+}
+
 
 
 } //namespace ORB_SLAM
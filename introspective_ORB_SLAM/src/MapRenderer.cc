@@ -0,0 +1,636 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MapRenderer.h"
+#include "Tracking.h"
+#include "Converter.h"
+#include "io_access.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <Eigen/Geometry>
+#include <glog/logging.h>
+#include <unistd.h>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+DEFINE_bool(map_renderer_enabled, false,
+            "Renders the map offscreen and saves the drawings to file when "
+            "the SLAM object is created without the viewer.");
+DEFINE_int32(map_renderer_rate, 1,
+             "The map is rendered once every this many frames.");
+DEFINE_int32(map_renderer_width, 1024, "Width of the rendered map images.");
+DEFINE_int32(map_renderer_height, 768, "Height of the rendered map images.");
+DEFINE_string(map_renderer_output_dir, "",
+              "Directory to save the rendered map images to. Defaults to "
+              "map_renderer/ under the visualization path of the tracker.");
+DEFINE_int32(map_renderer_max_queue, 8,
+             "Maximum number of rendered images waiting to be written to "
+             "disk. The renderer blocks when the queue is full.");
+
+namespace ORB_SLAM2
+{
+
+// Side of the tiles in which the point layer is redrawn, in pixels
+const int kTileSize = 32;
+
+MapRenderer::MapRenderer(Map* pMap, MapDrawer* pMapDrawer, Tracking *pTracking, const string &strSettingPath):
+    mpMap(pMap), mpMapDrawer(pMapDrawer), mnFramesSeen(0),
+    mbPointLayerValid(false), mbFinishRequested(false), mbFinished(true), mbStopped(false), mbStopRequested(false),
+    mptWriter(NULL), mbWriterFinish(false)
+{
+    cv::FileStorage fSettings(strSettingPath, cv::FileStorage::READ);
+
+    float fps = fSettings["Camera.fps"];
+    if(fps<1)
+        fps=30;
+    mT = 1e3/fps;
+
+    mnWidth = max(FLAGS_map_renderer_width, 1);
+    mnHeight = max(FLAGS_map_renderer_height, 1);
+
+    mViewpointX = fSettings["Viewer.ViewpointX"];
+    mViewpointY = fSettings["Viewer.ViewpointY"];
+    mViewpointZ = fSettings["Viewer.ViewpointZ"];
+    mViewpointF = fSettings["Viewer.ViewpointF"];
+    mKeyFrameSize = fSettings["Viewer.KeyFrameSize"];
+    mCameraSize = fSettings["Viewer.CameraSize"];
+    float fPointSize = fSettings["Viewer.PointSize"];
+    mnPointSize = max(static_cast<int>(fPointSize), 1);
+
+    if(FLAGS_map_renderer_output_dir.empty())
+        mstrOutputPath = pTracking->mvSaveVisualizationPath + "/map_renderer/";
+    else
+        mstrOutputPath = FLAGS_map_renderer_output_dir + "/";
+
+    mPointLayer.create(mnHeight, mnWidth, CV_8UC3);
+    mDepth.create(mnHeight, mnWidth, CV_32F);
+    mnTilesX = (mnWidth+kTileSize-1)/kTileSize;
+    mnTilesY = (mnHeight+kTileSize-1)/kTileSize;
+    mvbDirtyTiles.resize(mnTilesX*mnTilesY, false);
+
+    // Start logging before the initial copy of the map, so that no change
+    // is missed in between. Points logged twice are just updated twice.
+    mpMap->EnableMapPointChangeLog();
+    const vector<MapPoint*> vpMPs = mpMap->GetAllMapPoints();
+    for(size_t i=0; i<vpMPs.size(); i++)
+    {
+        if(vpMPs[i]->isBad())
+            continue;
+        mmSlotOfMapPoint[vpMPs[i]] = mvpSlotMapPoints.size();
+        mvpSlotMapPoints.push_back(vpMPs[i]);
+        mvSlotPositions.push_back(vpMPs[i]->GetWorldPosEig());
+        mvbSlotDirty.push_back(true);
+    }
+}
+
+MapRenderer::~MapRenderer()
+{
+    if(mptWriter)
+    {
+        {
+            unique_lock<mutex> lock(mMutexWriter);
+            mbWriterFinish = true;
+        }
+        mcvWriter.notify_all();
+        mptWriter->join();
+        delete mptWriter;
+    }
+}
+
+void MapRenderer::Run()
+{
+    {
+        unique_lock<mutex> lock(mMutexFinish);
+        mbFinished = false;
+    }
+
+    // Only the default directory is owned by the renderer and wiped
+    if(FLAGS_map_renderer_output_dir.empty())
+        RemoveDirectory(mstrOutputPath);
+    CreateDirectory(mstrOutputPath);
+
+    mptWriter = new thread(&MapRenderer::WriterLoop, this);
+
+    while(1)
+    {
+        cv::Mat Tcw, Twc_gt;
+        string strFrameName;
+        mpMapDrawer->GetCurrentCameraState(Tcw, Twc_gt, strFrameName);
+
+        if(!Tcw.empty() && !strFrameName.empty() && strFrameName != mstrLastFrameName)
+        {
+            mstrLastFrameName = strFrameName;
+
+            // Applied on every frame, so that a reset of the map also resets
+            // the trajectories before they are extended
+            UpdateVertexBuffer();
+
+            // The trajectories are extended on every frame, even those that
+            // are not rendered
+            cv::Mat Twc = mpMapDrawer->CalculateInverseTransform(Tcw);
+            mvTrajectory.push_back(Converter::toVector3f(Twc.rowRange(0,3).col(3)));
+            if(!Twc_gt.empty())
+            {
+                if(mTalign.empty())
+                    mTalign = Twc * mpMapDrawer->CalculateInverseTransform(Twc_gt);
+                cv::Mat Twc_gt_aligned = mTalign * Twc_gt;
+                mvTrajectoryGT.push_back(Converter::toVector3f(Twc_gt_aligned.rowRange(0,3).col(3)));
+            }
+
+            if(mnFramesSeen++ % max(FLAGS_map_renderer_rate, 1) == 0)
+            {
+                cv::Mat im = Render(Tcw, Twc_gt);
+                EnqueueImage(mstrOutputPath + strFrameName + ".png", im);
+            }
+        }
+
+        if(Stop())
+        {
+            while(isStopped())
+            {
+                usleep(3000);
+            }
+        }
+
+        if(CheckFinish())
+            break;
+
+        usleep(mT*1e3/2);
+    }
+
+    // Flush the images that are still queued
+    if(mptWriter)
+    {
+        {
+            unique_lock<mutex> lock(mMutexWriter);
+            mbWriterFinish = true;
+        }
+        mcvWriter.notify_all();
+        mptWriter->join();
+        delete mptWriter;
+        mptWriter = NULL;
+    }
+
+    LOG(INFO) << "Exiting the map renderer!";
+    SetFinish();
+}
+
+void MapRenderer::UpdateVertexBuffer()
+{
+    bool bCleared;
+    const vector<MapPoint*> vpChanged = mpMap->TakeMapPointChanges(bCleared);
+
+    if(bCleared)
+    {
+        // The pointers in the buffer are dangling now, drop them without
+        // touching them.
+        mmSlotOfMapPoint.clear();
+        mvpSlotMapPoints.clear();
+        mvSlotPositions.clear();
+        mvFreeSlots.clear();
+        mvbSlotDirty.clear();
+        mvSlotFootprints.clear();
+        mbPointLayerValid = false;
+        mvTrajectory.clear();
+        mvTrajectoryGT.clear();
+        mTalign.release();
+    }
+
+    for(size_t i=0; i<vpChanged.size(); i++)
+    {
+        MapPoint* pMP = vpChanged[i];
+        unordered_map<MapPoint*,size_t>::iterator mit = mmSlotOfMapPoint.find(pMP);
+
+        if(pMP->isBad())
+        {
+            if(mit!=mmSlotOfMapPoint.end())
+            {
+                mvpSlotMapPoints[mit->second] = static_cast<MapPoint*>(NULL);
+                mvbSlotDirty[mit->second] = true;
+                mvFreeSlots.push_back(mit->second);
+                mmSlotOfMapPoint.erase(mit);
+            }
+            continue;
+        }
+
+        if(mit!=mmSlotOfMapPoint.end())
+        {
+            const Eigen::Vector3f pos = pMP->GetWorldPosEig();
+            if(pos!=mvSlotPositions[mit->second])
+            {
+                mvSlotPositions[mit->second] = pos;
+                mvbSlotDirty[mit->second] = true;
+            }
+        }
+        else if(!mvFreeSlots.empty())
+        {
+            const size_t slot = mvFreeSlots.back();
+            mvFreeSlots.pop_back();
+            mmSlotOfMapPoint[pMP] = slot;
+            mvpSlotMapPoints[slot] = pMP;
+            mvSlotPositions[slot] = pMP->GetWorldPosEig();
+            mvbSlotDirty[slot] = true;
+        }
+        else
+        {
+            mmSlotOfMapPoint[pMP] = mvpSlotMapPoints.size();
+            mvpSlotMapPoints.push_back(pMP);
+            mvSlotPositions.push_back(pMP->GetWorldPosEig());
+            mvbSlotDirty.push_back(true);
+        }
+    }
+}
+
+void MapRenderer::ComputeViewTransform(const cv::Mat &Tcw, Eigen::Matrix3f &Rvw, Eigen::Vector3f &tvw)
+{
+    // Look at the origin of the camera frame from the viewpoint, with -y up
+    const Eigen::Vector3f eye(mViewpointX, mViewpointY, mViewpointZ);
+    Eigen::Vector3f z = -eye;
+    if(z.norm() < 1e-6)
+        z = Eigen::Vector3f(0,0,1);
+    z.normalize();
+    Eigen::Vector3f y = Eigen::Vector3f(0,1,0) - Eigen::Vector3f(0,1,0).dot(z) * z;
+    if(y.norm() < 1e-6)
+        y = Eigen::Vector3f(0,0,1) - z.z() * z;
+    y.normalize();
+    const Eigen::Vector3f x = y.cross(z);
+
+    Eigen::Matrix3f Rvc;
+    Rvc.row(0) = x.transpose();
+    Rvc.row(1) = y.transpose();
+    Rvc.row(2) = z.transpose();
+    const Eigen::Vector3f tvc = -Rvc * eye;
+
+    const Eigen::Matrix3f Rcw = Converter::toMatrix3f(Tcw.rowRange(0,3).colRange(0,3));
+    const Eigen::Vector3f tcw = Converter::toVector3f(Tcw.rowRange(0,3).col(3));
+
+    Rvw = Rvc * Rcw;
+    tvw = Rvc * tcw + tvc;
+}
+
+bool MapRenderer::Project(const Eigen::Vector3f &Pv, cv::Point2f &uv)
+{
+    const float kNear = 0.1;
+    if(Pv.z() < kNear)
+        return false;
+
+    const float invz = 1.0f/Pv.z();
+    uv.x = mViewpointF*Pv.x()*invz + 0.5f*mnWidth;
+    uv.y = mViewpointF*Pv.y()*invz + 0.5f*mnHeight;
+    return true;
+}
+
+void MapRenderer::DrawSegment(cv::Mat &im, const Eigen::Vector3f &P1v, const Eigen::Vector3f &P2v,
+                              const cv::Scalar &color, int thickness)
+{
+    const float kNear = 0.1;
+    Eigen::Vector3f A = P1v, B = P2v;
+    if(A.z() < kNear && B.z() < kNear)
+        return;
+
+    // Clip the segment against the near plane
+    if(A.z() < kNear)
+        A = B + (A - B) * ((B.z() - kNear) / (B.z() - A.z()));
+    else if(B.z() < kNear)
+        B = A + (B - A) * ((A.z() - kNear) / (A.z() - B.z()));
+
+    cv::Point2f a, b;
+    if(!Project(A, a) || !Project(B, b))
+        return;
+
+    // Keep the coordinates in the range cv::line can handle
+    const float kMaxCoord = 1e5;
+    if(fabs(a.x) > kMaxCoord || fabs(a.y) > kMaxCoord || fabs(b.x) > kMaxCoord || fabs(b.y) > kMaxCoord)
+        return;
+
+    cv::line(im, a, b, color, thickness);
+}
+
+void MapRenderer::DrawCamera(cv::Mat &im, const Eigen::Matrix3f &Rvw, const Eigen::Vector3f &tvw,
+                             const cv::Mat &Twc, float size, const cv::Scalar &color, int thickness)
+{
+    const float &w = size;
+    const float h = w*0.75;
+    const float z = w*0.6;
+
+    const Eigen::Matrix3f Rwc = Converter::toMatrix3f(Twc.rowRange(0,3).colRange(0,3));
+    const Eigen::Vector3f twc = Converter::toVector3f(Twc.rowRange(0,3).col(3));
+
+    // Same frustum as MapDrawer::DrawKeyFrames
+    Eigen::Vector3f corners[5] = {Eigen::Vector3f(0,0,0), Eigen::Vector3f(w,h,z), Eigen::Vector3f(w,-h,z),
+                                  Eigen::Vector3f(-w,-h,z), Eigen::Vector3f(-w,h,z)};
+    for(int i=0; i<5; i++)
+        corners[i] = Rvw * (Rwc * corners[i] + twc) + tvw;
+
+    for(int i=1; i<5; i++)
+    {
+        DrawSegment(im, corners[0], corners[i], color, thickness);
+        DrawSegment(im, corners[i], corners[i%4+1], color, thickness);
+    }
+}
+
+cv::Mat MapRenderer::Render(const cv::Mat &Tcw, const cv::Mat &Twc_gt)
+{
+    Eigen::Matrix3f Rvw;
+    Eigen::Vector3f tvw;
+    ComputeViewTransform(Tcw, Rvw, tvw);
+
+    // Map points, colored given their quality score as in the MapDrawer. The
+    // rest is drawn on top of them on every render.
+    RenderMapPoints(Rvw, tvw);
+    cv::Mat im = mPointLayer.clone();
+
+    // Keyframes in blue
+    const vector<KeyFrame*> vpKFs = mpMap->GetAllKeyFrames();
+    for(size_t i=0; i<vpKFs.size(); i++)
+    {
+        if(vpKFs[i]->isBad())
+            continue;
+        DrawCamera(im, Rvw, tvw, vpKFs[i]->GetPoseInverse(), mKeyFrameSize, cv::Scalar(255,0,0), 1);
+    }
+
+    // Estimated trajectory and current camera in green, reference in red
+    for(size_t i=1; i<mvTrajectory.size(); i++)
+        DrawSegment(im, Rvw*mvTrajectory[i-1]+tvw, Rvw*mvTrajectory[i]+tvw, cv::Scalar(0,200,0), 2);
+    for(size_t i=1; i<mvTrajectoryGT.size(); i++)
+        DrawSegment(im, Rvw*mvTrajectoryGT[i-1]+tvw, Rvw*mvTrajectoryGT[i]+tvw, cv::Scalar(0,0,255), 2);
+
+    DrawCamera(im, Rvw, tvw, mpMapDrawer->CalculateInverseTransform(Tcw), mCameraSize, cv::Scalar(0,200,0), 2);
+    if(!Twc_gt.empty() && !mTalign.empty())
+        DrawCamera(im, Rvw, tvw, mTalign * Twc_gt, mCameraSize, cv::Scalar(0,0,255), 2);
+
+    return im;
+}
+
+void MapRenderer::RenderMapPoints(const Eigen::Matrix3f &Rvw, const Eigen::Vector3f &tvw)
+{
+    const size_t nSlots = mvpSlotMapPoints.size();
+    PointFootprint fpHidden;
+    fpHidden.bVisible = false;
+    mvSlotFootprints.resize(nSlots, fpHidden);
+
+    if(!mbPointLayerValid || Rvw!=mRvwPointLayer || tvw!=mtvwPointLayer)
+    {
+        mPointLayer.setTo(cv::Scalar(255,255,255));
+        mDepth.setTo(std::numeric_limits<float>::max());
+        const cv::Rect roi(0, 0, mnWidth, mnHeight);
+        for(size_t i=0; i<nSlots; i++)
+        {
+            ComputeFootprint(i, Rvw, tvw, mvSlotFootprints[i]);
+            if(mvSlotFootprints[i].bVisible)
+                RasterizePoint(mvSlotFootprints[i], roi);
+        }
+        fill(mvbSlotDirty.begin(), mvbSlotDirty.end(), false);
+        mRvwPointLayer = Rvw;
+        mtvwPointLayer = tvw;
+        mbPointLayerValid = true;
+        return;
+    }
+
+    // Same view: find the slots that moved, appeared, disappeared or changed
+    // color, and the tiles they covered before and cover now
+    fill(mvbDirtyTiles.begin(), mvbDirtyTiles.end(), false);
+    bool bChanged = false;
+    for(size_t i=0; i<nSlots; i++)
+    {
+        PointFootprint fp;
+        if(mvbSlotDirty[i])
+        {
+            ComputeFootprint(i, Rvw, tvw, fp);
+            mvbSlotDirty[i] = false;
+        }
+        else
+        {
+            if(!mvSlotFootprints[i].bVisible)
+                continue;
+            fp = mvSlotFootprints[i];
+            fp.color = PointColor(mvpSlotMapPoints[i]);
+            if(fp.color==mvSlotFootprints[i].color)
+                continue;
+        }
+
+        MarkDirtyTiles(mvSlotFootprints[i]);
+        MarkDirtyTiles(fp);
+        mvSlotFootprints[i] = fp;
+        bChanged = true;
+    }
+
+    if(!bChanged)
+        return;
+
+    // Clear the dirty tiles and draw again, in slot order, the points that
+    // overlap them, so that the layer is the same as after a full redraw
+    for(int ty=0; ty<mnTilesY; ty++)
+    {
+        for(int tx=0; tx<mnTilesX; tx++)
+        {
+            if(!mvbDirtyTiles[ty*mnTilesX+tx])
+                continue;
+            const cv::Rect tile = cv::Rect(tx*kTileSize, ty*kTileSize, kTileSize, kTileSize) & cv::Rect(0, 0, mnWidth, mnHeight);
+            mPointLayer(tile).setTo(cv::Scalar(255,255,255));
+            mDepth(tile).setTo(std::numeric_limits<float>::max());
+        }
+    }
+
+    for(size_t i=0; i<nSlots; i++)
+    {
+        const PointFootprint &fp = mvSlotFootprints[i];
+        if(!fp.bVisible)
+            continue;
+
+        const int tx0 = max(fp.u0, 0)/kTileSize;
+        const int tx1 = min(fp.u0+mnPointSize-1, mnWidth-1)/kTileSize;
+        const int ty0 = max(fp.v0, 0)/kTileSize;
+        const int ty1 = min(fp.v0+mnPointSize-1, mnHeight-1)/kTileSize;
+        for(int ty=ty0; ty<=ty1; ty++)
+        {
+            for(int tx=tx0; tx<=tx1; tx++)
+            {
+                if(mvbDirtyTiles[ty*mnTilesX+tx])
+                    RasterizePoint(fp, cv::Rect(tx*kTileSize, ty*kTileSize, kTileSize, kTileSize));
+            }
+        }
+    }
+}
+
+void MapRenderer::ComputeFootprint(size_t slot, const Eigen::Matrix3f &Rvw, const Eigen::Vector3f &tvw, PointFootprint &fp)
+{
+    fp.bVisible = false;
+
+    MapPoint* pMP = mvpSlotMapPoints[slot];
+    if(!pMP)
+        return;
+
+    const Eigen::Vector3f Pv = Rvw * mvSlotPositions[slot] + tvw;
+    cv::Point2f uv;
+    if(!Project(Pv, uv))
+        return;
+
+    const int r = mnPointSize/2;
+    fp.u0 = cvRound(uv.x) - r;
+    fp.v0 = cvRound(uv.y) - r;
+    if(fp.u0 + mnPointSize <= 0 || fp.v0 + mnPointSize <= 0 || fp.u0 >= mnWidth || fp.v0 >= mnHeight)
+        return;
+
+    fp.z = Pv.z();
+    fp.color = PointColor(pMP);
+    fp.bVisible = true;
+}
+
+cv::Vec3b MapRenderer::PointColor(MapPoint* pMP)
+{
+    // Cyan: Map points for which the quality score has not been calculated
+    if(!pMP->mbQualityScoreCalculated)
+        return cv::Vec3b(255,255,0);
+
+    const float q = min(max(pMP->GetQualityScore(), 0.0f), 1.0f);
+    return cv::Vec3b(0, cv::saturate_cast<uchar>(255*q), cv::saturate_cast<uchar>(255*(1.0f-q)));
+}
+
+void MapRenderer::MarkDirtyTiles(const PointFootprint &fp)
+{
+    if(!fp.bVisible)
+        return;
+
+    const int tx0 = max(fp.u0, 0)/kTileSize;
+    const int tx1 = min(fp.u0+mnPointSize-1, mnWidth-1)/kTileSize;
+    const int ty0 = max(fp.v0, 0)/kTileSize;
+    const int ty1 = min(fp.v0+mnPointSize-1, mnHeight-1)/kTileSize;
+    for(int ty=ty0; ty<=ty1; ty++)
+        for(int tx=tx0; tx<=tx1; tx++)
+            mvbDirtyTiles[ty*mnTilesX+tx] = true;
+}
+
+void MapRenderer::RasterizePoint(const PointFootprint &fp, const cv::Rect &roi)
+{
+    const int vBegin = max(fp.v0, max(roi.y, 0));
+    const int vEnd = min(fp.v0+mnPointSize, min(roi.y+roi.height, mnHeight));
+    const int uBegin = max(fp.u0, max(roi.x, 0));
+    const int uEnd = min(fp.u0+mnPointSize, min(roi.x+roi.width, mnWidth));
+    for(int v=vBegin; v<vEnd; v++)
+    {
+        float* depth = mDepth.ptr<float>(v);
+        cv::Vec3b* pixel = mPointLayer.ptr<cv::Vec3b>(v);
+        for(int u=uBegin; u<uEnd; u++)
+        {
+            if(fp.z < depth[u])
+            {
+                depth[u] = fp.z;
+                pixel[u] = fp.color;
+            }
+        }
+    }
+}
+
+void MapRenderer::EnqueueImage(const std::string &strPath, const cv::Mat &im)
+{
+    unique_lock<mutex> lock(mMutexWriter);
+    while(static_cast<int>(mqImagesToWrite.size()) >= max(FLAGS_map_renderer_max_queue, 1) && !mbWriterFinish)
+        mcvWriter.wait(lock);
+    mqImagesToWrite.push_back(make_pair(strPath, im));
+    lock.unlock();
+    mcvWriter.notify_all();
+}
+
+void MapRenderer::WriterLoop()
+{
+    while(1)
+    {
+        pair<string,cv::Mat> item;
+        {
+            unique_lock<mutex> lock(mMutexWriter);
+            while(mqImagesToWrite.empty() && !mbWriterFinish)
+                mcvWriter.wait(lock);
+            if(mqImagesToWrite.empty())
+                break;
+            item = mqImagesToWrite.front();
+            mqImagesToWrite.pop_front();
+        }
+        mcvWriter.notify_all();
+
+        if(!cv::imwrite(item.first, item.second))
+            LOG(WARNING) << "Could not write " << item.first;
+    }
+}
+
+void MapRenderer::RequestFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    mbFinishRequested = true;
+}
+
+bool MapRenderer::CheckFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    return mbFinishRequested;
+}
+
+void MapRenderer::SetFinish()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    mbFinished = true;
+}
+
+bool MapRenderer::isFinished()
+{
+    unique_lock<mutex> lock(mMutexFinish);
+    return mbFinished;
+}
+
+void MapRenderer::RequestStop()
+{
+    unique_lock<mutex> lock(mMutexStop);
+    if(!mbStopped)
+        mbStopRequested = true;
+}
+
+bool MapRenderer::isStopped()
+{
+    unique_lock<mutex> lock(mMutexStop);
+    return mbStopped;
+}
+
+bool MapRenderer::Stop()
+{
+    unique_lock<mutex> lock(mMutexStop);
+    unique_lock<mutex> lock2(mMutexFinish);
+
+    if(mbFinishRequested)
+        return false;
+    else if(mbStopRequested)
+    {
+        mbStopped = true;
+        mbStopRequested = false;
+        return true;
+    }
+
+    return false;
+}
+
+void MapRenderer::Release()
+{
+    unique_lock<mutex> lock(mMutexStop);
+    mbStopped = false;
+}
+
+} //namespace ORB_SLAM
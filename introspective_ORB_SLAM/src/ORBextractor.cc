@@ -60,8 +60,13 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <vector>
 #include <algorithm>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "ORBextractor.h"
+#include "ORBextractorKernels.h"
 
 
 using namespace cv;
@@ -75,7 +80,9 @@ const int HALF_PATCH_SIZE = 15;
 const int EDGE_THRESHOLD = 19;
 
 
-static float IC_Angle(const Mat& image, Point2f pt,  const vector<int> & u_max)
+// Scalar intensity centroid angle. The SIMD version below must return the same
+// angles, which ORBextractor::CheckKernels verifies.
+static float IC_AngleReference(const Mat& image, Point2f pt,  const vector<int> & u_max)
 {
     int m_01 = 0, m_10 = 0;
 
@@ -104,47 +111,107 @@ static float IC_Angle(const Mat& image, Point2f pt,  const vector<int> & u_max)
     return fastAtan2((float)m_01, (float)m_10);
 }
 
+#ifdef __SSE2__
+// Weights of the intensity centroid moments for the rows of the circular
+// patch. Lane j of a row holds the pixel at u = j - HALF_PATCH_SIZE and is
+// zero outside the patch, so that every row is processed as 32 pixels.
+struct MomentWeights
+{
+    short wu[HALF_PATCH_SIZE+1][32];
+    short wv[HALF_PATCH_SIZE+1][32];
 
-const float factorPI = (float)(CV_PI/180.f);
-static void computeOrbDescriptor(const KeyPoint& kpt,
-                                 const Mat& img, const Point* pattern,
-                                 uchar* desc)
+    MomentWeights(const vector<int> &u_max)
+    {
+        for (int v = 0; v <= HALF_PATCH_SIZE; ++v)
+        {
+            const int d = (v == 0) ? HALF_PATCH_SIZE : u_max[v];
+            for (int j = 0; j < 32; ++j)
+            {
+                const int u = j - HALF_PATCH_SIZE;
+                const bool inside = u >= -d && u <= d;
+                wu[v][j] = inside ? u : 0;
+                wv[v][j] = inside ? v : 0;
+            }
+        }
+    }
+};
+
+static inline int HorizontalSum(__m128i v)
 {
-    float angle = (float)kpt.angle*factorPI;
-    float a = (float)cos(angle), b = (float)sin(angle);
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(v);
+}
 
-    const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
-    const int step = (int)img.step;
+// Same moments as IC_AngleReference. The sums are integer, so the angle is
+// identical.
+static float IC_Angle(const Mat& image, Point2f pt,  const vector<int> & u_max)
+{
+    // u_max is the same for all extractors
+    static const MomentWeights weights(u_max);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i m_10 = zero, m_01 = zero;
 
-    #define GET_VALUE(idx) \
-        center[cvRound(pattern[idx].x*b + pattern[idx].y*a)*step + \
-               cvRound(pattern[idx].x*a - pattern[idx].y*b)]
+    const uchar* center = &image.at<uchar> (cvRound(pt.y), cvRound(pt.x));
 
+    // Treat the center line differently, v=0
+    for (int half = 0; half < 32; half += 16)
+    {
+        const __m128i p = _mm_loadu_si128((const __m128i*)(center - HALF_PATCH_SIZE + half));
+        const __m128i* w = (const __m128i*)(weights.wu[0] + half);
+        m_10 = _mm_add_epi32(m_10, _mm_madd_epi16(_mm_unpacklo_epi8(p, zero), _mm_loadu_si128(w)));
+        m_10 = _mm_add_epi32(m_10, _mm_madd_epi16(_mm_unpackhi_epi8(p, zero), _mm_loadu_si128(w + 1)));
+    }
 
-    for (int i = 0; i < 32; ++i, pattern += 16)
+    // Go line by line in the circular patch, both lines at once
+    int step = (int)image.step1();
+    for (int v = 1; v <= HALF_PATCH_SIZE; ++v)
     {
-        int t0, t1, val;
-        t0 = GET_VALUE(0); t1 = GET_VALUE(1);
-        val = t0 < t1;
-        t0 = GET_VALUE(2); t1 = GET_VALUE(3);
-        val |= (t0 < t1) << 1;
-        t0 = GET_VALUE(4); t1 = GET_VALUE(5);
-        val |= (t0 < t1) << 2;
-        t0 = GET_VALUE(6); t1 = GET_VALUE(7);
-        val |= (t0 < t1) << 3;
-        t0 = GET_VALUE(8); t1 = GET_VALUE(9);
-        val |= (t0 < t1) << 4;
-        t0 = GET_VALUE(10); t1 = GET_VALUE(11);
-        val |= (t0 < t1) << 5;
-        t0 = GET_VALUE(12); t1 = GET_VALUE(13);
-        val |= (t0 < t1) << 6;
-        t0 = GET_VALUE(14); t1 = GET_VALUE(15);
-        val |= (t0 < t1) << 7;
+        const uchar* plus = center + v*step - HALF_PATCH_SIZE;
+        const uchar* minus = center - v*step - HALF_PATCH_SIZE;
+        for (int half = 0; half < 32; half += 16)
+        {
+            const __m128i p = _mm_loadu_si128((const __m128i*)(plus + half));
+            const __m128i m = _mm_loadu_si128((const __m128i*)(minus + half));
+            const __m128i p_lo = _mm_unpacklo_epi8(p, zero), p_hi = _mm_unpackhi_epi8(p, zero);
+            const __m128i m_lo = _mm_unpacklo_epi8(m, zero), m_hi = _mm_unpackhi_epi8(m, zero);
+            const __m128i* wu = (const __m128i*)(weights.wu[v] + half);
+            const __m128i* wv = (const __m128i*)(weights.wv[v] + half);
+
+            m_10 = _mm_add_epi32(m_10, _mm_madd_epi16(_mm_add_epi16(p_lo, m_lo), _mm_loadu_si128(wu)));
+            m_10 = _mm_add_epi32(m_10, _mm_madd_epi16(_mm_add_epi16(p_hi, m_hi), _mm_loadu_si128(wu + 1)));
+            m_01 = _mm_add_epi32(m_01, _mm_madd_epi16(_mm_sub_epi16(p_lo, m_lo), _mm_loadu_si128(wv)));
+            m_01 = _mm_add_epi32(m_01, _mm_madd_epi16(_mm_sub_epi16(p_hi, m_hi), _mm_loadu_si128(wv + 1)));
+        }
+    }
+
+    return fastAtan2((float)HorizontalSum(m_01), (float)HorizontalSum(m_10));
+}
+#else
+static float IC_Angle(const Mat& image, Point2f pt,  const vector<int> & u_max)
+{
+    return IC_AngleReference(image, pt, u_max);
+}
+#endif
+
+
+// Number of quantized keypoint angles with a precomputed rotated pattern
+const int NUM_ROTATED_PATTERNS = 30;
+
+static void computeOrbDescriptor(const KeyPoint& kpt,
+                                 const Mat& img, const int* offsets,
+                                 uchar* desc)
+{
+    const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
+
+    for (int i = 0; i < 32; ++i, offsets += 16)
+    {
+        int val = 0;
+        for (int j = 0; j < 8; ++j)
+            val |= (center[offsets[2*j]] < center[offsets[2*j+1]]) << j;
 
         desc[i] = (uchar)val;
     }
-
-    #undef GET_VALUE
 }
 
 
@@ -409,10 +476,12 @@ static int bit_pattern_31_[256*4] =
 };
 
 ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
-         int _iniThFAST, int _minThFAST, bool enableIntrospection):
+         int _iniThFAST, int _minThFAST, bool enableIntrospection,
+         float costGateThreshold):
     nfeatures(_nfeatures), scaleFactor(_scaleFactor), nlevels(_nlevels),
     iniThFAST(_iniThFAST), minThFAST(_minThFAST), 
-    benableIntrospection(enableIntrospection)
+    benableIntrospection(enableIntrospection),
+    mfCostGateThreshold(costGateThreshold)
 {
     mvScaleFactor.resize(nlevels);
     mvLevelSigma2.resize(nlevels);
@@ -434,6 +503,9 @@ ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
 
     mvImagePyramid.resize(nlevels);
     mvQualityImagePyramid.resize(nlevels);
+    mvBlurredPyramid.resize(nlevels);
+    mvImagePyramidBuffers.resize(nlevels);
+    mvQualityPyramidBuffers.resize(nlevels);
 
     mnFeaturesPerLevel.resize(nlevels);
     float factor = 1.0f / scaleFactor;
@@ -451,10 +523,18 @@ ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
     }
     mnFeaturesPerLevel[nlevels-1] = std::max(nfeatures - sumFeatures, 0);
 
-    const int npoints = 512;
+    const int npoints = PATTERN_POINTS;
     const Point* pattern0 = (const Point*)bit_pattern_31_;
     std::copy(pattern0, pattern0 + npoints, std::back_inserter(pattern));
 
+    mvPatternX.resize(npoints);
+    mvPatternY.resize(npoints);
+    for (int i = 0; i < npoints; i++)
+    {
+        mvPatternX[i] = (float)pattern[i].x;
+        mvPatternY[i] = (float)pattern[i].y;
+    }
+
     //This is for orientation
     // pre-compute the end of a row in a circular patch
     umax.resize(HALF_PATCH_SIZE + 1);
@@ -475,6 +555,27 @@ ORBextractor::ORBextractor(int _nfeatures, float _scaleFactor, int _nlevels,
     }
 }
 
+void ORBextractor::SetQuantizedAngles(const bool bQuantized)
+{
+    mvRotatedPatterns.clear();
+    if (!bQuantized)
+        return;
+
+    mvRotatedPatterns.resize(NUM_ROTATED_PATTERNS);
+    for (int k = 0; k < NUM_ROTATED_PATTERNS; k++)
+    {
+        const float angle = k*(360.f/NUM_ROTATED_PATTERNS)*factorPI;
+        const float a = (float)cos(angle), b = (float)sin(angle);
+        vector<Point>& rotated = mvRotatedPatterns[k];
+        rotated.resize(pattern.size());
+        for (size_t i = 0; i < pattern.size(); i++)
+        {
+            rotated[i].x = cvRound(pattern[i].x*a - pattern[i].y*b);
+            rotated[i].y = cvRound(pattern[i].x*b + pattern[i].y*a);
+        }
+    }
+}
+
 static void computeOrientation(const Mat& image, vector<KeyPoint>& keypoints, const vector<int>& umax)
 {
     for (vector<KeyPoint>::iterator keypoint = keypoints.begin(),
@@ -484,6 +585,11 @@ static void computeOrientation(const Mat& image, vector<KeyPoint>& keypoints, co
     }
 }
 
+static bool NodeSizeLess(const pair<int,ExtractorNode*> &a, const pair<int,ExtractorNode*> &b)
+{
+    return a.first < b.first;
+}
+
 void ExtractorNode::DivideNode(ExtractorNode &n1, ExtractorNode &n2, ExtractorNode &n3, ExtractorNode &n4)
 {
     const int halfX = ceil(static_cast<float>(UR.x-UL.x)/2);
@@ -687,7 +793,8 @@ vector<cv::KeyPoint> ORBextractor::DistributeOctTree(const vector<cv::KeyPoint>&
                 vector<pair<int,ExtractorNode*> > vPrevSizeAndPointerToNode = vSizeAndPointerToNode;
                 vSizeAndPointerToNode.clear();
 
-                sort(vPrevSizeAndPointerToNode.begin(),vPrevSizeAndPointerToNode.end());
+                // Ties on the size must not be broken by the node address
+                stable_sort(vPrevSizeAndPointerToNode.begin(),vPrevSizeAndPointerToNode.end(),NodeSizeLess);
                 for(int j=vPrevSizeAndPointerToNode.size()-1;j>=0;j--)
                 {
                     ExtractorNode n1,n2,n3,n4;
@@ -943,7 +1050,14 @@ void ORBextractor::ComputeKeyPointsOld(std::vector<std::vector<KeyPoint> > &allK
                               vector<float>(levelCols, nfeaturesCell));
         vector<vector<float>> cell_weights(levelRows, vector<float>(levelCols));
         float cell_weights_sum = 0.0;
+
+        // Cells with a high predicted cost that are skipped altogether
+        vector<vector<bool>> cell_gated(levelRows, 
+                                        vector<bool>(levelCols, false));
         if (bqualityScoresAvailable && benableIntrospection) {
+          int nCandidateCells = 0;
+          int nGatedCells = 0;
+          float gated_weights_sum = 0.0;
           for(int i=0; i<levelRows; i++) {
             const float iniY = minBorderY + i*cellH - 3;
             iniYRow[i] = iniY;
@@ -982,8 +1096,24 @@ void ORBextractor::ComputeKeyPointsOld(std::vector<std::vector<KeyPoint> > &allK
               float qual_score_norm = 2 * qual_score - 1;
               cell_weights[i][j] = qual_score_norm;
               cell_weights_sum+= qual_score_norm;
+
+              nCandidateCells++;
+              if (cost > mfCostGateThreshold) {
+                cell_gated[i][j] = true;
+                gated_weights_sum += qual_score_norm;
+                nGatedCells++;
+              }
             }
           }
+
+          // The budget of the gated cells is distributed over the rest of
+          // the cells in proportion to their weights. If all cells are
+          // gated, none is skipped.
+          if (nGatedCells == nCandidateCells) {
+            cell_gated.assign(levelRows, vector<bool>(levelCols, false));
+          } else {
+            cell_weights_sum -= gated_weights_sum;
+          }
         }
 
         for(int i=0; i<levelRows; i++)
@@ -1022,6 +1152,17 @@ void ORBextractor::ComputeKeyPointsOld(std::vector<std::vector<KeyPoint> > &allK
                         continue;
                 }
                 
+                // Skip the cell before running FAST if its predicted cost
+                // is too high
+                if (cell_gated[i][j]) {
+                  nfeatures_cell[i][j] = 0;
+                  nToRetain[i][j] = 0;
+                  nTotal[i][j] = 0;
+                  bNoMore[i][j] = true;
+                  nNoMore++;
+                  continue;
+                }
+
                 // If the predicted quality score image is available,
                 // set the maximum number of features to be extracted
                 // from the cell given the mean quality of the cell 
@@ -1212,13 +1353,31 @@ void ORBextractor::ComputeKeyPointsOld(std::vector<std::vector<KeyPoint> > &allK
     
 }
 
+// If vRotatedPatterns is not empty, the pattern of the closest quantized
+// angle is used instead of rotating the pattern by the keypoint angle
 static void computeDescriptors(const Mat& image, vector<KeyPoint>& keypoints, Mat& descriptors,
-                               const vector<Point>& pattern)
+                               const vector<float>& patternX, const vector<float>& patternY,
+                               const vector<vector<Point> >& vRotatedPatterns)
 {
     descriptors = Mat::zeros((int)keypoints.size(), 32, CV_8UC1);
 
+    const int step = (int)image.step;
+    int offsets[PATTERN_POINTS];
     for (size_t i = 0; i < keypoints.size(); i++)
-        computeOrbDescriptor(keypoints[i], image, &pattern[0], descriptors.ptr((int)i));
+    {
+        if (vRotatedPatterns.empty())
+        {
+            computeRotatedOffsets(&patternX[0], &patternY[0], keypoints[i].angle, step, offsets);
+        }
+        else
+        {
+            const int bin = cvRound(keypoints[i].angle*NUM_ROTATED_PATTERNS/360.f) % NUM_ROTATED_PATTERNS;
+            const vector<Point>& rotated = vRotatedPatterns[bin];
+            for (int j = 0; j < PATTERN_POINTS; ++j)
+                offsets[j] = rotated[j].y*step + rotated[j].x;
+        }
+        computeOrbDescriptor(keypoints[i], image, offsets, descriptors.ptr((int)i));
+    }
 }
 
 void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPoint>& _keypoints,
@@ -1272,13 +1431,10 @@ void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPo
         if(nkeypointsLevel==0)
             continue;
 
-        // preprocess the resized image
-        Mat workingMat = mvImagePyramid[level].clone();
-        GaussianBlur(workingMat, workingMat, Size(7, 7), 2, 2, BORDER_REFLECT_101);
-
-        // Compute the descriptors
+        // Compute the descriptors on the blurred level
         Mat desc = descriptors.rowRange(offset, offset + nkeypointsLevel);
-        computeDescriptors(workingMat, keypoints, desc, pattern);
+        computeDescriptors(mvBlurredPyramid[level], keypoints, desc,
+                           mvPatternX, mvPatternY, mvRotatedPatterns);
 
         offset += nkeypointsLevel;
 
@@ -1295,6 +1451,73 @@ void ORBextractor::operator()( InputArray _image, InputArray _mask, vector<KeyPo
     }
 }
 
+void ORBextractor::CheckKernels(InputArray _image, int &nKeyPoints,
+                                int &nAngleMismatches, int &nDescriptorMismatches)
+{
+    nKeyPoints = 0;
+    nAngleMismatches = 0;
+    nDescriptorMismatches = 0;
+    if(_image.empty())
+        return;
+
+    bqualityScoresAvailable = false;
+    Mat image = _image.getMat();
+    assert(image.type() == CV_8UC1 );
+    ComputePyramid(image);
+
+    // The angles of the detected keypoints come from IC_Angle
+    vector < vector<KeyPoint> > allKeypoints;
+    ComputeKeyPointsOld(allKeypoints);
+
+    const vector<vector<Point> > vNoRotatedPatterns;
+    uchar descReference[32];
+    for (int level = 0; level < nlevels; ++level)
+    {
+        vector<KeyPoint>& keypoints = allKeypoints[level];
+        nKeyPoints += (int)keypoints.size();
+        if(keypoints.empty())
+            continue;
+
+        for (size_t i = 0; i < keypoints.size(); i++)
+        {
+            if (IC_AngleReference(mvImagePyramid[level], keypoints[i].pt, umax) != keypoints[i].angle)
+                nAngleMismatches++;
+        }
+
+        Mat desc;
+        computeDescriptors(mvBlurredPyramid[level], keypoints, desc,
+                           mvPatternX, mvPatternY, vNoRotatedPatterns);
+        for (size_t i = 0; i < keypoints.size(); i++)
+        {
+            computeOrbDescriptorReference(keypoints[i], mvBlurredPyramid[level], &pattern[0], descReference);
+            if (memcmp(descReference, desc.ptr((int)i), 32) != 0)
+                nDescriptorMismatches++;
+        }
+    }
+}
+
+// Blurs the pyramid levels before computing the descriptors, one level per
+// task
+class PyramidBlurInvoker : public ParallelLoopBody
+{
+public:
+    PyramidBlurInvoker(const vector<Mat> &vImages, vector<Mat> &vBlurred):
+        mvImages(vImages), mvBlurred(vBlurred) {}
+
+    virtual void operator()(const Range &range) const
+    {
+        // The levels are views into bordered buffers, and the border pixels
+        // already hold the BORDER_REFLECT_101 values the blur needs
+        for(int level=range.start; level<range.end; level++)
+            GaussianBlur(mvImages[level], mvBlurred[level], Size(7, 7), 2, 2,
+                         BORDER_REFLECT_101);
+    }
+
+private:
+    const vector<Mat> &mvImages;
+    vector<Mat> &mvBlurred;
+};
+
 void ORBextractor::ComputePyramid(cv::Mat image)
 {
     for (int level = 0; level < nlevels; ++level)
@@ -1302,7 +1525,9 @@ void ORBextractor::ComputePyramid(cv::Mat image)
         float scale = mvInvScaleFactor[level];
         Size sz(cvRound((float)image.cols*scale), cvRound((float)image.rows*scale));
         Size wholeSize(sz.width + EDGE_THRESHOLD*2, sz.height + EDGE_THRESHOLD*2);
-        Mat temp(wholeSize, image.type());
+        // Only allocates if the image size changed
+        mvImagePyramidBuffers[level].create(wholeSize, image.type());
+        Mat &temp = mvImagePyramidBuffers[level];
         mvImagePyramid[level] = temp(Rect(EDGE_THRESHOLD, EDGE_THRESHOLD, sz.width, sz.height));
 
         // Compute the resized image
@@ -1320,6 +1545,8 @@ void ORBextractor::ComputePyramid(cv::Mat image)
         }
     }
 
+    parallel_for_(Range(0, nlevels),
+                  PyramidBlurInvoker(mvImagePyramid, mvBlurredPyramid));
 }
 
 void ORBextractor::ComputeQualityImagePyramid(cv::Mat image)
@@ -1331,7 +1558,9 @@ void ORBextractor::ComputeQualityImagePyramid(cv::Mat image)
                 cvRound((float)image.rows*scale));
         Size wholeSize(sz.width + EDGE_THRESHOLD*2, sz.height + 
                        EDGE_THRESHOLD*2);
-        Mat temp(wholeSize, image.type());
+        // Only allocates if the image size changed
+        mvQualityPyramidBuffers[level].create(wholeSize, image.type());
+        Mat &temp = mvQualityPyramidBuffers[level];
         mvQualityImagePyramid[level] = temp(Rect(EDGE_THRESHOLD, 
                        EDGE_THRESHOLD, sz.width, sz.height));
 
@@ -0,0 +1,123 @@
+/**
+* This file is part of ORB-SLAM2.
+* This file is based on the file orb.cpp from the OpenCV library (see BSD license below).
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+* Software License Agreement (BSD License)
+*
+*  Copyright (c) 2009, Willow Garage, Inc.
+*  All rights reserved.
+*
+*  Redistribution and use in source and binary forms, with or without
+*  modification, are permitted provided that the following conditions
+*  are met:
+*
+*   * Redistributions of source code must retain the above copyright
+*     notice, this list of conditions and the following disclaimer.
+*   * Redistributions in binary form must reproduce the above
+*     copyright notice, this list of conditions and the following
+*     disclaimer in the documentation and/or other materials provided
+*     with the distribution.
+*   * Neither the name of the Willow Garage nor the names of its
+*     contributors may be used to endorse or promote products derived
+*     from this software without specific prior written permission.
+*
+*  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+*  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+*  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+*  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+*  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+*  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+*  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+*  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+*  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+*  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+*  POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#include <opencv2/core/core.hpp>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ORBextractorKernels.h"
+
+
+using namespace cv;
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+void computeRotatedOffsets(const float* patternX, const float* patternY,
+                           float angle, int step, int* offsets)
+{
+    angle *= factorPI;
+    float a = (float)cos(angle), b = (float)sin(angle);
+
+    int i = 0;
+#ifdef __SSE2__
+    const __m128 va = _mm_set1_ps(a), vb = _mm_set1_ps(b);
+    const __m128 vstep = _mm_set1_ps((float)step);
+    for (; i <= PATTERN_POINTS - 4; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(patternX + i), y = _mm_loadu_ps(patternY + i);
+        const __m128i dx = _mm_cvtps_epi32(_mm_sub_ps(_mm_mul_ps(x, va), _mm_mul_ps(y, vb)));
+        const __m128i dy = _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(x, vb), _mm_mul_ps(y, va)));
+        // Exact in float for any realistic image width
+        const __m128 offset = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(dy), vstep), _mm_cvtepi32_ps(dx));
+        _mm_storeu_si128((__m128i*)(offsets + i), _mm_cvtps_epi32(offset));
+    }
+#endif
+    for (; i < PATTERN_POINTS; ++i)
+        offsets[i] = cvRound(patternX[i]*b + patternY[i]*a)*step +
+                     cvRound(patternX[i]*a - patternY[i]*b);
+}
+
+void computeOrbDescriptorReference(const KeyPoint& kpt,
+                                   const Mat& img, const Point* pattern,
+                                   uchar* desc)
+{
+    float angle = (float)kpt.angle*factorPI;
+    float a = (float)cos(angle), b = (float)sin(angle);
+
+    const uchar* center = &img.at<uchar>(cvRound(kpt.pt.y), cvRound(kpt.pt.x));
+    const int step = (int)img.step;
+
+    #define GET_VALUE(idx) \
+        center[cvRound(pattern[idx].x*b + pattern[idx].y*a)*step + \
+               cvRound(pattern[idx].x*a - pattern[idx].y*b)]
+
+    for (int i = 0; i < 32; ++i, pattern += 16)
+    {
+        int val = 0;
+        for (int j = 0; j < 8; ++j)
+            val |= (GET_VALUE(2*j) < GET_VALUE(2*j+1)) << j;
+
+        desc[i] = (uchar)val;
+    }
+
+    #undef GET_VALUE
+}
+
+} //namespace ORB_SLAM
@@ -41,92 +41,134 @@ const int ORBmatcher::HISTO_LENGTH = 30;
 ORBmatcher::ORBmatcher(float nnratio, bool checkOri): mfNNratio(nnratio), mbCheckOrientation(checkOri)
 {
 }
+
 // Supports FLAGS_ivslam_propagate_keyptqual
-int ORBmatcher::SearchByProjection(Frame &F, const vector<MapPoint*> &vpMapPoints, const float th)
+int ORBmatcher::SearchByProjection(Frame &F, const LocalMapCuller &culler, const float th, ThreadPool* pThreadPool)
 {
-    int nmatches=0;
-
     const bool bFactor = th!=1.0;
 
-    for(size_t iMP=0; iMP<vpMapPoints.size(); iMP++)
-    {
-        MapPoint* pMP = vpMapPoints[iMP];
-        if(!pMP->mbTrackInView)
-            continue;
+    const int nVisible = culler.NumVisible();
+    vector<int> vBestIdx(nVisible,-1);
+    vector<int> vBestDist(nVisible,256);
 
-        if(pMP->isBad())
-            continue;
+    // Find the best keypoint of each point. F.mvpMapPoints is only read here.
+    auto matchPoints = [&](const int nBegin, const int nEnd)
+    {
+        MapPoint::TrackingState state;
+        for(int iMP=nBegin; iMP<nEnd; iMP++)
+        {
+            MapPoint* pMP = culler.mvpVisible[iMP];
 
-        const int &nPredictedLevel = pMP->mnTrackScaleLevel;
+            const int &nPredictedLevel = culler.mvVisibleLevel[iMP];
 
-        // The size of the window will depend on the viewing direction
-        float r = RadiusByViewingCos(pMP->mTrackViewCos);
+            // The size of the window will depend on the viewing direction
+            float r = RadiusByViewingCos(culler.mvVisibleViewCos[iMP]);
 
-        if(bFactor)
-            r*=th;
+            if(bFactor)
+                r*=th;
 
-        const vector<size_t> vIndices =
-                F.GetFeaturesInArea(pMP->mTrackProjX,pMP->mTrackProjY,r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel);
+            const vector<size_t> vIndices =
+                    F.GetFeaturesInArea(culler.mvVisibleU[iMP],culler.mvVisibleV[iMP],r*F.mvScaleFactors[nPredictedLevel],nPredictedLevel-1,nPredictedLevel);
 
-        if(vIndices.empty())
-            continue;
+            if(vIndices.empty())
+                continue;
 
-        const cv::Mat MPdescriptor = pMP->GetDescriptor();
+            pMP->GetTrackingState(state);
+            if(state.mbBad || !state.mbHasDescriptor)
+                continue;
+            const cv::Mat MPdescriptor(1,32,CV_8U,state.mDescriptor);
 
-        int bestDist=256;
-        int bestLevel= -1;
-        int bestDist2=256;
-        int bestLevel2 = -1;
-        int bestIdx =-1 ;
+            int bestDist=256;
+            int bestLevel= -1;
+            int bestDist2=256;
+            int bestLevel2 = -1;
+            int bestIdx =-1 ;
 
-        // Get best and second matches with near keypoints
-        for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
-        {
-            const size_t idx = *vit;
+            // Get best and second matches with near keypoints
+            for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
+            {
+                const size_t idx = *vit;
 
-            if(F.mvpMapPoints[idx])
-                if(F.mvpMapPoints[idx]->Observations()>0)
-                    continue;
+                if(F.mvpMapPoints[idx])
+                    if(F.mvpMapPoints[idx]->Observations()>0)
+                        continue;
 
-            if(F.mvuRight[idx]>0)
-            {
-                const float er = fabs(pMP->mTrackProjXR-F.mvuRight[idx]);
-                if(er>r*F.mvScaleFactors[nPredictedLevel])
-                    continue;
-            }
+                if(F.mvuRight[idx]>0)
+                {
+                    const float er = fabs(culler.mvVisibleUR[iMP]-F.mvuRight[idx]);
+                    if(er>r*F.mvScaleFactors[nPredictedLevel])
+                        continue;
+                }
 
-            const cv::Mat &d = F.mDescriptors.row(idx);
+                const cv::Mat &d = F.mDescriptors.row(idx);
 
-            const int dist = DescriptorDistance(MPdescriptor,d);
+                const int dist = DescriptorDistance(MPdescriptor,d);
 
-            if(dist<bestDist)
-            {
-                bestDist2=bestDist;
-                bestDist=dist;
-                bestLevel2 = bestLevel;
-                bestLevel = F.mvKeysUn[idx].octave;
-                bestIdx=idx;
+                if(dist<bestDist)
+                {
+                    bestDist2=bestDist;
+                    bestDist=dist;
+                    bestLevel2 = bestLevel;
+                    bestLevel = F.mvKeysUn[idx].octave;
+                    bestIdx=idx;
+                }
+                else if(dist<bestDist2)
+                {
+                    bestLevel2 = F.mvKeysUn[idx].octave;
+                    bestDist2=dist;
+                }
             }
-            else if(dist<bestDist2)
+
+            // Apply ratio to second match (only if best and second are in the same scale level)
+            if(bestDist<=TH_HIGH)
             {
-                bestLevel2 = F.mvKeysUn[idx].octave;
-                bestDist2=dist;
+                if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
+                    continue;
+
+                vBestIdx[iMP]=bestIdx;
+                vBestDist[iMP]=bestDist;
             }
         }
+    };
 
-        // Apply ratio to second match (only if best and second are in the same scale level)
-        if(bestDist<=TH_HIGH)
+    if(pThreadPool && pThreadPool->NumThreads()>1)
+    {
+        // Contiguous chunks, one per thread
+        const int nChunks = pThreadPool->NumThreads();
+        const int nChunkSize = (nVisible+nChunks-1)/nChunks;
+        pThreadPool->ParallelFor(nChunks, [&](int i)
         {
-            if(bestLevel==bestLevel2 && bestDist>mfNNratio*bestDist2)
-                continue;
+            const int nBegin = min(i*nChunkSize,nVisible);
+            const int nEnd = min(nBegin+nChunkSize,nVisible);
+            matchPoints(nBegin,nEnd);
+        });
+    }
+    else
+    {
+        matchPoints(0,nVisible);
+    }
 
-            F.mvpMapPoints[bestIdx]=pMP;
-            nmatches++;
-        }
+    // Resolve keypoints chosen by several points, keeping the closest descriptor
+    vector<int> vKeyPointOwner(F.N,-1);
+    for(int iMP=0; iMP<nVisible; iMP++)
+    {
+        const int idx = vBestIdx[iMP];
+        if(idx<0)
+            continue;
+        const int owner = vKeyPointOwner[idx];
+        if(owner<0 || vBestDist[iMP]<vBestDist[owner])
+            vKeyPointOwner[idx]=iMP;
     }
-    
-    // TODO: Optimize for efficiency. Updating can only happend for newly 
-    // matched keypoints
+
+    int nmatches=0;
+    for(int idx=0; idx<F.N; idx++)
+    {
+        if(vKeyPointOwner[idx]<0)
+            continue;
+        F.mvpMapPoints[idx]=culler.mvpVisible[vKeyPointOwner[idx]];
+        nmatches++;
+    }
+
     if(FLAGS_ivslam_propagate_keyptqual) {
       UpdateQualityScores(F);
     }
@@ -261,11 +303,11 @@ int ORBmatcher::SearchByBoW(KeyFrame* pKF,Frame &F, vector<MapPoint*> &vpMapPoin
         }
         else if(KFit->first < Fit->first)
         {
-            KFit = vFeatVecKF.lower_bound(Fit->first);
+            KFit = DBoW2::gallopLowerBound(KFit, KFend, Fit->first);
         }
         else
         {
-            Fit = F.mFeatVec.lower_bound(KFit->first);
+            Fit = DBoW2::gallopLowerBound(Fit, Fend, KFit->first);
         }
     }
 
@@ -629,11 +671,11 @@ int ORBmatcher::SearchByBoW(KeyFrame *pKF1, KeyFrame *pKF2, vector<MapPoint *> &
         }
         else if(f1it->first < f2it->first)
         {
-            f1it = vFeatVec1.lower_bound(f2it->first);
+            f1it = DBoW2::gallopLowerBound(f1it, f1end, f2it->first);
         }
         else
         {
-            f2it = vFeatVec2.lower_bound(f1it->first);
+            f2it = DBoW2::gallopLowerBound(f2it, f2end, f1it->first);
         }
     }
 
@@ -786,11 +828,11 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
         }
         else if(f1it->first < f2it->first)
         {
-            f1it = vFeatVec1.lower_bound(f2it->first);
+            f1it = DBoW2::gallopLowerBound(f1it, f1end, f2it->first);
         }
         else
         {
-            f2it = vFeatVec2.lower_bound(f1it->first);
+            f2it = DBoW2::gallopLowerBound(f2it, f2end, f1it->first);
         }
     }
 
@@ -828,10 +870,42 @@ int ORBmatcher::SearchForTriangulation(KeyFrame *pKF1, KeyFrame *pKF2, cv::Mat F
     return nmatches;
 }
 
-int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const float th)
+int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const float th, ThreadPool* pThreadPool)
 {
-    cv::Mat Rcw = pKF->GetRotation();
-    cv::Mat tcw = pKF->GetTranslation();
+    vector<FusionCandidate> vCandidates;
+
+    if(pThreadPool && pThreadPool->NumThreads()>1)
+    {
+        // The chunks do not depend on the number of threads and are merged in order, so the
+        // candidates are the same as the ones of a single search
+        const int nChunkSize = 128;
+        const int nPoints = vpMapPoints.size();
+        const int nChunks = (nPoints+nChunkSize-1)/nChunkSize;
+        vector<vector<FusionCandidate> > vvChunkCandidates(nChunks);
+        pThreadPool->ParallelFor(nChunks, [&](int i)
+        {
+            const int nBegin = i*nChunkSize;
+            const int nEnd = min(nBegin+nChunkSize,nPoints);
+            const vector<MapPoint*> vpChunk(vpMapPoints.begin()+nBegin,vpMapPoints.begin()+nEnd);
+            SearchForFusion(pKF,vpChunk,vvChunkCandidates[i],th);
+        });
+
+        for(int i=0; i<nChunks; i++)
+            vCandidates.insert(vCandidates.end(),vvChunkCandidates[i].begin(),vvChunkCandidates[i].end());
+    }
+    else
+    {
+        SearchForFusion(pKF,vpMapPoints,vCandidates,th);
+    }
+
+    return ApplyFusion(pKF,vCandidates);
+}
+
+int ORBmatcher::SearchForFusion(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints,
+                                vector<FusionCandidate> &vCandidates, const float th)
+{
+    const Eigen::Matrix3f Rcw = pKF->GetRotationEig();
+    const Eigen::Vector3f tcw = pKF->GetTranslationEig();
 
     const float &fx = pKF->fx;
     const float &fy = pKF->fy;
@@ -839,9 +913,9 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
     const float &cy = pKF->cy;
     const float &bf = pKF->mbf;
 
-    cv::Mat Ow = pKF->GetCameraCenter();
+    const Eigen::Vector3f Ow = pKF->GetCameraCenterEig();
 
-    int nFused=0;
+    int nmatches=0;
 
     const int nMPs = vpMapPoints.size();
 
@@ -855,16 +929,16 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
         if(pMP->isBad() || pMP->IsInKeyFrame(pKF))
             continue;
 
-        cv::Mat p3Dw = pMP->GetWorldPos();
-        cv::Mat p3Dc = Rcw*p3Dw + tcw;
+        const Eigen::Vector3f p3Dw = pMP->GetWorldPosEig();
+        const Eigen::Vector3f p3Dc = Rcw*p3Dw + tcw;
 
         // Depth must be positive
-        if(p3Dc.at<float>(2)<0.0f)
+        if(p3Dc(2)<0.0f)
             continue;
 
-        const float invz = 1/p3Dc.at<float>(2);
-        const float x = p3Dc.at<float>(0)*invz;
-        const float y = p3Dc.at<float>(1)*invz;
+        const float invz = 1/p3Dc(2);
+        const float x = p3Dc(0)*invz;
+        const float y = p3Dc(1)*invz;
 
         const float u = fx*x+cx;
         const float v = fy*y+cy;
@@ -877,104 +951,149 @@ int ORBmatcher::Fuse(KeyFrame *pKF, const vector<MapPoint *> &vpMapPoints, const
 
         const float maxDistance = pMP->GetMaxDistanceInvariance();
         const float minDistance = pMP->GetMinDistanceInvariance();
-        cv::Mat PO = p3Dw-Ow;
-        const float dist3D = cv::norm(PO);
+        const Eigen::Vector3f PO = p3Dw-Ow;
+        const float dist3D = PO.norm();
 
         // Depth must be inside the scale pyramid of the image
         if(dist3D<minDistance || dist3D>maxDistance )
             continue;
 
         // Viewing angle must be less than 60 deg
-        cv::Mat Pn = pMP->GetNormal();
+        const Eigen::Vector3f Pn = pMP->GetNormalEig();
 
         if(PO.dot(Pn)<0.5*dist3D)
             continue;
 
-        int nPredictedLevel = pMP->PredictScale(dist3D,pKF);
+        FusionCandidate candidate;
+        candidate.pMP = pMP;
+        candidate.u = u;
+        candidate.v = v;
+        candidate.ur = ur;
+        candidate.nPredictedLevel = pMP->PredictScale(dist3D,pKF);
 
         // Search in a radius
-        const float radius = th*pKF->mvScaleFactors[nPredictedLevel];
+        candidate.radius = th*pKF->mvScaleFactors[candidate.nPredictedLevel];
 
-        const vector<size_t> vIndices = pKF->GetFeaturesInArea(u,v,radius);
+        // Match to the most similar keypoint in the radius
+        candidate.descriptor = pMP->GetDescriptor();
+        candidate.bestIdx = MatchFusionCandidate(pKF,candidate,candidate.descriptor);
+        if(candidate.bestIdx>=0)
+            nmatches++;
 
-        if(vIndices.empty())
+        // Points without a match are kept too, an earlier fusion can change their descriptor
+        vCandidates.push_back(candidate);
+    }
+
+    return nmatches;
+}
+
+int ORBmatcher::MatchFusionCandidate(KeyFrame *pKF, const FusionCandidate &candidate, const cv::Mat &dMP)
+{
+    const float &u = candidate.u;
+    const float &v = candidate.v;
+    const float &ur = candidate.ur;
+    const int &nPredictedLevel = candidate.nPredictedLevel;
+
+    const vector<size_t> vIndices = pKF->GetFeaturesInArea(u,v,candidate.radius);
+
+    int bestDist = 256;
+    int bestIdx = -1;
+    for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
+    {
+        const size_t idx = *vit;
+
+        const cv::KeyPoint &kp = pKF->mvKeysUn[idx];
+
+        const int &kpLevel= kp.octave;
+
+        if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
             continue;
 
-        // Match to the most similar keypoint in the radius
+        if(pKF->mvuRight[idx]>=0)
+        {
+            // Check reprojection error in stereo
+            const float &kpx = kp.pt.x;
+            const float &kpy = kp.pt.y;
+            const float &kpr = pKF->mvuRight[idx];
+            const float ex = u-kpx;
+            const float ey = v-kpy;
+            const float er = ur-kpr;
+            const float e2 = ex*ex+ey*ey+er*er;
+
+            if(e2*pKF->mvInvLevelSigma2[kpLevel]>7.8)
+                continue;
+        }
+        else
+        {
+            const float &kpx = kp.pt.x;
+            const float &kpy = kp.pt.y;
+            const float ex = u-kpx;
+            const float ey = v-kpy;
+            const float e2 = ex*ex+ey*ey;
 
-        const cv::Mat dMP = pMP->GetDescriptor();
+            if(e2*pKF->mvInvLevelSigma2[kpLevel]>5.99)
+                continue;
+        }
 
-        int bestDist = 256;
-        int bestIdx = -1;
-        for(vector<size_t>::const_iterator vit=vIndices.begin(), vend=vIndices.end(); vit!=vend; vit++)
+        const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+
+        const int dist = DescriptorDistance(dMP,dKF);
+
+        if(dist<bestDist)
         {
-            const size_t idx = *vit;
+            bestDist = dist;
+            bestIdx = idx;
+        }
+    }
 
-            const cv::KeyPoint &kp = pKF->mvKeysUn[idx];
+    if(bestDist<=TH_LOW)
+        return bestIdx;
 
-            const int &kpLevel= kp.octave;
+    return -1;
+}
 
-            if(kpLevel<nPredictedLevel-1 || kpLevel>nPredictedLevel)
-                continue;
+int ORBmatcher::ApplyFusion(KeyFrame *pKF, const vector<FusionCandidate> &vCandidates)
+{
+    int nFused=0;
 
-            if(pKF->mvuRight[idx]>=0)
-            {
-                // Check reprojection error in stereo
-                const float &kpx = kp.pt.x;
-                const float &kpy = kp.pt.y;
-                const float &kpr = pKF->mvuRight[idx];
-                const float ex = u-kpx;
-                const float ey = v-kpy;
-                const float er = ur-kpr;
-                const float e2 = ex*ex+ey*ey+er*er;
-
-                if(e2*pKF->mvInvLevelSigma2[kpLevel]>7.8)
-                    continue;
-            }
-            else
-            {
-                const float &kpx = kp.pt.x;
-                const float &kpy = kp.pt.y;
-                const float ex = u-kpx;
-                const float ey = v-kpy;
-                const float e2 = ex*ex+ey*ey;
+    for(size_t i=0, iend=vCandidates.size(); i<iend; i++)
+    {
+        const FusionCandidate &candidate = vCandidates[i];
+        MapPoint* pMP = candidate.pMP;
 
-                if(e2*pKF->mvInvLevelSigma2[kpLevel]>5.99)
-                    continue;
-            }
+        // An earlier fusion can replace pMP, associate it with pKF or, when pMP survives a
+        // replacement, recompute its descriptor. The position, normal and distances that decide
+        // where it projects are not changed by a fusion.
+        if(pMP->isBad() || pMP->IsInKeyFrame(pKF))
+            continue;
 
-            const cv::Mat &dKF = pKF->mDescriptors.row(idx);
+        int bestIdx = candidate.bestIdx;
+        const cv::Mat dMP = pMP->GetDescriptor();
+        if(DescriptorDistance(dMP,candidate.descriptor)!=0)
+            bestIdx = MatchFusionCandidate(pKF,candidate,dMP);
 
-            const int dist = DescriptorDistance(dMP,dKF);
+        if(bestIdx<0)
+            continue;
 
-            if(dist<bestDist)
+        // If there is already a MapPoint replace otherwise add new measurement. The keypoint
+        // is read now, so the fusions applied before this one are seen.
+        MapPoint* pMPinKF = pKF->GetMapPoint(bestIdx);
+        if(pMPinKF)
+        {
+            if(!pMPinKF->isBad())
             {
-                bestDist = dist;
-                bestIdx = idx;
+                if(pMPinKF->Observations()>pMP->Observations())
+                    pMP->Replace(pMPinKF);
+                else
+                    pMPinKF->Replace(pMP);
             }
         }
-
-        // If there is already a MapPoint replace otherwise add new measurement
-        if(bestDist<=TH_LOW)
+        else
         {
-            MapPoint* pMPinKF = pKF->GetMapPoint(bestIdx);
-            if(pMPinKF)
-            {
-                if(!pMPinKF->isBad())
-                {
-                    if(pMPinKF->Observations()>pMP->Observations())
-                        pMP->Replace(pMPinKF);
-                    else
-                        pMPinKF->Replace(pMP);
-                }
-            }
-            else
-            {
-                pMP->AddObservation(pKF,bestIdx);
-                pKF->AddMapPoint(pMP,bestIdx);
-            }
-            nFused++;
+            pMP->AddObservation(pKF,bestIdx);
+            pKF->AddMapPoint(pMP,bestIdx);
         }
+        nFused++;
     }
 
     return nFused;
@@ -1392,6 +1511,9 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
     const bool bForward = tlc.at<float>(2)>CurrentFrame.mb && !bMono;
     const bool bBackward = -tlc.at<float>(2)>CurrentFrame.mb && !bMono;
 
+    const Eigen::Matrix3f &RcwEig = CurrentFrame.GetRotationEig();
+    const Eigen::Vector3f &tcwEig = CurrentFrame.GetTranslationEig();
+
     for(int i=0; i<LastFrame.N; i++)
     {
         MapPoint* pMP = LastFrame.mvpMapPoints[i];
@@ -1401,12 +1523,11 @@ int ORBmatcher::SearchByProjection(Frame &CurrentFrame, const Frame &LastFrame,
             if(!LastFrame.mvbOutlier[i])
             {
                 // Project
-                cv::Mat x3Dw = pMP->GetWorldPos();
-                cv::Mat x3Dc = Rcw*x3Dw+tcw;
+                const Eigen::Vector3f x3Dc = RcwEig*pMP->GetWorldPosEig()+tcwEig;
 
-                const float xc = x3Dc.at<float>(0);
-                const float yc = x3Dc.at<float>(1);
-                const float invzc = 1.0/x3Dc.at<float>(2);
+                const float xc = x3Dc(0);
+                const float yc = x3Dc(1);
+                const float invzc = 1.0/x3Dc(2);
 
                 if(invzc<0)
                     continue;
@@ -29,9 +29,9 @@
 #include "Thirdparty/g2o/g2o/types/types_seven_dof_expmap.h"
 
 #include<Eigen/StdVector>
-#include <boost/math/distributions.hpp>
 #include <unordered_map>
 #include "Converter.h"
+#include "Chi2Quantiles.h"
 #include <glog/logging.h>
 #include <algorithm>
 
@@ -47,17 +47,51 @@ DEFINE_int32(optimizer_pose_opt_iter_count, 4,
 namespace ORB_SLAM2
 {
 
+// Sets the quality score of each map point from the sum of the reprojection
+// errors of its observations, scaled between the median and the 95% quantile
+// of the chi2 distribution with the summed degrees of freedom
+static void UpdateMapPointQualityScores(const list<MapPoint*> &lMapPoints)
+{
+    static const Chi2QuantileTable chi2Median(0.5);
+    static const Chi2QuantileTable chi2Quantile95(0.95);
+
+    for(list<MapPoint*>::const_iterator lit=lMapPoints.begin(),
+        lend=lMapPoints.end(); lit!=lend; lit++)
+    {
+        MapPoint* pMP = *lit;
+        double chi2;
+        int chi2DOF;
+        pMP->GetChi2Sum(chi2, chi2DOF);
+
+        if(chi2DOF < 1)
+            continue;
+
+        const double thresh_max = chi2Quantile95(chi2DOF);
+        const double thresh_min = chi2Median(chi2DOF);
+
+        double scaled_err = (chi2 - thresh_min) / (thresh_max - thresh_min);
+        scaled_err = (scaled_err > 1.0)? 1.0: scaled_err;
+        scaled_err = (scaled_err < 0.0)? 0.0: scaled_err;
+
+        float qual_score = 1.0 / (1.0 + static_cast<float>(scaled_err));
+        float qual_score_norm = 2 * qual_score - 1;
+        pMP->SetQualityScore(qual_score_norm);
+    }
+}
 
-void Optimizer::GlobalBundleAdjustemnt(Map* pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust)
+
+void Optimizer::GlobalBundleAdjustemnt(Map* pMap, int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust,
+                                       const int nThreads)
 {
     vector<KeyFrame*> vpKFs = pMap->GetAllKeyFrames();
     vector<MapPoint*> vpMP = pMap->GetAllMapPoints();
-    BundleAdjustment(vpKFs,vpMP,nIterations,pbStopFlag, nLoopKF, bRobust);
+    BundleAdjustment(vpKFs,vpMP,nIterations,pbStopFlag, nLoopKF, bRobust, nThreads);
 }
 
 
 void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<MapPoint *> &vpMP,
-                                 int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust)
+                                 int nIterations, bool* pbStopFlag, const unsigned long nLoopKF, const bool bRobust,
+                                 const int nThreads)
 {
     vector<bool> vbNotIncludedMP;
     vbNotIncludedMP.resize(vpMP.size());
@@ -71,6 +105,7 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
 
     g2o::OptimizationAlgorithmLevenberg* solver = new g2o::OptimizationAlgorithmLevenberg(solver_ptr);
     optimizer.setAlgorithm(solver);
+    optimizer.setNumThreads(nThreads);
 
     if(pbStopFlag)
         optimizer.setForceStopFlag(pbStopFlag);
@@ -98,6 +133,11 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
     // Set MapPoint vertices
     for(size_t i=0; i<vpMP.size(); i++)
     {
+        // Building the graph of a large map takes a while, so also check for
+        // an abort request here
+        if(pbStopFlag && *pbStopFlag)
+            return;
+
         MapPoint* pMP = vpMP[i];
         if(pMP->isBad())
             continue;
@@ -108,11 +148,11 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
         vPoint->setMarginalized(true);
         optimizer.addVertex(vPoint);
 
-       const map<KeyFrame*,size_t> observations = pMP->GetObservations();
+       const map<KeyFrame*,size_t,IdLess> observations = pMP->GetObservations();
 
         int nEdges = 0;
         //SET EDGES
-        for(map<KeyFrame*,size_t>::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
+        for(map<KeyFrame*,size_t,IdLess>::const_iterator mit=observations.begin(); mit!=observations.end(); mit++)
         {
 
             KeyFrame* pKF = mit->first;
@@ -199,6 +239,10 @@ void Optimizer::BundleAdjustment(const vector<KeyFrame *> &vpKFs, const vector<M
     optimizer.initializeOptimization();
     optimizer.optimize(nIterations);
 
+    // The result of an aborted optimization is discarded
+    if(pbStopFlag && *pbStopFlag)
+        return;
+
     // Recover optimized data
 
     //Keyframes
@@ -305,7 +349,7 @@ int Optimizer::PoseOptimization(Frame *pFrame, bool logging)
 
 
     {
-    unique_lock<mutex> lock(MapPoint::mGlobalMutex);
+    unique_lock<mutex> lock(pFrame->mpContext->mMutexPointPos);
 
     for(int i=0; i<N; i++)
     {
@@ -545,8 +589,8 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF,
     list<KeyFrame*> lFixedCameras;
     for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), lend=lLocalMapPoints.end(); lit!=lend; lit++)
     {
-        map<KeyFrame*,size_t> observations = (*lit)->GetObservations();
-        for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        map<KeyFrame*,size_t,IdLess> observations = (*lit)->GetObservations();
+        for(map<KeyFrame*,size_t,IdLess>::iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
         {
             KeyFrame* pKFi = mit->first;
 
@@ -563,7 +607,12 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF,
     g2o::SparseOptimizer optimizer;
     g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
 
-    linearSolver = new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+    g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType> * linearSolverEigen =
+        new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+    // The reduced camera system of a local BA is small and mostly dense, so
+    // it is solved with a dense Cholesky decomposition
+    linearSolverEigen->setDenseBlockPath(300, 0.3);
+    linearSolver = linearSolverEigen;
 
     g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
 
@@ -656,10 +705,10 @@ void Optimizer::LocalBundleAdjustment(KeyFrame *pKF,
         vPoint->setMarginalized(true);
         optimizer.addVertex(vPoint);
 
-        const map<KeyFrame*,size_t> observations = pMP->GetObservations();
+        const map<KeyFrame*,size_t,IdLess> observations = pMP->GetObservations();
 
         //Set edges
-        for(map<KeyFrame*,size_t>::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
+        for(map<KeyFrame*,size_t,IdLess>::const_iterator mit=observations.begin(), mend=observations.end(); mit!=mend; mit++)
         {
             KeyFrame* pKFi = mit->first;
 
@@ -917,8 +966,8 @@ vit!=vend; vit++)
     for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), 
 lend=lLocalMapPoints.end(); lit!=lend; lit++)
     {
-        map<KeyFrame*,size_t> observations = (*lit)->GetObservations();
-        for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), 
+        map<KeyFrame*,size_t,IdLess> observations = (*lit)->GetObservations();
+        for(map<KeyFrame*,size_t,IdLess>::iterator mit=observations.begin(), 
 mend=observations.end(); mit!=mend; mit++)
         {
             KeyFrame* pKFi = mit->first;
@@ -937,8 +986,11 @@ pKFi->mnBAFixedForKF!=pKF->mnId)
     g2o::SparseOptimizer optimizer;
     g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
 
-    linearSolver = new 
-g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+    g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType> * linearSolverEigen =
+        new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+    // Same dense solve as in LocalBundleAdjustment
+    linearSolverEigen->setDenseBlockPath(300, 0.3);
+    linearSolver = linearSolverEigen;
 
     g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
 
@@ -1018,10 +1070,10 @@ lend=lLocalMapPoints.end(); lit!=lend; lit++)
         vPoint->setMarginalized(true);
         optimizer.addVertex(vPoint);
 
-        const map<KeyFrame*,size_t> observations = pMP->GetObservations();
+        const map<KeyFrame*,size_t,IdLess> observations = pMP->GetObservations();
 
         //Set edges
-        for(map<KeyFrame*,size_t>::const_iterator mit=observations.begin(), 
+        for(map<KeyFrame*,size_t,IdLess>::const_iterator mit=observations.begin(), 
             mend=observations.end(); mit!=mend; mit++)
         {
             KeyFrame* pKFi = mit->first;
@@ -1188,8 +1240,7 @@ lend=lLocalMapPoints.end(); lit!=lend; lit++)
             KeyFrame* pKFi = vpEdgeKFMono[i];
             vToErase.push_back(make_pair(pKFi,pMP));
         }
-        pMP->mlnChi2Dof[vpEdgeKFMono[i]] = 2;
-        pMP->mldChi2[vpEdgeKFMono[i]] = e->chi2();
+        pMP->SetObservationChi2(vpEdgeKFMono[i], e->chi2(), 2);
     }
    
 
@@ -1207,8 +1258,7 @@ lend=lLocalMapPoints.end(); lit!=lend; lit++)
             vToErase.push_back(make_pair(pKFi,pMP));
         }
         
-        pMP->mlnChi2Dof[vpEdgeKFStereo[i]] = 3;
-        pMP->mldChi2[vpEdgeKFStereo[i]] = e->chi2();
+        pMP->SetObservationChi2(vpEdgeKFStereo[i], e->chi2(), 3);
     }
    
     // Get Map Mutex
@@ -1229,38 +1279,7 @@ lend=lLocalMapPoints.end(); lit!=lend; lit++)
 
     // Update the quality score for all map points given the overall normalized
     // reprojection error on all connected keyframes
-    for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), 
-        lend=lLocalMapPoints.end(); lit!=lend; lit++) {
-      MapPoint* pMP = *lit;
-      int chi2DOF = 0;
-      double chi2 = 0;
-      for(unordered_map<KeyFrame*, int>::iterator it = pMP->mlnChi2Dof.begin(); 
-          it != pMP->mlnChi2Dof.end(); it++) {
-        chi2DOF += it->second;
-      }
-      
-      for(unordered_map<KeyFrame*, double>::iterator it = pMP->mldChi2.begin(); 
-          it != pMP->mldChi2.end(); it++) {
-        chi2 += it->second;
-      }
-    
-      
-      if (chi2DOF < 1) {
-        continue;
-      }
-      
-      boost::math::chi_squared_distribution<double> distribution(chi2DOF);
-      double thresh_max = quantile(distribution, 0.95);
-      double thresh_min = quantile(distribution, 0.5);
-      
-      double scaled_err = (chi2 - thresh_min) / (thresh_max - thresh_min);
-      scaled_err = (scaled_err > 1.0)? 1.0: scaled_err;
-      scaled_err = (scaled_err < 0.0)? 0.0: scaled_err;
-      
-      float qual_score = 1.0 / (1.0 + static_cast<float>(scaled_err));
-      float qual_score_norm = 2 * qual_score - 1;
-      pMP->SetQualityScore(qual_score_norm);
-    }
+    UpdateMapPointQualityScores(lLocalMapPoints);
     
     // Recover optimized data
 
@@ -1335,8 +1354,8 @@ void Optimizer::ConstrainedLocalBundleAdjustment(KeyFrame *pKF,
     // are not local key frames
     for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), 
         lend=lLocalMapPoints.end(); lit!=lend; lit++) {
-        map<KeyFrame*,size_t> observations = (*lit)->GetObservations();
-        for(map<KeyFrame*,size_t>::iterator mit=observations.begin(), 
+        map<KeyFrame*,size_t,IdLess> observations = (*lit)->GetObservations();
+        for(map<KeyFrame*,size_t,IdLess>::iterator mit=observations.begin(), 
                            mend=observations.end(); mit!=mend; mit++) {
             KeyFrame* pKFi = mit->first;
 
@@ -1356,8 +1375,11 @@ void Optimizer::ConstrainedLocalBundleAdjustment(KeyFrame *pKF,
     g2o::SparseOptimizer optimizer;
     g2o::BlockSolver_6_3::LinearSolverType * linearSolver;
 
-    linearSolver = new 
-g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+    g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType> * linearSolverEigen =
+        new g2o::LinearSolverEigen<g2o::BlockSolver_6_3::PoseMatrixType>();
+    // Same dense solve as in LocalBundleAdjustment
+    linearSolverEigen->setDenseBlockPath(300, 0.3);
+    linearSolver = linearSolverEigen;
 
     g2o::BlockSolver_6_3 * solver_ptr = new g2o::BlockSolver_6_3(linearSolver);
 
@@ -1429,10 +1451,10 @@ lend=lLocalMapPoints.end(); lit!=lend; lit++)
         vPoint->setMarginalized(true);
         optimizer.addVertex(vPoint);
 
-        const map<KeyFrame*,size_t> observations = pMP->GetObservations();
+        const map<KeyFrame*,size_t,IdLess> observations = pMP->GetObservations();
 
         //Set edges
-        for(map<KeyFrame*,size_t>::const_iterator mit=observations.begin(), 
+        for(map<KeyFrame*,size_t,IdLess>::const_iterator mit=observations.begin(), 
             mend=observations.end(); mit!=mend; mit++) {
             KeyFrame* pKFi = mit->first;
 
@@ -1563,8 +1585,7 @@ pKFi->mvInvLevelSigma2[kpUn.octave];
           pKFi->mvKeyQualScore[keypt_idx] = qual_score_norm;
         }
         
-        pMP->mlnChi2Dof[vpEdgeKFMono[i]] = 2;
-        pMP->mldChi2[vpEdgeKFMono[i]] = e->chi2();
+        pMP->SetObservationChi2(vpEdgeKFMono[i], e->chi2(), 2);
     }
 
     for(size_t i=0, iend=vpEdgesStereo.size(); i<iend;i++)
@@ -1597,8 +1618,7 @@ pKFi->mvInvLevelSigma2[kpUn.octave];
           pKFi->mvKeyQualScore[keypt_idx] = qual_score_norm;
         }
         
-        pMP->mlnChi2Dof[vpEdgeKFStereo[i]] = 3;
-        pMP->mldChi2[vpEdgeKFStereo[i]] = e->chi2();
+        pMP->SetObservationChi2(vpEdgeKFStereo[i], e->chi2(), 3);
     }
    
 
@@ -1661,67 +1681,9 @@ pKFi->mvInvLevelSigma2[kpUn.octave];
         }
     }
     
-    // Remove the record from map point's reprojection error history for 
-    // observations that were classified as outlier in this round of 
-    // optimization
-    if(!vToErase.empty()) {
-        for(size_t i=0;i<vToErase.size();i++)
-        {
-            KeyFrame* pKFi = vToErase[i].first;
-            MapPoint* pMPi = vToErase[i].second;
-            
-            if (pMPi->mlnChi2Dof.find(pKFi) != pMPi->mlnChi2Dof.end()) {
-              cout << "size: before: " <<  pMPi->mlnChi2Dof.size() << endl;
-              cout << "size: before: " <<  pMPi->mldChi2.size() << endl;
-              
-              auto it_c = pMPi->mlnChi2Dof.find(pKFi);
-              pMPi->mlnChi2Dof.erase(it_c);
-              
-              auto it_v = pMPi->mldChi2.find(pKFi);
-              pMPi->mldChi2.erase(it_v);
-              
-              cout << "size: after: " <<  pMPi->mlnChi2Dof.size() << endl;
-              cout << "size: after: " <<  pMPi->mldChi2.size() << endl;
-            }
-        }
-    }
-    
-    
     // Update the quality score for all map points given the overall normalized
     // reprojection error on all connected keyframes
-    for(list<MapPoint*>::iterator lit=lLocalMapPoints.begin(), 
-        lend=lLocalMapPoints.end(); lit!=lend; lit++) {
-      MapPoint* pMP = *lit;
-      int chi2DOF = 0;
-      double chi2 = 0;
-      for(unordered_map<KeyFrame*, int>::iterator it = pMP->mlnChi2Dof.begin(); 
-          it != pMP->mlnChi2Dof.end(); it++) {
-        chi2DOF += it->second;
-      }
-      
-      for(unordered_map<KeyFrame*, double>::iterator it = pMP->mldChi2.begin(); 
-          it != pMP->mldChi2.end(); it++) {
-        chi2 += it->second;
-      }
-     
-      cout << "chi2DOF: " << chi2DOF << "  chi2: " << chi2 << endl;
-      
-      if (chi2DOF < 1) {
-        continue;
-      }
-      
-      boost::math::chi_squared_distribution<double> distribution(chi2DOF);
-      double thresh_max = quantile(distribution, 0.95);
-      double thresh_min = quantile(distribution, 0.5);
-      
-      double scaled_err = (chi2 - thresh_min) / (thresh_max - thresh_min);
-      scaled_err = (scaled_err > 1.0)? 1.0: scaled_err;
-      scaled_err = (scaled_err < 0.0)? 0.0: scaled_err;
-      
-      float qual_score = 1.0 / (1.0 + static_cast<float>(scaled_err));
-      float qual_score_norm = 2 * qual_score - 1;
-      pMP->SetQualityScore(qual_score_norm);
-    }
+    UpdateMapPointQualityScores(lLocalMapPoints);
     
     
 
@@ -1753,7 +1715,7 @@ static_cast<g2o::VertexSBAPointXYZ*>(optimizer.vertex(pMP->mnId+maxKFid+1));
 void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* pCurKF,
                                        const LoopClosing::KeyFrameAndPose &NonCorrectedSim3,
                                        const LoopClosing::KeyFrameAndPose &CorrectedSim3,
-                                       const map<KeyFrame *, set<KeyFrame *> > &LoopConnections, const bool &bFixScale)
+                                       const map<KeyFrame *, set<KeyFrame *, IdLess>, IdLess> &LoopConnections, const bool &bFixScale)
 {
     // Setup optimizer
     g2o::SparseOptimizer optimizer;
@@ -1821,15 +1783,15 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
     const Eigen::Matrix<double,7,7> matLambda = Eigen::Matrix<double,7,7>::Identity();
 
     // Set Loop edges
-    for(map<KeyFrame *, set<KeyFrame *> >::const_iterator mit = LoopConnections.begin(), mend=LoopConnections.end(); mit!=mend; mit++)
+    for(map<KeyFrame *, set<KeyFrame *, IdLess>, IdLess>::const_iterator mit = LoopConnections.begin(), mend=LoopConnections.end(); mit!=mend; mit++)
     {
         KeyFrame* pKF = mit->first;
         const long unsigned int nIDi = pKF->mnId;
-        const set<KeyFrame*> &spConnections = mit->second;
+        const set<KeyFrame*,IdLess> &spConnections = mit->second;
         const g2o::Sim3 Siw = vScw[nIDi];
         const g2o::Sim3 Swi = Siw.inverse();
 
-        for(set<KeyFrame*>::const_iterator sit=spConnections.begin(), send=spConnections.end(); sit!=send; sit++)
+        for(set<KeyFrame*,IdLess>::const_iterator sit=spConnections.begin(), send=spConnections.end(); sit!=send; sit++)
         {
             const long unsigned int nIDj = (*sit)->mnId;
             if((nIDi!=pCurKF->mnId || nIDj!=pLoopKF->mnId) && pKF->GetWeight(*sit)<minFeat)
@@ -1895,8 +1857,8 @@ void Optimizer::OptimizeEssentialGraph(Map* pMap, KeyFrame* pLoopKF, KeyFrame* p
         }
 
         // Loop edges
-        const set<KeyFrame*> sLoopEdges = pKF->GetLoopEdges();
-        for(set<KeyFrame*>::const_iterator sit=sLoopEdges.begin(), send=sLoopEdges.end(); sit!=send; sit++)
+        const set<KeyFrame*,IdLess> sLoopEdges = pKF->GetLoopEdges();
+        for(set<KeyFrame*,IdLess>::const_iterator sit=sLoopEdges.begin(), send=sLoopEdges.end(); sit!=send; sit++)
         {
             KeyFrame* pLKF = *sit;
             if(pLKF->mnId<pKF->mnId)
@@ -863,21 +863,10 @@ void PnPsolver::gauss_newton(const CvMat * L_6x10, const CvMat * Rho,
 
 void PnPsolver::qr_solve(CvMat * A, CvMat * b, CvMat * X)
 {
-  static int max_nr = 0;
-  static double * A1, * A2;
-
   const int nr = A->rows;
   const int nc = A->cols;
 
-  if (max_nr != 0 && max_nr < nr) {
-    delete [] A1;
-    delete [] A2;
-  }
-  if (max_nr < nr) {
-    max_nr = nr;
-    A1 = new double[nr];
-    A2 = new double[nr];
-  }
+  vector<double> A1(nr), A2(nr);
 
   double * pA = A->data.db, * ppAkk = pA;
   for(int k = 0; k < nc; k++) {
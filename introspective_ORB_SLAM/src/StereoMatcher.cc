@@ -0,0 +1,294 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "StereoMatcher.h"
+#include "Frame.h"
+#include "ORBmatcher.h"
+#include "ORBextractor.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace ORB_SLAM2
+{
+
+// Half size of the SAD window and of the sliding range
+static const int W = 5;
+static const int L = 5;
+
+StereoMatcher::StereoMatcher(int nThreads): mThreadPool(nThreads)
+{
+}
+
+int StereoMatcher::PatchSAD(const uchar* pL, const size_t strideL, const uchar* pR, const size_t strideR)
+{
+    const int c = int(pL[W*strideL+W]) - int(pR[W*strideR+W]);
+
+#ifdef __SSE2__
+    // Each row is loaded as 16 pixels, the 5 pixels past the patch are masked
+    // out. The pyramid images have a border so these loads stay in bounds.
+    // Per lane sums are at most 2*11*510 so they fit in 16 bits.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vc = _mm_set1_epi16(c);
+    const __m128i maskHi = _mm_setr_epi16(-1,-1,-1,0,0,0,0,0);
+    __m128i acc = zero;
+    for(int y=0; y<2*W+1; y++)
+    {
+        const __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pL+y*strideL));
+        const __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pR+y*strideR));
+        __m128i dLo = _mm_sub_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(l,zero),_mm_unpacklo_epi8(r,zero)),vc);
+        __m128i dHi = _mm_sub_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(l,zero),_mm_unpackhi_epi8(r,zero)),vc);
+        dLo = _mm_max_epi16(dLo,_mm_sub_epi16(zero,dLo));
+        dHi = _mm_and_si128(_mm_max_epi16(dHi,_mm_sub_epi16(zero,dHi)),maskHi);
+        acc = _mm_add_epi16(acc,_mm_add_epi16(dLo,dHi));
+    }
+    __m128i sum = _mm_madd_epi16(acc,_mm_set1_epi16(1));
+    sum = _mm_add_epi32(sum,_mm_shuffle_epi32(sum,_MM_SHUFFLE(1,0,3,2)));
+    sum = _mm_add_epi32(sum,_mm_shuffle_epi32(sum,_MM_SHUFFLE(2,3,0,1)));
+    return _mm_cvtsi128_si32(sum);
+#else
+    int sad = 0;
+    for(int y=0; y<2*W+1; y++)
+    {
+        const uchar* pRowL = pL+y*strideL;
+        const uchar* pRowR = pR+y*strideR;
+        for(int x=0; x<2*W+1; x++)
+            sad += abs(int(pRowL[x])-int(pRowR[x])-c);
+    }
+    return sad;
+#endif
+}
+
+void StereoMatcher::Match(Frame &F)
+{
+    F.mvuRight = vector<float>(F.N,-1.0f);
+    F.mvDepth = vector<float>(F.N,-1.0f);
+
+    const int nRows = F.mpORBextractorLeft->mvImagePyramid[0].rows;
+
+    //Assign keypoints to row table
+    const int Nr = F.mvKeysRight.size();
+    mvRowStart.assign(nRows+1,0);
+    for(int iR=0; iR<Nr; iR++)
+    {
+        const cv::KeyPoint &kp = F.mvKeysRight[iR];
+        const float &kpY = kp.pt.y;
+        const float r = 2.0f*F.mvScaleFactors[kp.octave];
+        const int maxr = min<int>(ceil(kpY+r),nRows-1);
+        const int minr = max<int>(floor(kpY-r),0);
+
+        for(int yi=minr;yi<=maxr;yi++)
+            mvRowStart[yi+1]++;
+    }
+
+    for(int yi=0; yi<nRows; yi++)
+        mvRowStart[yi+1] += mvRowStart[yi];
+
+    // Fill in increasing index order, as the candidates are visited
+    mvRowIndices.resize(mvRowStart[nRows]);
+    vector<int> vRowFill(mvRowStart.begin(),mvRowStart.end()-1);
+    for(int iR=0; iR<Nr; iR++)
+    {
+        const cv::KeyPoint &kp = F.mvKeysRight[iR];
+        const float &kpY = kp.pt.y;
+        const float r = 2.0f*F.mvScaleFactors[kp.octave];
+        const int maxr = min<int>(ceil(kpY+r),nRows-1);
+        const int minr = max<int>(floor(kpY-r),0);
+
+        for(int yi=minr;yi<=maxr;yi++)
+            mvRowIndices[vRowFill[yi]++] = iR;
+    }
+
+    // Match the left keypoints in chunks. There are more chunks than threads
+    // to balance the load, as the cost per keypoint varies a lot.
+    mvBestSAD.assign(F.N,-1);
+    const int nChunks = mThreadPool.NumThreads()>1 ? 4*mThreadPool.NumThreads() : 1;
+    const int nChunkSize = (F.N+nChunks-1)/nChunks;
+    mThreadPool.ParallelFor(nChunks, [&](int i)
+    {
+        const int nBegin = min(i*nChunkSize,F.N);
+        const int nEnd = min(nBegin+nChunkSize,F.N);
+        MatchRange(F,nBegin,nEnd);
+    });
+
+    vector<pair<int, int> > vDistIdx;
+    vDistIdx.reserve(F.N);
+    for(int iL=0; iL<F.N; iL++)
+        if(mvBestSAD[iL]>=0)
+            vDistIdx.push_back(pair<int,int>(mvBestSAD[iL],iL));
+
+    if(vDistIdx.empty())
+        return;
+
+    sort(vDistIdx.begin(),vDistIdx.end());
+    const float median = vDistIdx[vDistIdx.size()/2].first;
+    const float thDist = 1.5f*1.4f*median;
+
+    for(int i=vDistIdx.size()-1;i>=0;i--)
+    {
+        if(vDistIdx[i].first<thDist)
+            break;
+        else
+        {
+            F.mvuRight[vDistIdx[i].second]=-1;
+            F.mvDepth[vDistIdx[i].second]=-1;
+        }
+    }
+}
+
+void StereoMatcher::MatchRange(Frame &F, const int nBegin, const int nEnd)
+{
+    const int thOrbDist = (ORBmatcher::TH_HIGH+ORBmatcher::TH_LOW)/2;
+
+    // Set limits for search
+    const float minZ = F.mb;
+    const float minD = 0;
+    const float maxD = F.mbf/minZ;
+
+    // For each left keypoint search a match in the right image
+    for(int iL=nBegin; iL<nEnd; iL++)
+    {
+        const cv::KeyPoint &kpL = F.mvKeys[iL];
+        const int &levelL = kpL.octave;
+        const float &vL = kpL.pt.y;
+        const float &uL = kpL.pt.x;
+
+        const int row = vL;
+        const int nCandBegin = mvRowStart[row];
+        const int nCandEnd = mvRowStart[row+1];
+
+        if(nCandBegin==nCandEnd)
+            continue;
+
+        const float minU = uL-maxD;
+        const float maxU = uL-minD;
+
+        if(maxU<0)
+            continue;
+
+        int bestDist = ORBmatcher::TH_HIGH;
+        size_t bestIdxR = 0;
+
+        const cv::Mat &dL = F.mDescriptors.row(iL);
+
+        // Compare descriptor to right keypoints
+        for(int iC=nCandBegin; iC<nCandEnd; iC++)
+        {
+            const int iR = mvRowIndices[iC];
+            const cv::KeyPoint &kpR = F.mvKeysRight[iR];
+
+            if(kpR.octave<levelL-1 || kpR.octave>levelL+1)
+                continue;
+
+            const float &uR = kpR.pt.x;
+
+            if(uR>=minU && uR<=maxU)
+            {
+                const cv::Mat &dR = F.mDescriptorsRight.row(iR);
+                const int dist = ORBmatcher::DescriptorDistance(dL,dR);
+
+                if(dist<bestDist)
+                {
+                    bestDist = dist;
+                    bestIdxR = iR;
+                }
+            }
+        }
+
+        // Subpixel match by correlation
+        if(bestDist<thOrbDist)
+        {
+            // coordinates in image pyramid at keypoint scale
+            const float uR0 = F.mvKeysRight[bestIdxR].pt.x;
+            const float scaleFactor = F.mvInvScaleFactors[kpL.octave];
+            const float scaleduL = round(kpL.pt.x*scaleFactor);
+            const float scaledvL = round(kpL.pt.y*scaleFactor);
+            const float scaleduR0 = round(uR0*scaleFactor);
+
+            const cv::Mat &imL = F.mpORBextractorLeft->mvImagePyramid[kpL.octave];
+            const cv::Mat &imR = F.mpORBextractorRight->mvImagePyramid[kpL.octave];
+
+            const float iniu = scaleduR0+L-W;
+            const float endu = scaleduR0+L+W+1;
+            if(iniu<0 || endu >= imR.cols)
+                continue;
+
+            // sliding window search
+            const uchar* pL = imL.ptr<uchar>(int(scaledvL)-W) + int(scaleduL)-W;
+            const uchar* pR = imR.ptr<uchar>(int(scaledvL)-W) + int(scaleduR0)-W;
+
+            int bestSAD = INT_MAX;
+            int bestincR = 0;
+            float vDists[2*L+1];
+
+            for(int incR=-L; incR<=+L; incR++)
+            {
+                const int dist = PatchSAD(pL,imL.step,pR+incR,imR.step);
+                if(dist<bestSAD)
+                {
+                    bestSAD = dist;
+                    bestincR = incR;
+                }
+
+                vDists[L+incR] = dist;
+            }
+
+            if(bestincR==-L || bestincR==L)
+                continue;
+
+            // Sub-pixel match (Parabola fitting)
+            const float dist1 = vDists[L+bestincR-1];
+            const float dist2 = vDists[L+bestincR];
+            const float dist3 = vDists[L+bestincR+1];
+
+            const float deltaR = (dist1-dist3)/(2.0f*(dist1+dist3-2.0f*dist2));
+
+            if(deltaR<-1 || deltaR>1)
+                continue;
+
+            // Re-scaled coordinate
+            float bestuR = F.mvScaleFactors[kpL.octave]*((float)scaleduR0+(float)bestincR+deltaR);
+
+            float disparity = (uL-bestuR);
+
+            if(disparity>=minD && disparity<maxD)
+            {
+                if(disparity<=0)
+                {
+                    disparity=0.01;
+                    bestuR = uL-0.01;
+                }
+                F.mvDepth[iL]=F.mbf/disparity;
+                F.mvuRight[iL] = bestuR;
+                mvBestSAD[iL] = bestSAD;
+            }
+        }
+    }
+}
+
+} //namespace ORB_SLAM
@@ -26,6 +26,16 @@
 #include <thread>
 
 #include "Converter.h"
+#include "Thirdparty/DBoW2/DUtils/Random.h"
+
+DEFINE_bool(deterministic_replay, false,
+            "Replay a sequence deterministically in single threaded mode: "
+            "loop closing and global BA run inline in the tracking thread "
+            "and RANSAC is seeded, so that two runs produce identical "
+            "trajectories and introspection datasets.");
+DEFINE_int32(deterministic_replay_seed, 0,
+             "Seed of the random number generator used by RANSAC when "
+             "deterministic_replay is set.");
 
 namespace ORB_SLAM2 {
 
@@ -46,9 +56,12 @@ System::System(const string &strVocFile,
                ORBVocabulary *const pVocabulary)
     : mSensor(sensor),
       mpViewer(static_cast<Viewer *>(NULL)),
+      mpMapRenderer(static_cast<MapRenderer *>(NULL)),
+      mptMapRenderer(static_cast<std::thread *>(NULL)),
       mbReset(false),
       mbActivateLocalizationMode(false),
       mbDeactivateLocalizationMode(false),
+      mnLastBigChangeIdx(0),
       mbSingleThreaded(bSingleThreaded),
       mbSilent(bSilent),
       mbGuidedBA(bGuidedBA) {
@@ -85,21 +98,35 @@ System::System(const string &strVocFile,
     }
   }
 
-  KeyFrame::nNextId = 0;
-  Frame::nNextId = 0;
+  mpContext = new SessionContext();
+
+  if (FLAGS_deterministic_replay) {
+    if (!bSingleThreaded) {
+      cerr << "WARNING: deterministic_replay only takes effect in single "
+              "threaded mode."
+           << endl;
+    }
+    DUtils::Random::SeedRand(FLAGS_deterministic_replay_seed);
+
+    // Tracking and local mapping merge their per-thread results in a fixed
+    // order and the inline global BA runs on one thread, so a replay does not
+    // depend on the thread settings.
+  }
 
   // If bUseBoW is set to false, the functionalities that rely on bag of
   // words will be turned off. This includes loop closure and tracking
   // with reference frame where feature matching is done with searching
   // extracted bag of words for each frame.
+  mbOwnsVocabulary = false;
   if (bUseBoW) {
-    // Load ORB Vocabulary
-    mpVocabulary = new ORBVocabulary();
-
     if (pVocabulary) {
-      // IF a vocabulary is passed, use that instead of loading from file
-      *mpVocabulary = *pVocabulary;
+      // If a vocabulary is passed, share it instead of loading from file
+      mpVocabulary = pVocabulary;
     } else {
+      // Load ORB Vocabulary
+      mpVocabulary = new ORBVocabulary();
+      mbOwnsVocabulary = true;
+
       cout << endl
            << "Loading ORB Vocabulary. This could take a while..." << endl;
       bool bVocLoad = mpVocabulary->loadFromTextFile(strVocFile);
@@ -141,6 +168,7 @@ System::System(const string &strVocFile,
                            mpMapDrawer,
                            mpMap,
                            mpKeyFrameDatabase,
+                           mpContext,
                            strSettingsFile,
                            mSensor,
                            bSingleThreaded,
@@ -183,6 +211,12 @@ System::System(const string &strVocFile,
     mpLoopCloser = new LoopClosing(
         mpMap, mpKeyFrameDatabase, mpVocabulary, mSensor != MONOCULAR);
     mptLoopClosing = new thread(&ORB_SLAM2::LoopClosing::Run, mpLoopCloser);
+  } else if (FLAGS_deterministic_replay) {
+    // Loop closing is run by the tracking thread after each frame
+    mpLoopCloser = new LoopClosing(
+        mpMap, mpKeyFrameDatabase, mpVocabulary, mSensor != MONOCULAR);
+    mpLoopCloser->SetInlineMode(true);
+    mptLoopClosing = NULL;
   } else {
     mpLoopCloser = NULL;
     mptLoopClosing = NULL;
@@ -194,6 +228,11 @@ System::System(const string &strVocFile,
         this, mpFrameDrawer, mpMapDrawer, mpTracker, strSettingsFile);
     mptViewer = new thread(&Viewer::Run, mpViewer);
     mpTracker->SetViewer(mpViewer);
+  } else if (FLAGS_map_renderer_enabled) {
+    mpMapRenderer =
+        new MapRenderer(mpMap, mpMapDrawer, mpTracker, strSettingsFile);
+    mptMapRenderer = new thread(&MapRenderer::Run, mpMapRenderer);
+    mpTracker->SetMapRenderer(mpMapRenderer);
   }
 
   // Set pointers between threads
@@ -251,10 +290,13 @@ cv::Mat System::TrackStereo(const cv::Mat &imLeft,
 
   cv::Mat Tcw = mpTracker->GrabImageStereo(imLeft, imRight, timestamp);
 
+  RunInlineLoopClosing();
+
   unique_lock<mutex> lock2(mMutexState);
   mTrackingState = mpTracker->mState;
   mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
   mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+  mMapLockWaitStats = mpTracker->GetMapLockWaitStats();
   return Tcw;
 }
 
@@ -314,10 +356,13 @@ cv::Mat System::TrackStereo(const cv::Mat &imLeft,
                                            gtDepthAvailable,
                                            depthmap);
 
+  RunInlineLoopClosing();
+
   unique_lock<mutex> lock2(mMutexState);
   mTrackingState = mpTracker->mState;
   mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
   mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+  mMapLockWaitStats = mpTracker->GetMapLockWaitStats();
   return Tcw;
 }
 
@@ -362,10 +407,13 @@ cv::Mat System::TrackRGBD(const cv::Mat &im,
 
   cv::Mat Tcw = mpTracker->GrabImageRGBD(im, depthmap, timestamp);
 
+  RunInlineLoopClosing();
+
   unique_lock<mutex> lock2(mMutexState);
   mTrackingState = mpTracker->mState;
   mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
   mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+  mMapLockWaitStats = mpTracker->GetMapLockWaitStats();
   return Tcw;
 }
 
@@ -409,10 +457,13 @@ cv::Mat System::TrackMonocular(const cv::Mat &im, const double &timestamp) {
 
   cv::Mat Tcw = mpTracker->GrabImageMonocular(im, timestamp);
 
+  RunInlineLoopClosing();
+
   unique_lock<mutex> lock2(mMutexState);
   mTrackingState = mpTracker->mState;
   mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
   mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+  mMapLockWaitStats = mpTracker->GetMapLockWaitStats();
 
   return Tcw;
 }
@@ -463,10 +514,13 @@ cv::Mat System::TrackMonocular(const cv::Mat &im,
   cv::Mat Tcw = mpTracker->GrabImageMonocular(
       im, timestamp, cam_pose_gt, img_name, gtDepthAvailable, depthmap);
 
+  RunInlineLoopClosing();
+
   unique_lock<mutex> lock2(mMutexState);
   mTrackingState = mpTracker->mState;
   mTrackedMapPoints = mpTracker->mCurrentFrame.mvpMapPoints;
   mTrackedKeyPointsUn = mpTracker->mCurrentFrame.mvKeysUn;
+  mMapLockWaitStats = mpTracker->GetMapLockWaitStats();
 
   return Tcw;
 }
@@ -481,11 +535,18 @@ void System::DeactivateLocalizationMode() {
   mbDeactivateLocalizationMode = true;
 }
 
+void System::RunInlineLoopClosing() {
+  // The tracker holds the map while it processes a frame, so the inline loop
+  // closer can only run once it has returned
+  if (mbSingleThreaded && mpLoopCloser) {
+    mpLoopCloser->LoopOnce();
+  }
+}
+
 bool System::MapChanged() {
-  static int n = 0;
   int curn = mpMap->GetLastBigChangeIdx();
-  if (n < curn) {
-    n = curn;
+  if (mnLastBigChangeIdx < curn) {
+    mnLastBigChangeIdx = curn;
     return true;
   } else
     return false;
@@ -513,6 +574,10 @@ void System::Shutdown() {
     mpViewer->RequestFinish();
     while (!mpViewer->isFinished()) usleep(5000);
   }
+  if (mpMapRenderer) {
+    mpMapRenderer->RequestFinish();
+    mptMapRenderer->join();
+  }
 
   // Wait until all thread have effectively stopped
   if (!mbSingleThreaded)
@@ -529,6 +594,13 @@ void System::Shutdown() {
     mpViewer = static_cast<Viewer *>(NULL);
   }
 
+  if (mpMapRenderer) {
+    delete mpMapRenderer;
+    delete mptMapRenderer;
+    mpMapRenderer = static_cast<MapRenderer *>(NULL);
+    mptMapRenderer = static_cast<std::thread *>(NULL);
+  }
+
   mpMap->clear();
 
   delete mpMap;
@@ -549,9 +621,11 @@ void System::Shutdown() {
     delete mpKeyFrameDatabase;
   }
 
-  if (mpVocabulary) {
+  if (mbOwnsVocabulary) {
     delete mpVocabulary;
   }
+
+  delete mpContext;
 }
 
 void System::ShutdownMinimal() {
@@ -570,6 +644,10 @@ void System::ShutdownMinimal() {
     mpViewer->RequestFinish();
     while (!mpViewer->isFinished()) usleep(5000);
   }
+  if (mpMapRenderer) {
+    mpMapRenderer->RequestFinish();
+    mptMapRenderer->join();
+  }
 
   // Wait until all thread have effectively stopped
   if (!mbSingleThreaded)
@@ -586,6 +664,13 @@ void System::ShutdownMinimal() {
     mpViewer = static_cast<Viewer *>(NULL);
   }
 
+  if (mpMapRenderer) {
+    delete mpMapRenderer;
+    delete mptMapRenderer;
+    mpMapRenderer = static_cast<MapRenderer *>(NULL);
+    mptMapRenderer = static_cast<std::thread *>(NULL);
+  }
+
   mpMap->clear();
 
   delete mpMap;
@@ -606,9 +691,11 @@ void System::ShutdownMinimal() {
     delete mpKeyFrameDatabase;
   }
 
-  if (mpVocabulary) {
+  if (mbOwnsVocabulary) {
     delete mpVocabulary;
   }
+
+  delete mpContext;
 }
 
 void System::SaveTrajectoryTUM(const string &filename) {
@@ -786,7 +873,7 @@ void System::SetRelativeCamPoseUncertainty(
 bool System::GetCurrentCamPose(cv::Mat &cam_pose) {
   unique_lock<mutex> lock(mMutexState);
 
-  if (mTrackingState != 2) {
+  if (mTrackingState != Tracking::OK) {
     return false;
   } else {
     cam_pose = mpTracker->mCurrentFramePose;
@@ -794,6 +881,28 @@ bool System::GetCurrentCamPose(cv::Mat &cam_pose) {
   }
 }
 
+bool System::GetTrackedFrameInfo(TrackedFrameInfo &info) {
+  unique_lock<mutex> lock(mMutexState);
+
+  if (mTrackingState != Tracking::OK) {
+    return false;
+  }
+
+  const Frame &frame = mpTracker->mCurrentFrame;
+  info.Tcw = frame.mTcw.clone();
+  info.velocity = mpTracker->GetVelocity();
+  info.K = frame.mK.clone();
+  info.num_inliers = mpTracker->GetNumMatchesInliers();
+  info.keypoints = frame.mvKeysUn;
+  info.depths = frame.mvDepth;
+  return true;
+}
+
+MapLockWaitStats System::GetMapLockWaitStats() {
+  unique_lock<mutex> lock(mMutexState);
+  return mMapLockWaitStats;
+}
+
 vector<MapPoint *> System::GetTrackedMapPoints() {
   unique_lock<mutex> lock(mMutexState);
   return mTrackedMapPoints;
@@ -0,0 +1,124 @@
+/**
+* This file is part of ORB-SLAM2.
+*
+* Copyright (C) 2014-2016 Raúl Mur-Artal <raulmur at unizar dot es> (University of Zaragoza)
+* For more information see <https://github.com/raulmur/ORB_SLAM2>
+*
+* ORB-SLAM2 is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* ORB-SLAM2 is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with ORB-SLAM2. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ThreadPool.h"
+
+namespace ORB_SLAM2
+{
+
+ThreadPool::ThreadPool(int nThreads):
+    mpJob(NULL), mnJobSize(0), mnNextIndex(0), mnActiveWorkers(0), mnJobId(0), mbFinish(false)
+{
+    for(int i=1; i<nThreads; i++)
+        mvWorkers.push_back(std::thread(&ThreadPool::WorkerLoop,this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(mMutexJob);
+        mbFinish = true;
+    }
+    mcvJob.notify_all();
+
+    for(size_t i=0; i<mvWorkers.size(); i++)
+        mvWorkers[i].join();
+}
+
+int ThreadPool::NumThreads() const
+{
+    return mvWorkers.size()+1;
+}
+
+void ThreadPool::ParallelFor(int n, const std::function<void(int)> &func)
+{
+    if(n<=0)
+        return;
+
+    if(mvWorkers.empty() || n==1)
+    {
+        for(int i=0; i<n; i++)
+            func(i);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lockCall(mMutexCall);
+
+    {
+        std::unique_lock<std::mutex> lock(mMutexJob);
+        mpJob = &func;
+        mnJobSize = n;
+        mnNextIndex = 0;
+        mnJobId++;
+    }
+    mcvJob.notify_all();
+
+    RunJob();
+
+    // All indices have been claimed. Wait for the workers that are still
+    // running one of them and retire the job, so that late workers skip it.
+    std::unique_lock<std::mutex> lock(mMutexJob);
+    while(mnActiveWorkers>0)
+        mcvDone.wait(lock);
+    mpJob = NULL;
+}
+
+void ThreadPool::RunJob()
+{
+    while(true)
+    {
+        const int i = mnNextIndex.fetch_add(1);
+        if(i>=mnJobSize)
+            break;
+        (*mpJob)(i);
+    }
+}
+
+void ThreadPool::WorkerLoop()
+{
+    unsigned long nLastJobId = 0;
+
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mMutexJob);
+            while(!mbFinish && mnJobId==nLastJobId)
+                mcvJob.wait(lock);
+
+            if(mbFinish)
+                return;
+
+            nLastJobId = mnJobId;
+            if(!mpJob)
+                continue;
+            mnActiveWorkers++;
+        }
+
+        RunJob();
+
+        {
+            std::unique_lock<std::mutex> lock(mMutexJob);
+            mnActiveWorkers--;
+        }
+        mcvDone.notify_all();
+    }
+}
+
+} //namespace ORB_SLAM
@@ -30,6 +30,7 @@
 #include <glog/logging.h>
 
 #include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <mutex>
 
@@ -37,6 +38,7 @@
 #include "FrameDrawer.h"
 #include "Initializer.h"
 #include "Map.h"
+#include "MapRenderer.h"
 #include "ORBmatcher.h"
 #include "Optimizer.h"
 #include "PnPsolver.h"
@@ -63,6 +65,12 @@ DEFINE_double(ivslam_ref_pose_trans_var_inv,
               "learning mode and in order to determine whether a frame "
               "should be used for training.");
 
+DEFINE_int32(tracking_num_threads,
+             1,
+             "Number of threads used by tracking to match the local map "
+             "points with the keypoints of the current frame. The results do "
+             "not depend on this value.");
+
 using namespace std;
 using namespace feature_evaluation;
 
@@ -74,6 +82,7 @@ Tracking::Tracking(System* pSys,
                    MapDrawer* pMapDrawer,
                    Map* pMap,
                    KeyFrameDatabase* pKFDB,
+                   SessionContext* pContext,
                    const string& strSettingPath,
                    const int sensor,
                    const bool bSingleThreaded,
@@ -86,6 +95,7 @@ Tracking::Tracking(System* pSys,
       mbVO(false),
       mpORBVocabulary(pVoc),
       mpKeyFrameDB(pKFDB),
+      mpContext(pContext),
       mpInitializer(static_cast<Initializer*>(NULL)),
       mpSystem(pSys),
       mpViewer(NULL),
@@ -93,6 +103,7 @@ Tracking::Tracking(System* pSys,
       mpMapDrawer(pMapDrawer),
       mpMap(pMap),
       mnLastRelocFrameId(0),
+      mnFramesEvaluated(0),
       mbSilent(bSilent),
       mbGuidedBA(bGuidedBA) {
   // Load camera parameters from settings file
@@ -171,24 +182,47 @@ Tracking::Tracking(System* pSys,
         static_cast<bool>(int(fSettings["ORBextractor.enableIntrospection"]));
   }
 
+  // Image regions with a higher mean predicted cost are skipped during
+  // feature extraction. Disabled by default.
+  float fCostGateThreshold = 255.0f;
+  cv::FileNode cost_gate_node = fSettings["ORBextractor.costGateThreshold"];
+  if (!cost_gate_node.empty()) {
+    fCostGateThreshold = static_cast<float>(cost_gate_node);
+  }
+
+  // Descriptors use BRIEF patterns pre-rotated to 30 quantized angles
+  bool bQuantizedAngles = false;
+  cv::FileNode quantized_angles_node =
+      fSettings["ORBextractor.quantizedAngles"];
+  if (!quantized_angles_node.empty()) {
+    bQuantizedAngles = static_cast<bool>(int(quantized_angles_node));
+  }
+
   mpORBextractorLeft = new ORBextractor(nFeatures,
                                         fScaleFactor,
                                         nLevels,
                                         fIniThFAST,
                                         fMinThFAST,
-                                        enableInrospectiveFeatExtraction);
+                                        enableInrospectiveFeatExtraction,
+                                        fCostGateThreshold);
+  mpORBextractorLeft->SetQuantizedAngles(bQuantizedAngles);
 
-  if (sensor == System::STEREO)
+  if (sensor == System::STEREO) {
     mpORBextractorRight = new ORBextractor(
         nFeatures, fScaleFactor, nLevels, fIniThFAST, fMinThFAST);
+    mpORBextractorRight->SetQuantizedAngles(bQuantizedAngles);
+  }
 
-  if (sensor == System::MONOCULAR)
+  if (sensor == System::MONOCULAR) {
     mpIniORBextractor = new ORBextractor(2 * nFeatures,
                                          fScaleFactor,
                                          nLevels,
                                          fIniThFAST,
                                          fMinThFAST,
-                                         enableInrospectiveFeatExtraction);
+                                         enableInrospectiveFeatExtraction,
+                                         fCostGateThreshold);
+    mpIniORBextractor->SetQuantizedAngles(bQuantizedAngles);
+  }
 
   if (!bSilent) {
     cout << endl << "ORB Extractor Parameters: " << endl;
@@ -199,6 +233,10 @@ Tracking::Tracking(System* pSys,
     cout << "- Minimum Fast Threshold: " << fMinThFAST << endl;
     cout << "- Intorspective Feature Extraction: "
          << enableInrospectiveFeatExtraction << endl;
+    if (enableInrospectiveFeatExtraction && fCostGateThreshold < 255.0f) {
+      cout << "- Cost Gate Threshold: " << fCostGateThreshold << endl;
+    }
+    cout << "- Quantized Descriptor Angles: " << bQuantizedAngles << endl;
   }
 
   if (sensor == System::STEREO || sensor == System::RGBD) {
@@ -257,8 +295,12 @@ Tracking::Tracking(System* pSys,
   if (sensor == System::STEREO) {
     mFeatureEvaluator->LoadRectificationMap(strSettingPath);
   }
+
+  mpThreadPool = new ThreadPool(FLAGS_tracking_num_threads);
 }
 
+Tracking::~Tracking() { delete mpThreadPool; }
+
 void Tracking::SetLocalMapper(LocalMapping* pLocalMapper) {
   mpLocalMapper = pLocalMapper;
 }
@@ -269,6 +311,10 @@ void Tracking::SetLoopClosing(LoopClosing* pLoopClosing) {
 
 void Tracking::SetViewer(Viewer* pViewer) { mpViewer = pViewer; }
 
+void Tracking::SetMapRenderer(MapRenderer* pMapRenderer) {
+  mpMapRenderer = pMapRenderer;
+}
+
 cv::Mat Tracking::GrabImageStereo(const cv::Mat& imRectLeft,
                                   const cv::Mat& imRectRight,
                                   const double& timestamp) {
@@ -299,6 +345,7 @@ cv::Mat Tracking::GrabImageStereo(const cv::Mat& imRectLeft,
                         mpORBextractorLeft,
                         mpORBextractorRight,
                         mpORBVocabulary,
+                        mpContext,
                         mK,
                         mDistCoef,
                         mbf,
@@ -346,6 +393,7 @@ cv::Mat Tracking::GrabImageStereo(
                         mpORBextractorLeft,
                         mpORBextractorRight,
                         mpORBVocabulary,
+                        mpContext,
                         mK,
                         mDistCoef,
                         mbf,
@@ -400,6 +448,7 @@ cv::Mat Tracking::GrabImageRGBD(const cv::Mat& imRGB,
                         timestamp,
                         mpORBextractorLeft,
                         mpORBVocabulary,
+                        mpContext,
                         mK,
                         mDistCoef,
                         mbf,
@@ -431,6 +480,7 @@ cv::Mat Tracking::GrabImageMonocular(const cv::Mat& im,
                           timestamp,
                           mpIniORBextractor,
                           mpORBVocabulary,
+                          mpContext,
                           mK,
                           mDistCoef,
                           mbf,
@@ -440,6 +490,7 @@ cv::Mat Tracking::GrabImageMonocular(const cv::Mat& im,
                           timestamp,
                           mpORBextractorLeft,
                           mpORBVocabulary,
+                          mpContext,
                           mK,
                           mDistCoef,
                           mbf,
@@ -482,6 +533,7 @@ cv::Mat Tracking::GrabImageMonocular(const cv::Mat& im,
                           timestamp,
                           mpIniORBextractor,
                           mpORBVocabulary,
+                          mpContext,
                           mK,
                           mDistCoef,
                           mbf,
@@ -491,6 +543,7 @@ cv::Mat Tracking::GrabImageMonocular(const cv::Mat& im,
                           timestamp,
                           mpORBextractorLeft,
                           mpORBVocabulary,
+                          mpContext,
                           mK,
                           mDistCoef,
                           mbf,
@@ -520,7 +573,16 @@ void Tracking::Track() {
   mLastProcessedState = mState;
 
   // Get Map Mutex -> Map cannot be changed
+  const std::chrono::steady_clock::time_point t_lock =
+      std::chrono::steady_clock::now();
   unique_lock<mutex> lock(mpMap->mMutexMapUpdate);
+  const double lock_wait_ms =
+      std::chrono::duration<double, std::milli>(
+          std::chrono::steady_clock::now() - t_lock)
+          .count();
+  mMapLockWaitStats.num_frames++;
+  mMapLockWaitStats.total_ms += lock_wait_ms;
+  mMapLockWaitStats.max_ms = std::max(mMapLockWaitStats.max_ms, lock_wait_ms);
 
   if (mState == NOT_INITIALIZED) {
     if (mSensor == System::STEREO || mSensor == System::RGBD) {
@@ -684,12 +746,11 @@ void Tracking::Track() {
       }
     }
 
-    static int counter = 0;
-    counter++;
-    if (!mbIntrospectionOn && mbTrainingMode && counter < 2) {
+    mnFramesEvaluated++;
+    if (!mbIntrospectionOn && mbTrainingMode && mnFramesEvaluated < 2) {
       mFeatureEvaluator->UpdateCameraCalibration(mCurrentFrame);
     }
-    if (!mbIntrospectionOn && mbTrainingMode && mState == OK && counter > 2) {
+    if (!mbIntrospectionOn && mbTrainingMode && mState == OK && mnFramesEvaluated > 2) {
       // Evaluate the recent frames and calculate the quality heatmap
       mFeatureEvaluator->LoadImagePair(mImGrayPrev, mImGray);
 
@@ -1178,26 +1239,16 @@ bool Tracking::TrackReferenceKeyFrame(float nn_ratio_mult,
          mCurrentFrame.mvpMapPoints.end(),
          static_cast<MapPoint*>(NULL));
 
-    int nToMatch = 0;
+    // The local map may have changed since it was last gathered
+    mLocalMapCuller.SetMapPoints(mvpLocalMapPoints);
 
     // Project points in frame and check its visibility
-    for (vector<MapPoint*>::iterator vit = mvpLocalMapPoints.begin(),
-                                     vend = mvpLocalMapPoints.end();
-         vit != vend;
-         vit++) {
-      MapPoint* pMP = *vit;
-      if (pMP->mnLastFrameSeen == mCurrentFrame.mnId) continue;
-      if (pMP->isBad()) continue;
-      // Project (this fills MapPoint variables for matching)
-      if (mCurrentFrame.isInFrustum(pMP, 0.5)) {
-        nToMatch++;
-      }
-    }
+    const int nToMatch = mLocalMapCuller.Cull(mCurrentFrame, 0.5);
 
     if (nToMatch > 0) {
       int th = 5;
       nmatches = matcher.SearchByProjection(
-          mCurrentFrame, mvpLocalMapPoints, search_wind_mult * th);
+          mCurrentFrame, mLocalMapCuller, search_wind_mult * th, mpThreadPool);
     }
     if (nmatches < 15) return false;
   }
@@ -1225,7 +1276,6 @@ bool Tracking::TrackReferenceKeyFrame(float nn_ratio_mult,
 
         mCurrentFrame.mvpMapPoints[i] = static_cast<MapPoint*>(NULL);
         mCurrentFrame.mvbOutlier[i] = false;
-        pMP->mbTrackInView = false;
         pMP->mnLastFrameSeen = mCurrentFrame.mnId;
         nmatches--;
       } else if (mCurrentFrame.mvpMapPoints[i]->Observations() > 0)
@@ -1483,7 +1533,6 @@ bool Tracking::TrackWithMotionModel(float nn_ratio_mult,
 
         mCurrentFrame.mvpMapPoints[i] = static_cast<MapPoint*>(NULL);
         mCurrentFrame.mvbOutlier[i] = false;
-        pMP->mbTrackInView = false;
         pMP->mnLastFrameSeen = mCurrentFrame.mnId;
         nmatches--;
       } else if (mCurrentFrame.mvpMapPoints[i]->Observations() > 0)
@@ -2090,32 +2139,20 @@ void Tracking::SearchLocalPoints() {
        vit++) {
     MapPoint* pMP = *vit;
     if (pMP) {
-      if (pMP->isBad()) {
+      if (pMP->isBadLockFree()) {
         *vit = static_cast<MapPoint*>(NULL);
       } else {
         pMP->IncreaseVisible();
         pMP->mnLastFrameSeen = mCurrentFrame.mnId;
-        pMP->mbTrackInView = false;
       }
     }
   }
 
-  int nToMatch = 0;
-
-  // Project points in frame and check its visibility
-  for (vector<MapPoint*>::iterator vit = mvpLocalMapPoints.begin(),
-                                   vend = mvpLocalMapPoints.end();
-       vit != vend;
-       vit++) {
-    MapPoint* pMP = *vit;
-    if (pMP->mnLastFrameSeen == mCurrentFrame.mnId) continue;
-    if (pMP->isBad()) continue;
-    // Project (this fills MapPoint variables for matching)
-    if (mCurrentFrame.isInFrustum(pMP, 0.5)) {
-      pMP->IncreaseVisible();
-      nToMatch++;
-    }
-  }
+  // Project points in frame and check its visibility. Points already matched
+  // are skipped by the culler through mnLastFrameSeen.
+  const int nToMatch = mLocalMapCuller.Cull(mCurrentFrame, 0.5);
+  for (int i = 0; i < nToMatch; i++)
+    mLocalMapCuller.mvpVisible[i]->IncreaseVisible();
 
   if (nToMatch > 0) {
     ORBmatcher matcher(mMatcherNNRatioMultiplier * 0.8);
@@ -2124,7 +2161,10 @@ void Tracking::SearchLocalPoints() {
     // If the camera has been relocalised recently, perform a coarser search
     if (mCurrentFrame.mnId < mnLastRelocFrameId + 2) th = 5;
     matcher.SearchByProjection(
-        mCurrentFrame, mvpLocalMapPoints, mMatcherSearchWindowMultiplier * th);
+        mCurrentFrame,
+        mLocalMapCuller,
+        mMatcherSearchWindowMultiplier * th,
+        mpThreadPool);
   }
 }
 
@@ -2154,27 +2194,32 @@ void Tracking::UpdateLocalPoints() {
       MapPoint* pMP = *itMP;
       if (!pMP) continue;
       if (pMP->mnTrackReferenceForFrame == mCurrentFrame.mnId) continue;
-      if (!pMP->isBad()) {
+      if (!pMP->isBadLockFree()) {
         mvpLocalMapPoints.push_back(pMP);
         pMP->mnTrackReferenceForFrame = mCurrentFrame.mnId;
       }
     }
   }
+
+  mLocalMapCuller.SetMapPoints(mvpLocalMapPoints);
 }
 
 void Tracking::UpdateLocalKeyFrames() {
   // Each map point vote for the keyframes in which it has been observed
-  map<KeyFrame*, int> keyframeCounter;
+  map<KeyFrame*, int, IdLess> keyframeCounter;
+  vector<KeyFrame*> vpObservingKFs;
   for (int i = 0; i < mCurrentFrame.N; i++) {
     if (mCurrentFrame.mvpMapPoints[i]) {
       MapPoint* pMP = mCurrentFrame.mvpMapPoints[i];
-      if (!pMP->isBad()) {
-        const map<KeyFrame*, size_t> observations = pMP->GetObservations();
-        for (map<KeyFrame*, size_t>::const_iterator it = observations.begin(),
-                                                    itend = observations.end();
+      if (!pMP->isBadLockFree()) {
+        // Only the observing keyframes are needed, avoid copying the map
+        vpObservingKFs.clear();
+        pMP->GetObservingKeyFrames(vpObservingKFs);
+        for (vector<KeyFrame*>::const_iterator it = vpObservingKFs.begin(),
+                                               itend = vpObservingKFs.end();
              it != itend;
              it++)
-          keyframeCounter[it->first]++;
+          keyframeCounter[*it]++;
       } else {
         mCurrentFrame.mvpMapPoints[i] = NULL;
       }
@@ -2191,8 +2236,8 @@ void Tracking::UpdateLocalKeyFrames() {
 
   // All keyframes that observe a map point are included in the local map. Also
   // check which keyframe shares most points
-  for (map<KeyFrame*, int>::const_iterator it = keyframeCounter.begin(),
-                                           itEnd = keyframeCounter.end();
+  for (map<KeyFrame*, int, IdLess>::const_iterator it = keyframeCounter.begin(),
+                                                   itEnd = keyframeCounter.end();
        it != itEnd;
        it++) {
     KeyFrame* pKF = it->first;
@@ -2235,8 +2280,8 @@ void Tracking::UpdateLocalKeyFrames() {
       }
     }
 
-    const set<KeyFrame*> spChilds = pKF->GetChilds();
-    for (set<KeyFrame*>::const_iterator sit = spChilds.begin(),
+    const set<KeyFrame*, IdLess> spChilds = pKF->GetChilds();
+    for (set<KeyFrame*, IdLess>::const_iterator sit = spChilds.begin(),
                                         send = spChilds.end();
          sit != send;
          sit++) {
@@ -2343,7 +2388,7 @@ bool Tracking::Relocalization() {
 
       // If a Camera Pose is computed, optimize
       if (!Tcw.empty()) {
-        Tcw.copyTo(mCurrentFrame.mTcw);
+        mCurrentFrame.SetPose(Tcw);
 
         set<MapPoint*> sFound;
 
@@ -2506,6 +2551,10 @@ void Tracking::Reset() {
     mpViewer->RequestStop();
     while (!mpViewer->isStopped()) usleep(3000);
   }
+  if (mpMapRenderer) {
+    mpMapRenderer->RequestStop();
+    while (!mpMapRenderer->isStopped()) usleep(3000);
+  }
 
   // Reset Local Mapping
   cout << "Reseting Local Mapper...";
@@ -2533,8 +2582,8 @@ void Tracking::Reset() {
   // Clear Map (this erase MapPoints and KeyFrames)
   mpMap->clear();
 
-  //     KeyFrame::nNextId = 0;
-  //     Frame::nNextId = 0;
+  //     mpContext->mnNextKeyFrameId = 0;
+  //     mpContext->mnNextFrameId = 0;
   mState = NO_IMAGES_YET;
 
   if (mpInitializer) {
@@ -2548,6 +2597,7 @@ void Tracking::Reset() {
   mlbLost.clear();
 
   if (mpViewer) mpViewer->Release();
+  if (mpMapRenderer) mpMapRenderer->Release();
 }
 
 void Tracking::ChangeCalibration(const string& strSettingPath) {
@@ -2578,7 +2628,7 @@ void Tracking::ChangeCalibration(const string& strSettingPath) {
 
   mbf = fSettings["Camera.bf"];
 
-  Frame::mbInitialComputations = true;
+  mpContext->mbInitialComputations = true;
 }
 
 void Tracking::InformOnlyTracking(const bool& flag) { mbOnlyTracking = flag; }
@@ -0,0 +1,251 @@
+// Copyright 2019 srabiee@cs.utexas.edu
+// College of Information and Computer Sciences,
+// University of Texas at Austin
+//
+//
+// This software is free: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License Version 3,
+// as published by the Free Software Foundation.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// Version 3 in the file COPYING that came with this distribution.
+// If not, see <http://www.gnu.org/licenses/>.
+// ========================================================================
+
+
+#include "cost_map_scheduler.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <sstream>
+#include <vector>
+
+DEFINE_int32(introspection_inference_period,
+             1,
+             "Runs the introspection function on every Nth frame and warps "
+             "the last predicted cost map into the frames in between. 1 runs "
+             "it on every frame.");
+DEFINE_double(introspection_rerun_inlier_ratio,
+              0.7,
+              "Runs the introspection function before the inference period "
+              "is over if the number of tracked inliers drops below this "
+              "ratio of the inliers of the last inference frame.");
+DEFINE_double(introspection_min_warp_coverage,
+              0.8,
+              "Staleness bound for warped cost maps. Runs the introspection "
+              "function before the inference period is over if less than "
+              "this fraction of the frame is covered by the warped cost "
+              "map.");
+
+namespace ORB_SLAM2 {
+
+namespace {
+
+// Size in pixels of the cells of the keypoint depth grid
+const int kDepthCellSize = 32;
+
+// The warp is computed every kWarpStride pixels and interpolated in between
+const int kWarpStride = 8;
+
+cv::Mat InverseTransform(const cv::Mat& T) {
+  cv::Mat T_inv = cv::Mat::eye(4, 4, CV_32F);
+  const cv::Mat R_inv = T.rowRange(0, 3).colRange(0, 3).t();
+  R_inv.copyTo(T_inv.rowRange(0, 3).colRange(0, 3));
+  cv::Mat t_inv = -R_inv * T.rowRange(0, 3).col(3);
+  t_inv.copyTo(T_inv.rowRange(0, 3).col(3));
+  return T_inv;
+}
+
+float Median(std::vector<float>* values) {
+  std::nth_element(
+      values->begin(), values->begin() + values->size() / 2, values->end());
+  return (*values)[values->size() / 2];
+}
+
+}  // namespace
+
+bool CostMapScheduler::Schedule(System* slam, cv::Mat* cost_map) {
+  stats_.num_frames++;
+
+  if (FLAGS_introspection_inference_period <= 1 || source_cost_map_.empty() ||
+      frames_since_inference_ + 1 >= FLAGS_introspection_inference_period) {
+    stats_.num_inferences++;
+    return true;
+  }
+
+  TrackedFrameInfo last;
+  if (!slam->GetTrackedFrameInfo(last) || last.velocity.empty()) {
+    stats_.num_inferences++;
+    stats_.num_reruns_tracking++;
+    return true;
+  }
+
+  // The last frame is the inference frame
+  if (source_pending_) {
+    InitSource(last);
+  }
+
+  if (last.num_inliers <
+      FLAGS_introspection_rerun_inlier_ratio * source_num_inliers_) {
+    stats_.num_inferences++;
+    stats_.num_reruns_inliers++;
+    return true;
+  }
+
+  // Predict the pose of the next frame with the motion model. Warping
+  // directly from the inference frame does not accumulate the interpolation
+  // blur of consecutive warps.
+  const cv::Mat Tcw = last.velocity * last.Tcw;
+  const cv::Mat T_dst_src = Tcw * InverseTransform(source_Tcw_);
+
+  cv::Mat warped;
+  const float coverage = Warp(T_dst_src, last.K, &warped);
+  if (coverage < FLAGS_introspection_min_warp_coverage) {
+    stats_.num_inferences++;
+    stats_.num_reruns_coverage++;
+    return true;
+  }
+
+  frames_since_inference_++;
+  *cost_map = warped;
+  return false;
+}
+
+void CostMapScheduler::SetPredictedCostMap(const cv::Mat& cost_map) {
+  source_cost_map_ = cost_map;
+  source_pending_ = true;
+  frames_since_inference_ = 0;
+}
+
+void CostMapScheduler::InitSource(const TrackedFrameInfo& info) {
+  source_pending_ = false;
+  source_Tcw_ = info.Tcw.clone();
+  source_num_inliers_ = info.num_inliers;
+
+  // Median inverse depth of the keypoints in each cell. Cells without stereo
+  // depth get the median of the whole frame. Without any depth, the points
+  // are assumed to be at infinity and only the rotation is compensated.
+  const int cols =
+      (source_cost_map_.cols + kDepthCellSize - 1) / kDepthCellSize;
+  const int rows =
+      (source_cost_map_.rows + kDepthCellSize - 1) / kDepthCellSize;
+  std::vector<std::vector<float>> cells(rows * cols);
+  std::vector<float> all;
+  for (size_t i = 0; i < info.keypoints.size(); i++) {
+    if (info.depths[i] <= 0) {
+      continue;
+    }
+    const cv::Point2f& pt = info.keypoints[i].pt;
+    const int col = std::min(
+        cols - 1, std::max(0, static_cast<int>(pt.x) / kDepthCellSize));
+    const int row = std::min(
+        rows - 1, std::max(0, static_cast<int>(pt.y) / kDepthCellSize));
+    cells[row * cols + col].push_back(1.0f / info.depths[i]);
+    all.push_back(1.0f / info.depths[i]);
+  }
+
+  const float default_inv_depth = all.empty() ? 0.0f : Median(&all);
+  source_inv_depth_ = cv::Mat(rows, cols, CV_32F);
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      std::vector<float>& cell = cells[row * cols + col];
+      source_inv_depth_.at<float>(row, col) =
+          cell.empty() ? default_inv_depth : Median(&cell);
+    }
+  }
+}
+
+float CostMapScheduler::Warp(const cv::Mat& T_dst_src,
+                             const cv::Mat& K,
+                             cv::Mat* warped) {
+  const int width = source_cost_map_.cols;
+  const int height = source_cost_map_.rows;
+  const float fx = K.at<float>(0, 0);
+  const float fy = K.at<float>(1, 1);
+  const float cx = K.at<float>(0, 2);
+  const float cy = K.at<float>(1, 2);
+
+  const cv::Mat T_src_dst = InverseTransform(T_dst_src);
+  cv::Matx33f R;
+  cv::Vec3f t;
+  for (int r = 0; r < 3; r++) {
+    for (int c = 0; c < 3; c++) {
+      R(r, c) = T_src_dst.at<float>(r, c);
+    }
+    t[r] = T_src_dst.at<float>(r, 3);
+  }
+
+  // The depth of a destination pixel is approximated by the depth of the
+  // same pixel in the source frame, which holds for the small motion
+  // between frames.
+  const cv::Size coarse_size((width + kWarpStride - 1) / kWarpStride + 1,
+                             (height + kWarpStride - 1) / kWarpStride + 1);
+  cv::Mat inv_depth;
+  cv::resize(source_inv_depth_, inv_depth, coarse_size, 0, 0,
+             cv::INTER_LINEAR);
+
+  cv::Mat coarse_map_x(coarse_size, CV_32F);
+  cv::Mat coarse_map_y(coarse_size, CV_32F);
+  const float scale_x = static_cast<float>(width) / coarse_size.width;
+  const float scale_y = static_cast<float>(height) / coarse_size.height;
+  int num_covered = 0;
+  for (int i = 0; i < coarse_size.height; i++) {
+    // Pixel coordinates of the coarse samples follow the cv::resize
+    // convention so that resizing the maps interpolates them exactly
+    const float y = (i + 0.5f) * scale_y - 0.5f;
+    for (int j = 0; j < coarse_size.width; j++) {
+      const float x = (j + 0.5f) * scale_x - 0.5f;
+      const cv::Vec3f ray((x - cx) / fx, (y - cy) / fy, 1.0f);
+      // Point in the source frame scaled by its inverse depth
+      const cv::Vec3f p = R * ray + t * inv_depth.at<float>(i, j);
+
+      float u = -1.0f;
+      float v = -1.0f;
+      if (p[2] > 1e-6f) {
+        u = fx * p[0] / p[2] + cx;
+        v = fy * p[1] / p[2] + cy;
+        if (u >= 0 && u <= width - 1 && v >= 0 && v <= height - 1) {
+          num_covered++;
+        }
+      }
+      coarse_map_x.at<float>(i, j) = u;
+      coarse_map_y.at<float>(i, j) = v;
+    }
+  }
+
+  cv::Mat map_x, map_y;
+  cv::resize(coarse_map_x, map_x, source_cost_map_.size(), 0, 0,
+             cv::INTER_LINEAR);
+  cv::resize(coarse_map_y, map_y, source_cost_map_.size(), 0, 0,
+             cv::INTER_LINEAR);
+  // Regions that were not visible in the source frame take the cost of the
+  // closest visible pixel
+  cv::remap(source_cost_map_, *warped, map_x, map_y, cv::INTER_LINEAR,
+            cv::BORDER_REPLICATE);
+
+  return static_cast<float>(num_covered) / coarse_size.area();
+}
+
+std::string CostMapScheduler::GetSummary() const {
+  const float skipped =
+      stats_.num_frames > 0
+          ? 100.0f * (stats_.num_frames - stats_.num_inferences) /
+                stats_.num_frames
+          : 0.0f;
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(1) << "Cost map scheduler: "
+     << stats_.num_frames << " frames, " << stats_.num_inferences
+     << " inferences (" << skipped << "% skipped), early reruns: "
+     << stats_.num_reruns_tracking << " tracking, "
+     << stats_.num_reruns_inliers << " inliers, "
+     << stats_.num_reruns_coverage << " coverage";
+  return ss.str();
+}
+
+}  // namespace ORB_SLAM2
@@ -81,7 +81,7 @@ void FeatureEvaluator::LoadImagePair(cv::Mat img_prev, cv::Mat img_curr) {
 
 void FeatureEvaluator::EvaluateFeatures(ORB_SLAM2::Frame& prev_frame,
                                         ORB_SLAM2::Frame& curr_frame) {
-  unique_lock<mutex> lock(MapPoint::mGlobalMutex);
+  unique_lock<mutex> lock(curr_frame.mpContext->mMutexPointPos);
   // TODO (srabiee): uncomment this and scale the ground truth
   cv::Mat tf_prev_to_curr =
       CalculateRelativeTransform(curr_frame.mTwc_gt, prev_frame.mTwc_gt);
@@ -1045,11 +1045,10 @@ void FeatureEvaluator::SaveImagesToFile(std::string target_path,
   const bool kDrawSelectedForTrainingFlag = true;
   const bool kSaveColoredHeatmaps = true;
   const bool kSaveColoredMaskedHeatmaps = true;
-  static bool first_call = true;
 
   string img_name_truncated = img_name.substr(0, img_name.length() - 4);
 
-  if (first_call) {
+  if (!output_dirs_created_) {
     RemoveDirectory(target_path + "/feature_qual/");
     RemoveDirectory(target_path + "/feature_matching/");
     RemoveDirectory(target_path + "/bad_matched_features/");
@@ -1165,7 +1164,7 @@ void FeatureEvaluator::SaveImagesToFile(std::string target_path,
   //     cv::imwrite(err_norm_factor_path, img_err_normalization_factor_);
   //   }
 
-  first_call = false;
+  output_dirs_created_ = true;
 }
 
 bool FeatureEvaluator::GetGTReprojection(const ORB_SLAM2::Frame& ref_frame,
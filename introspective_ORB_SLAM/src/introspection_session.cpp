@@ -0,0 +1,246 @@
+// Copyright 2019 srabiee@cs.utexas.edu
+// College of Information and Computer Sciences,
+// University of Texas at Austin
+//
+//
+// This software is free: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License Version 3,
+// as published by the Free Software Foundation.
+//
+// This software is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// Version 3 in the file COPYING that came with this distribution.
+// If not, see <http://www.gnu.org/licenses/>.
+// ========================================================================
+
+#include "introspection_session.h"
+
+#include <glog/logging.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <sstream>
+
+#if defined(__has_include)
+#if __has_include(<torch/version.h>)
+#include <torch/version.h>
+#endif
+#endif
+
+#include "torch_helpers.h"
+
+// c10::InferenceMode is available since libtorch 1.9 and freezing a module
+// from C++ since 1.10. Older versions fall back to NoGradGuard and eval().
+#if defined(TORCH_VERSION_MAJOR) && \
+    (TORCH_VERSION_MAJOR > 1 || TORCH_VERSION_MINOR >= 9)
+#define IVSLAM_HAS_INFERENCE_MODE 1
+#endif
+#if defined(TORCH_VERSION_MAJOR) && \
+    (TORCH_VERSION_MAJOR > 1 || TORCH_VERSION_MINOR >= 10)
+#define IVSLAM_HAS_JIT_FREEZE 1
+#endif
+
+DEFINE_int32(introspection_num_threads,
+             2,
+             "Number of intra-op threads used by libtorch for running the "
+             "introspection function on the CPU. Kept low so that inference "
+             "does not compete with the SLAM threads. 0 keeps the libtorch "
+             "default (one per core).");
+DEFINE_int32(introspection_num_interop_threads,
+             1,
+             "Number of inter-op threads used by libtorch. 0 keeps the "
+             "libtorch default.");
+DEFINE_int32(introspection_warmup_iters,
+             3,
+             "Number of forward passes run before the first frame so that "
+             "the JIT profiling runs do not slow down tracking.");
+DEFINE_bool(introspection_freeze_model,
+            true,
+            "Freezes and optimizes the introspection model for inference "
+            "when supported by the libtorch version.");
+DEFINE_string(introspection_quantized_engine,
+              "",
+              "Backend for int8 quantized introspection models: fbgemm "
+              "(x86) or qnnpack (ARM). Must match the engine the model was "
+              "exported for. The libtorch default is kept if empty.");
+
+namespace ORB_SLAM2 {
+
+namespace {
+
+// Selects the backend that runs the quantized operators. Returns false if
+// the engine is unknown or not built into libtorch.
+bool SetQuantizedEngine(const std::string& name) {
+  at::QEngine engine;
+  if (name == "fbgemm") {
+    engine = at::QEngine::FBGEMM;
+  } else if (name == "qnnpack") {
+    engine = at::QEngine::QNNPACK;
+  } else {
+    LOG(ERROR) << "Unknown quantized engine " << name;
+    return false;
+  }
+
+  const std::vector<at::QEngine>& supported =
+      at::globalContext().supportedQEngines();
+  if (std::find(supported.begin(), supported.end(), engine) ==
+      supported.end()) {
+    LOG(ERROR) << "Quantized engine " << name
+               << " is not supported by this libtorch build";
+    return false;
+  }
+  at::globalContext().setQEngine(engine);
+  return true;
+}
+
+}  // namespace
+
+bool IntrospectionSession::Load(const std::string& model_path,
+                                const bool use_gpu,
+                                const cv::Size& input_size) {
+  // The thread pools are process wide. The inter-op pool can only be sized
+  // before it is first used.
+  if (FLAGS_introspection_num_threads > 0) {
+    at::set_num_threads(FLAGS_introspection_num_threads);
+  }
+  if (FLAGS_introspection_num_interop_threads > 0) {
+    try {
+      at::set_num_interop_threads(FLAGS_introspection_num_interop_threads);
+    } catch (const c10::Error& e) {
+      LOG(WARNING) << "The number of libtorch inter-op threads was already "
+                   << "set. Keeping " << at::get_num_interop_threads();
+    }
+  }
+
+  if (!FLAGS_introspection_quantized_engine.empty() &&
+      !SetQuantizedEngine(FLAGS_introspection_quantized_engine)) {
+    return false;
+  }
+
+  try {
+    // Deserialize the ScriptModule from file
+    module_ = torch::jit::load(model_path);
+
+    if (use_gpu && torch::cuda::is_available()) {
+      std::cout << "Introspection function running on GPU." << std::endl;
+      device_ = torch::kCUDA;
+    }
+    module_.to(device_);
+    module_.eval();
+
+#ifdef IVSLAM_HAS_JIT_FREEZE
+    if (FLAGS_introspection_freeze_model) {
+      module_ = torch::jit::freeze(module_);
+      module_ = torch::jit::optimize_for_inference(module_);
+    }
+#endif
+  } catch (const c10::Error& e) {
+    LOG(ERROR) << "Error loading the introspection model from " << model_path
+               << ": " << e.msg();
+    return false;
+  }
+
+  input_size_ = input_size;
+  loaded_ = true;
+  return true;
+}
+
+void IntrospectionSession::Warmup(const cv::Size& image_size) {
+  std::call_once(
+      warmup_flag_, &IntrospectionSession::RunWarmup, this, image_size);
+}
+
+void IntrospectionSession::RunWarmup(const cv::Size& image_size) {
+  CHECK(loaded_) << "The introspection model is not loaded.";
+  const cv::Mat img = cv::Mat::zeros(image_size, CV_8UC3);
+  const at::Tensor input = ToInputTensor(img);
+  for (int i = 0; i < FLAGS_introspection_warmup_iters; i++) {
+    // Copying the output to the CPU waits for the GPU to finish
+    Forward(input).to(torch::kCPU);
+  }
+}
+
+cv::Mat IntrospectionSession::Predict(const cv::Mat& img_bgr) {
+  Warmup(img_bgr.size());
+
+  std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+  at::Tensor cost_img = Forward(ToInputTensor(img_bgr));
+  cost_img = (cost_img * 255.0).to(torch::kByte);
+  cost_img = cost_img.to(torch::kCPU).contiguous();
+
+  // ToCvImage does not copy the tensor data
+  cv::Mat cost_img_cv = ToCvImage(cost_img).clone();
+  if (!input_size_.empty()) {
+    cv::resize(cost_img_cv, cost_img_cv, img_bgr.size());
+  }
+
+  std::chrono::steady_clock::time_point t2 = std::chrono::steady_clock::now();
+  const float latency_ms =
+      std::chrono::duration_cast<std::chrono::duration<float, std::milli>>(
+          t2 - t1)
+          .count();
+  {
+    std::lock_guard<std::mutex> lock(latency_mutex_);
+    latencies_ms_.Add(latency_ms);
+  }
+
+  return cost_img_cv;
+}
+
+LatencyStats IntrospectionSession::GetLatencyStats() const {
+  std::lock_guard<std::mutex> lock(latency_mutex_);
+  return latencies_ms_.GetStats();
+}
+
+std::string IntrospectionSession::GetLatencySummary() const {
+  const LatencyStats stats = GetLatencyStats();
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(2) << "Introspection function: "
+     << stats.count << " calls, mean " << stats.mean << " ms, p50 "
+     << stats.p50 << " ms, p99 " << stats.p99 << " ms, max " << stats.max
+     << " ms";
+  return ss.str();
+}
+
+at::Tensor IntrospectionSession::ToInputTensor(const cv::Mat& img_bgr) const {
+  cv::Mat img_rgb;
+  cv::cvtColor(img_bgr, img_rgb, cv::COLOR_BGR2RGB);
+  if (!input_size_.empty()) {
+    cv::resize(img_rgb, img_rgb, input_size_);
+  }
+
+  // Convert to float and normalize image
+  img_rgb.convertTo(img_rgb, CV_32FC3, 1.0 / 255.0);
+  cv::subtract(img_rgb, cv::Scalar(0.485, 0.456, 0.406), img_rgb);
+  cv::divide(img_rgb, cv::Scalar(0.229, 0.224, 0.225), img_rgb);
+
+  at::Tensor tensor_img = CVImgToTensor(img_rgb);
+  // Swap axis
+  tensor_img = TransposeTensor(tensor_img, {(2), (0), (1)});
+  // Add batch dim
+  tensor_img.unsqueeze_(0);
+
+  // The tensor wraps img_rgb, which goes out of scope, so always copy
+  return tensor_img.to(tensor_img.options().device(device_),
+                       /*non_blocking=*/false,
+                       /*copy=*/true);
+}
+
+at::Tensor IntrospectionSession::Forward(const at::Tensor& input) {
+#ifdef IVSLAM_HAS_INFERENCE_MODE
+  c10::InferenceMode guard;
+#else
+  torch::NoGradGuard guard;
+#endif
+  std::vector<torch::jit::IValue> inputs{input};
+  return module_.forward(inputs).toTensor();
+}
+
+}  // namespace ORB_SLAM2
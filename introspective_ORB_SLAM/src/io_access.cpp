@@ -19,6 +19,11 @@
 
 #include "io_access.h"
 
+#include <cctype>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
 namespace ORB_SLAM2 {
 
 using std::string;
@@ -64,5 +69,116 @@ bool WriteJsonToFile( const string& path,
 
 PFM::PFM() {} 
 
+namespace {
+
+// Reads the next whitespace-delimited token of the PFM header starting at
+// "pos". Returns an empty string if the end of the buffer is reached.
+string ReadHeaderToken( const char* data, size_t size, size_t* pos )
+{
+  while( *pos < size && isspace(static_cast<unsigned char>(data[*pos])) )
+  {
+    ++(*pos);
+  }
+
+  size_t start = *pos;
+  while( *pos < size && !isspace(static_cast<unsigned char>(data[*pos])) )
+  {
+    ++(*pos);
+  }
+
+  return string( data + start, *pos - start );
+}
+
+} // namespace
+
+bool PFM::read_pfm( const string & filename, cv::Mat * img, bool flip_rows )
+{
+  int fd = open( filename.c_str(), O_RDONLY );
+  if( fd < 0 )
+  {
+    std::cerr << "Cannot open file " << filename
+              << ", or it does not exist!" << std::endl;
+    return false;
+  }
+
+  struct stat file_stat;
+  if( fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0 )
+  {
+    std::cerr << "Cannot stat file " << filename << std::endl;
+    close(fd);
+    return false;
+  }
+
+  const size_t file_size = static_cast<size_t>(file_stat.st_size);
+  void* mapped = mmap( NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+  if( mapped == MAP_FAILED )
+  {
+    std::cerr << "Cannot memory-map file " << filename << std::endl;
+    return false;
+  }
+  madvise( mapped, file_size, MADV_SEQUENTIAL );
+
+  const char* data = static_cast<const char*>(mapped);
+  size_t pos = 0;
+  bool success = false;
+
+  if( ReadHeaderToken(data, file_size, &pos) != "Pf" )
+  {
+    std::cerr << "Invalid magic number in " << filename
+              << ". Only grayscale (Pf) PFM files are supported." << std::endl;
+  }
+  else
+  {
+    this->width_ = atoi( ReadHeaderToken(data, file_size, &pos).c_str() );
+    this->height_ = atoi( ReadHeaderToken(data, file_size, &pos).c_str() );
+    this->endianess_ = atof( ReadHeaderToken(data, file_size, &pos).c_str() );
+
+    const size_t row_bytes = static_cast<size_t>(this->width_) * sizeof(float);
+    const size_t raster_bytes = row_bytes * this->height_;
+
+    if( this->width_ <= 0 || this->height_ <= 0 || this->endianess_ == 0.f ||
+        raster_bytes > file_size - pos )
+    {
+      std::cerr << "Malformed PFM header in " << filename << std::endl;
+    }
+    else
+    {
+      // Same as the template reader: the raster occupies the last bytes of
+      // the file, which tolerates any trailing whitespace in the header.
+      const char* raster = data + (file_size - raster_bytes);
+      const bool swap_bytes = this->is_little_big_endianness_swap();
+
+      img->create( this->height_, this->width_, CV_32F );
+      for( int i = 0; i < this->height_; ++i )
+      {
+        const int src_row = flip_rows ? (this->height_ - i - 1) : i;
+        const char* src = raster + src_row * row_bytes;
+        float* dst = img->ptr<float>(i);
+
+        if( swap_bytes )
+        {
+          uint32_t word;
+          for( int j = 0; j < this->width_; ++j )
+          {
+            memcpy( &word, src + j * sizeof(float), sizeof(float) );
+            word = __builtin_bswap32(word);
+            memcpy( &dst[j], &word, sizeof(float) );
+          }
+        }
+        else
+        {
+          memcpy( dst, src, row_bytes );
+        }
+      }
+      success = true;
+    }
+  }
+
+  munmap( mapped, file_size );
+  return success;
+}
+
 } // namespace ORB_SLAM2
 